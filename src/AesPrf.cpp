@@ -0,0 +1,285 @@
+#include "AesPrf.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <openssl/crypto.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AES_PRF_X86 1
+#endif
+
+namespace {
+    constexpr size_t BLOCK_SIZE = 16;
+
+    constexpr uint8_t rotl8(const uint8_t x, const int shift)
+    {
+        return static_cast<uint8_t>((x << shift) | (x >> (8 - shift)));
+    }
+
+    constexpr uint8_t xtime(const uint8_t x)
+    {
+        return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00));
+    }
+
+    // FIPS 197 S-box: the multiplicative inverse in GF(2^8) followed by the affine map. p walks the multiplicative
+    // group through powers of 3 while q walks it backwards, so q = p^-1 at every step.
+    constexpr std::array<uint8_t, 256> make_sbox()
+    {
+        std::array<uint8_t, 256> sbox{};
+        uint8_t p = 1;
+        uint8_t q = 1;
+        do
+        {
+            p = static_cast<uint8_t>(p ^ xtime(p));
+            q = static_cast<uint8_t>(q ^ (q << 1));
+            q = static_cast<uint8_t>(q ^ (q << 2));
+            q = static_cast<uint8_t>(q ^ (q << 4));
+            if (q & 0x80)
+                q ^= 0x09;
+            sbox[p] = static_cast<uint8_t>(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63);
+        } while (p != 1);
+        sbox[0] = 0x63;
+        return sbox;
+    }
+
+    constexpr std::array<uint8_t, 256> SBOX = make_sbox();
+    static_assert(SBOX[0x00] == 0x63 && SBOX[0x01] == 0x7C && SBOX[0x53] == 0xED && SBOX[0xFF] == 0x16);
+
+    // KeyExpansion (FIPS 197, section 5.2), written out as bytes in the order AES-NI loads round keys
+    int expand_key(const std::vector<uint8_t>& key, uint8_t (&round_keys)[15][16])
+    {
+        const size_t nk = key.size() / 4;
+        if (key.size() % 4 != 0 || (nk != 4 && nk != 6 && nk != 8))
+            throw std::invalid_argument("AesPrf: Key must be 128, 192, or 256 bits");
+        const int rounds = static_cast<int>(nk) + 6;
+
+        uint8_t* w = &round_keys[0][0];
+        std::memcpy(w, key.data(), key.size());
+
+        uint8_t rcon = 0x01;
+        for (size_t i = nk; i < 4 * static_cast<size_t>(rounds + 1); ++i)
+        {
+            uint8_t temp[4];
+            std::memcpy(temp, w + 4 * (i - 1), 4);
+            if (i % nk == 0)
+            {
+                const uint8_t first = temp[0];
+                temp[0] = static_cast<uint8_t>(SBOX[temp[1]] ^ rcon);
+                temp[1] = SBOX[temp[2]];
+                temp[2] = SBOX[temp[3]];
+                temp[3] = SBOX[first];
+                rcon = xtime(rcon);
+            }
+            else if (nk > 6 && i % nk == 4)
+            {
+                for (auto& byte : temp)
+                    byte = SBOX[byte];
+            }
+            for (size_t j = 0; j < 4; ++j)
+                w[4 * i + j] = static_cast<uint8_t>(w[4 * (i - nk) + j] ^ temp[j]);
+        }
+        return rounds;
+    }
+}
+
+AesPrf::AesPrf(const std::vector<uint8_t>& key)
+    : _rounds(expand_key(key, _round_keys))
+    , _encrypt(select(active_backend()))
+{
+    if (active_backend() == Backend::Portable)
+    {
+        _portable = std::make_unique<AES_KEY>();
+        if (AES_set_encrypt_key(key.data(), static_cast<int>(key.size() * 8), _portable.get()) != 0)
+            throw std::runtime_error("AesPrf: Failed to initialize AES key");
+    }
+}
+
+AesPrf::~AesPrf() noexcept
+{
+    OPENSSL_cleanse(_round_keys, sizeof(_round_keys));
+    if (_portable)
+        OPENSSL_cleanse(_portable.get(), sizeof(AES_KEY));
+}
+
+void AesPrf::encrypt_blocks(const Backend backend, const uint8_t* in, uint8_t* out, const size_t blocks) const
+{
+    if (!supported(backend))
+        throw std::invalid_argument("AesPrf: Backend not supported by this CPU");
+    select(backend)(*this, in, out, blocks);
+}
+
+AesPrf::Encrypt AesPrf::select(const Backend backend) noexcept
+{
+    switch (backend)
+    {
+    case Backend::Vaes: return &encrypt_vaes;
+    case Backend::AesNi: return &encrypt_aesni;
+    case Backend::Portable: break;
+    }
+    return &encrypt_portable;
+}
+
+AesPrf::Backend AesPrf::active_backend() noexcept
+{
+    static const Backend backend = supported(Backend::Vaes)    ? Backend::Vaes
+                                   : supported(Backend::AesNi) ? Backend::AesNi
+                                                               : Backend::Portable;
+    return backend;
+}
+
+void AesPrf::encrypt_portable(const AesPrf& prf, const uint8_t* in, uint8_t* out, const size_t blocks)
+{
+    if (prf._portable)
+    {
+        for (size_t i = 0; i < blocks; ++i)
+            AES_encrypt(in + i * BLOCK_SIZE, out + i * BLOCK_SIZE, prf._portable.get());
+        return;
+    }
+
+    // Asked for explicitly on a CPU with hardware AES, e.g. by a test: expand a schedule for this call only. The key
+    // is the first Nk words of the FIPS 197 schedule.
+    AES_KEY key;
+    const int key_bits = (prf._rounds - 6) * 32;
+    if (AES_set_encrypt_key(&prf._round_keys[0][0], key_bits, &key) != 0)
+        throw std::runtime_error("AesPrf: Failed to initialize AES key");
+    for (size_t i = 0; i < blocks; ++i)
+        AES_encrypt(in + i * BLOCK_SIZE, out + i * BLOCK_SIZE, &key);
+    OPENSSL_cleanse(&key, sizeof(key));
+}
+
+#ifdef AES_PRF_X86
+
+bool AesPrf::supported(const Backend backend) noexcept
+{
+    static const bool aesni = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("aes") != 0;
+    }();
+    static const bool vaes = aesni && __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx512f");
+
+    switch (backend)
+    {
+    case Backend::Vaes: return vaes;
+    case Backend::AesNi: return aesni;
+    case Backend::Portable: return true;
+    }
+    return false;
+}
+
+namespace {
+    // N independent blocks through every round together, so their AESENC latencies overlap
+    template <size_t N>
+    __attribute__((target("aes,sse2"))) inline void aesni_blocks(
+        const __m128i* keys, const int rounds, const uint8_t* in, uint8_t* out
+    )
+    {
+        __m128i state[N];
+        for (size_t j = 0; j < N; ++j)
+            state[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + j * BLOCK_SIZE)), keys[0]);
+        for (int r = 1; r < rounds; ++r)
+        {
+            for (size_t j = 0; j < N; ++j)
+                state[j] = _mm_aesenc_si128(state[j], keys[r]);
+        }
+        for (size_t j = 0; j < N; ++j)
+        {
+            state[j] = _mm_aesenclast_si128(state[j], keys[rounds]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j * BLOCK_SIZE), state[j]);
+        }
+    }
+}
+
+__attribute__((target("aes,sse2")))
+void AesPrf::encrypt_aesni(const AesPrf& prf, const uint8_t* in, uint8_t* out, size_t blocks)
+{
+    __m128i keys[15];
+    for (int r = 0; r <= prf._rounds; ++r)
+        keys[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(prf._round_keys[r]));
+
+    for (; blocks >= 8; blocks -= 8, in += 8 * BLOCK_SIZE, out += 8 * BLOCK_SIZE)
+        aesni_blocks<8>(keys, prf._rounds, in, out);
+    if (blocks >= 4)
+    {
+        aesni_blocks<4>(keys, prf._rounds, in, out);
+        blocks -= 4, in += 4 * BLOCK_SIZE, out += 4 * BLOCK_SIZE;
+    }
+    if (blocks >= 2)
+    {
+        aesni_blocks<2>(keys, prf._rounds, in, out);
+        blocks -= 2, in += 2 * BLOCK_SIZE, out += 2 * BLOCK_SIZE;
+    }
+    if (blocks == 1)
+        aesni_blocks<1>(keys, prf._rounds, in, out);
+}
+
+// Four blocks per 512-bit register and up to four registers in flight. A tail of one to three blocks uses a masked
+// load and store.
+__attribute__((target("vaes,avx512f")))
+void AesPrf::encrypt_vaes(const AesPrf& prf, const uint8_t* in, uint8_t* out, size_t blocks)
+{
+    // Below one full register the 128-bit instructions are faster
+    if (blocks < 4)
+    {
+        encrypt_aesni(prf, in, out, blocks);
+        return;
+    }
+
+    __m512i keys[15];
+    for (int r = 0; r <= prf._rounds; ++r)
+    {
+        const __m128i key = _mm_load_si128(reinterpret_cast<const __m128i*>(prf._round_keys[r]));
+        keys[r] = _mm512_maskz_broadcast_i32x4(0xFFFF, key);
+    }
+
+    while (blocks > 0)
+    {
+        // Registers this pass fills, the last one possibly partial
+        const size_t count = std::min<size_t>((blocks + 3) / 4, 4);
+        const size_t tail = std::min<size_t>(blocks - 4 * (count - 1), 4);
+        const auto tail_mask = static_cast<__mmask8>((1u << (2 * tail)) - 1);
+
+        __m512i state[4];
+        for (size_t j = 0; j < count; ++j)
+        {
+            const __mmask8 mask = j + 1 == count ? tail_mask : 0xFF;
+            state[j] = _mm512_xor_si512(_mm512_maskz_loadu_epi64(mask, in + 4 * j * BLOCK_SIZE), keys[0]);
+        }
+        for (int r = 1; r < prf._rounds; ++r)
+        {
+            for (size_t j = 0; j < count; ++j)
+                state[j] = _mm512_aesenc_epi128(state[j], keys[r]);
+        }
+        for (size_t j = 0; j < count; ++j)
+        {
+            const __mmask8 mask = j + 1 == count ? tail_mask : 0xFF;
+            state[j] = _mm512_aesenclast_epi128(state[j], keys[prf._rounds]);
+            _mm512_mask_storeu_epi64(out + 4 * j * BLOCK_SIZE, mask, state[j]);
+        }
+
+        const size_t done = 4 * (count - 1) + tail;
+        blocks -= done;
+        in += done * BLOCK_SIZE;
+        out += done * BLOCK_SIZE;
+    }
+}
+
+#else
+
+bool AesPrf::supported(const Backend backend) noexcept
+{
+    return backend == Backend::Portable;
+}
+
+void AesPrf::encrypt_aesni(const AesPrf& prf, const uint8_t* in, uint8_t* out, const size_t blocks)
+{
+    encrypt_portable(prf, in, out, blocks);
+}
+
+void AesPrf::encrypt_vaes(const AesPrf& prf, const uint8_t* in, uint8_t* out, const size_t blocks)
+{
+    encrypt_portable(prf, in, out, blocks);
+}
+
+#endif
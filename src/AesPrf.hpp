@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <openssl/aes.h>
+
+// AES-128/192/256 forward cipher for the FPE round functions (CIPH_K in NIST SP 800-38G).
+//
+// The implementation is picked once from CPUID: VAES over AVX-512 (four blocks per instruction), AES-NI (up to eight
+// independent blocks in flight), or OpenSSL's portable AES_encrypt. All of them give identical output. Only the
+// portable backend needs OpenSSL's own key schedule, so it is expanded only where that backend is the active one.
+// Only encryption is needed; FF1 and FF3-1 never run AES backwards.
+class AesPrf
+{
+  public:
+    enum class Backend
+    {
+        Portable,
+        AesNi,
+        Vaes
+    };
+
+    explicit AesPrf(const std::vector<uint8_t>& key);
+    ~AesPrf() noexcept;
+
+    AesPrf(const AesPrf&) = delete;
+    AesPrf& operator=(const AesPrf&) = delete;
+
+    // One block. in and out may be the same memory.
+    void encrypt(const uint8_t* in, uint8_t* out) const { _encrypt(*this, in, out, 1); }
+
+    // Independent blocks, e.g. one per lane of a batch. in and out may be the same memory.
+    void encrypt_blocks(const uint8_t* in, uint8_t* out, const size_t blocks) const
+    {
+        _encrypt(*this, in, out, blocks);
+    }
+
+    // Same, on an explicit backend, for tests and benchmarks. The backend must be supported().
+    void encrypt_blocks(Backend backend, const uint8_t* in, uint8_t* out, size_t blocks) const;
+
+    static bool supported(Backend backend) noexcept;
+
+    // Fastest supported backend; what encrypt() and encrypt_blocks() use
+    static Backend active_backend() noexcept;
+
+  private:
+    using Encrypt = void (*)(const AesPrf&, const uint8_t*, uint8_t*, size_t);
+
+    alignas(16) uint8_t _round_keys[15][16]{}; // FIPS 197 key schedule, one 16-byte round key per row
+    int _rounds = 0;
+    std::unique_ptr<AES_KEY> _portable; // only when the portable backend is active
+    Encrypt _encrypt = nullptr;
+
+    static Encrypt select(Backend backend) noexcept;
+    static void encrypt_portable(const AesPrf& prf, const uint8_t* in, uint8_t* out, size_t blocks);
+    static void encrypt_aesni(const AesPrf& prf, const uint8_t* in, uint8_t* out, size_t blocks);
+    static void encrypt_vaes(const AesPrf& prf, const uint8_t* in, uint8_t* out, size_t blocks);
+};
@@ -0,0 +1,380 @@
+#include "CipherIndexSnapshot.hpp"
+#include "UnicodeGlyphCipherIndex.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr char MAGIC[8] = {'F', 'P', 'E', 'I', 'N', 'D', 'E', 'X'};
+    constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+    enum SetKind : uint32_t {
+        CODEPOINT_RANGE = 0,
+        GLYPHS = 1,
+        NOOP_GLYPHS = 2
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t header_size;
+        uint32_t page_bits;
+        uint64_t file_size;
+        uint64_t checksum; // of every byte after the header
+        uint32_t set_count;
+        uint32_t page_count;
+        uint64_t sets_offset;
+        uint64_t names_offset;
+        uint64_t names_size;
+        uint64_t glyphs_offset;
+        uint64_t glyphs_size;
+        uint64_t directory_offset;
+        uint64_t pages_offset;
+    };
+    static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) == 104);
+
+    uint64_t align_section(const uint64_t offset)
+    {
+        return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    }
+
+    // FNV-1a over 64-bit words, then the tail bytes. Catches corruption, not tampering: the file holds no secrets.
+    uint64_t checksum(const std::byte* data, const size_t size)
+    {
+        constexpr uint64_t prime = 0x100000001B3;
+        uint64_t hash = 0xCBF29CE484222325;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof word);
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < size; ++i)
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * prime;
+        return hash;
+    }
+
+    [[noreturn]] void fail(const std::string& why)
+    {
+        throw std::runtime_error("CipherIndexSnapshot: " + why);
+    }
+}
+
+struct CipherIndexSnapshot::SetRecord
+{
+    uint32_t kind;
+    uint32_t strategy; // GlyphIndexStrategy of an IndexedGlyphSet
+    uint32_t first;    // code point range
+    uint32_t last;
+    uint64_t name_offset; // into the names section
+    uint64_t name_size;
+    uint64_t glyphs_offset; // into the glyphs section
+    uint64_t glyph_count;
+    uint32_t glyph_size;
+    uint32_t reserved;
+};
+
+void CipherIndexSnapshot::write(const std::string& path, const UnicodeGlyphCipherIndex& index)
+{
+    const size_t set_count = index.cipher_count();
+    std::vector<SetRecord> sets(set_count);
+    std::string names;
+    std::string glyphs;
+    for (size_t id = 0; id < set_count; ++id)
+    {
+        const GlyphFPECipher& cipher = index.cipher(static_cast<uint16_t>(id));
+        SetRecord& set = sets[id];
+        std::string_view name;
+        if (const CodepointRangeGlyphSet* range = cipher.codepoint_range())
+        {
+            set.kind = CODEPOINT_RANGE;
+            set.first = range->first_codepoint();
+            set.last = range->last_codepoint();
+            name = range->name();
+        }
+        else
+        {
+            const IndexedGlyphSet& indexed = cipher.glyphs();
+            set.kind = cipher.is_noop() ? NOOP_GLYPHS : GLYPHS;
+            set.strategy = static_cast<uint32_t>(indexed.index_strategy());
+            set.glyph_size = static_cast<uint32_t>(indexed.glyph_size());
+            set.glyph_count = indexed.size();
+            set.glyphs_offset = glyphs.size();
+            glyphs.append(indexed.data(), indexed.size() * indexed.glyph_size());
+            name = indexed.name();
+        }
+        set.name_offset = names.size();
+        set.name_size = name.size();
+        names.append(name);
+    }
+
+    const CodepointCipherTable& table = index.table();
+    const auto directory = table.directory();
+    const auto pages = table.pages();
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof header.magic);
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.header_size = sizeof(Header);
+    header.page_bits = CodepointCipherTable::PAGE_BITS;
+    header.set_count = static_cast<uint32_t>(set_count);
+    header.page_count = static_cast<uint32_t>(table.page_count());
+    header.sets_offset = align_section(sizeof(Header));
+    header.names_offset = align_section(header.sets_offset + sets.size() * sizeof(SetRecord));
+    header.names_size = names.size();
+    header.glyphs_offset = align_section(header.names_offset + names.size());
+    header.glyphs_size = glyphs.size();
+    header.directory_offset = align_section(header.glyphs_offset + glyphs.size());
+    header.pages_offset = align_section(header.directory_offset + directory.size_bytes());
+    header.file_size = header.pages_offset + pages.size_bytes();
+
+    std::vector<std::byte> file(header.file_size);
+    std::memcpy(file.data() + header.sets_offset, sets.data(), sets.size() * sizeof(SetRecord));
+    std::memcpy(file.data() + header.names_offset, names.data(), names.size());
+    std::memcpy(file.data() + header.glyphs_offset, glyphs.data(), glyphs.size());
+    std::memcpy(file.data() + header.directory_offset, directory.data(), directory.size_bytes());
+    std::memcpy(file.data() + header.pages_offset, pages.data(), pages.size_bytes());
+    header.checksum = checksum(file.data() + sizeof(Header), file.size() - sizeof(Header));
+    std::memcpy(file.data(), &header, sizeof(Header));
+
+    // A temporary of its own in the same directory, so concurrent writers never share one and the rename stays
+    // within one file system. It reaches the disk before the rename, and the directory entry is synced after it where
+    // the file system allows.
+    std::string temporary = path + ".XXXXXX";
+    const int fd = ::mkstemp(temporary.data());
+    if (fd < 0)
+        fail("cannot create a temporary file next to " + path);
+    auto abandon = [&](const std::string& why) {
+        ::close(fd);
+        ::unlink(temporary.c_str());
+        fail(why);
+    };
+
+    const auto* bytes = reinterpret_cast<const char*>(file.data());
+    for (size_t written = 0; written < file.size();)
+    {
+        const ssize_t count = ::write(fd, bytes + written, file.size() - written);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            abandon("cannot write " + temporary);
+        written += static_cast<size_t>(count);
+    }
+    // mkstemp creates the file readable by its owner only; snapshots are shared by every process on the host
+    if (::fchmod(fd, 0644) != 0 || ::fsync(fd) != 0)
+        abandon("cannot sync " + temporary);
+    if (::close(fd) != 0)
+    {
+        ::unlink(temporary.c_str());
+        fail("cannot write " + temporary);
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        ::unlink(temporary.c_str());
+        fail("cannot rename " + temporary + " to " + path + ": " + error.message());
+    }
+
+    const std::filesystem::path parent = std::filesystem::absolute(path).parent_path();
+    const int directory_fd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd >= 0)
+    {
+        ::fsync(directory_fd);
+        ::close(directory_fd);
+    }
+}
+
+std::shared_ptr<const CipherIndexSnapshot> CipherIndexSnapshot::open(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        fail("cannot open " + path);
+    struct stat status{};
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header)))
+    {
+        ::close(fd);
+        fail(path + " is too short to be a snapshot");
+    }
+    const auto size = static_cast<size_t>(status.st_size);
+    void* base = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+        fail("cannot map " + path);
+
+    // Owned before validating, so a bad file is unmapped on the way out
+    std::shared_ptr<CipherIndexSnapshot> snapshot(new CipherIndexSnapshot(static_cast<const std::byte*>(base), size));
+    snapshot->validate();
+    return snapshot;
+}
+
+CipherIndexSnapshot::CipherIndexSnapshot(const std::byte* base, const size_t size)
+    : _base(base)
+    , _size(size)
+{
+}
+
+CipherIndexSnapshot::~CipherIndexSnapshot()
+{
+    ::munmap(const_cast<std::byte*>(_base), _size);
+}
+
+// Everything is checked once here so that lookups and create_cipher() can trust the mapping
+void CipherIndexSnapshot::validate()
+{
+    Header header;
+    std::memcpy(&header, _base, sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof header.magic) != 0)
+        fail("not a cipher index snapshot");
+    if (header.version != VERSION)
+        fail("unsupported version " + std::to_string(header.version));
+    if (header.byte_order != BYTE_ORDER_MARK || header.header_size != sizeof(Header)
+        || header.page_bits != CodepointCipherTable::PAGE_BITS)
+        fail("written for a different platform or table layout");
+    if (header.file_size != _size)
+        fail("file is " + std::to_string(_size) + " bytes, expected " + std::to_string(header.file_size));
+    if (checksum(_base + sizeof(Header), _size - sizeof(Header)) != header.checksum)
+        fail("checksum mismatch");
+
+    if (header.set_count == 0 || header.set_count >= CodepointCipherTable::NO_CIPHER)
+        fail("invalid glyph set count");
+    if (header.page_count == 0 || header.page_count > size_t{UINT16_MAX} + 1)
+        fail("invalid page count");
+    auto check_section = [&](const uint64_t offset, const uint64_t bytes) {
+        if (offset % SECTION_ALIGNMENT != 0 || offset > _size || bytes > _size - offset)
+            fail("section out of bounds");
+    };
+    check_section(header.sets_offset, uint64_t{header.set_count} * sizeof(SetRecord));
+    check_section(header.names_offset, header.names_size);
+    check_section(header.glyphs_offset, header.glyphs_size);
+    check_section(header.directory_offset, uint64_t{CodepointCipherTable::PAGE_COUNT} * sizeof(uint16_t));
+    check_section(header.pages_offset, uint64_t{header.page_count} * CodepointCipherTable::PAGE_SIZE * sizeof(uint16_t));
+
+    _sets = reinterpret_cast<const SetRecord*>(_base + header.sets_offset);
+    _set_count = header.set_count;
+    _names = reinterpret_cast<const char*>(_base + header.names_offset);
+    _glyphs = reinterpret_cast<const char*>(_base + header.glyphs_offset);
+    _directory = {reinterpret_cast<const uint16_t*>(_base + header.directory_offset), CodepointCipherTable::PAGE_COUNT};
+    _pages = {reinterpret_cast<const uint16_t*>(_base + header.pages_offset),
+              size_t{header.page_count} * CodepointCipherTable::PAGE_SIZE};
+
+    for (const uint16_t page : _directory)
+        if (page >= header.page_count)
+            fail("directory names a missing page");
+    for (size_t i = 0; i < _pages.size(); ++i)
+    {
+        const uint16_t id = _pages[i];
+        if (id == CodepointCipherTable::NO_CIPHER)
+            continue;
+        if (id >= _set_count || i < CodepointCipherTable::PAGE_SIZE)
+            fail("page maps a code point to a missing glyph set");
+    }
+
+    _ranges.resize(_set_count);
+    _indexed.resize(_set_count);
+    for (size_t id = 0; id < _set_count; ++id)
+    {
+        const SetRecord& set = _sets[id];
+        if (set.name_offset > header.names_size || set.name_size > header.names_size - set.name_offset)
+            fail("glyph set name out of bounds");
+        if (set.kind == CODEPOINT_RANGE)
+        {
+            try
+            {
+                _ranges[id].emplace(name_of(set), set.first, set.last);
+            }
+            catch (const std::invalid_argument& e)
+            {
+                fail(std::string("invalid code point range: ") + e.what());
+            }
+        }
+        else if (set.kind == GLYPHS || set.kind == NOOP_GLYPHS)
+        {
+            if (set.glyph_size < 1 || set.glyph_size > 4 || set.glyph_count < 2
+                || set.strategy > static_cast<uint32_t>(GlyphIndexStrategy::Hash))
+                fail("invalid glyph set " + std::string(name_of(set)));
+            if (set.glyphs_offset > header.glyphs_size
+                || set.glyph_count > (header.glyphs_size - set.glyphs_offset) / set.glyph_size)
+                fail("glyphs out of bounds");
+        }
+        else
+            fail("unknown glyph set kind " + std::to_string(set.kind));
+    }
+}
+
+std::string_view CipherIndexSnapshot::name_of(const SetRecord& set) const noexcept
+{
+    return {_names + set.name_offset, set.name_size};
+}
+
+std::string_view CipherIndexSnapshot::glyph_set_name(const uint16_t id) const
+{
+    if (id >= _set_count)
+        throw std::out_of_range("CipherIndexSnapshot: no glyph set " + std::to_string(id));
+    return name_of(_sets[id]);
+}
+
+CodepointCipherTable CipherIndexSnapshot::table() const
+{
+    return CodepointCipherTable::over(_directory, _pages);
+}
+
+const IndexedGlyphSet& CipherIndexSnapshot::indexed_set(const uint16_t id) const
+{
+    std::lock_guard lock(_indexed_mutex);
+    if (!_indexed[id])
+    {
+        const SetRecord& set = _sets[id];
+        _indexed[id] = std::make_unique<IndexedGlyphSet>(
+            std::string(name_of(set)),
+            std::string(_glyphs + set.glyphs_offset, set.glyph_count * set.glyph_size),
+            static_cast<GlyphIndexStrategy>(set.strategy)
+        );
+    }
+    return *_indexed[id];
+}
+
+CodepointGlyphTable::GlyphSource CipherIndexSnapshot::glyph_source(const uint16_t id) const
+{
+    if (id >= _set_count)
+        throw std::out_of_range("CipherIndexSnapshot: no glyph set " + std::to_string(id));
+    const SetRecord& set = _sets[id];
+    if (set.kind == CODEPOINT_RANGE)
+        return {&*_ranges[id], nullptr};
+    if (set.kind == NOOP_GLYPHS)
+        return {};
+    return {nullptr, &indexed_set(id)};
+}
+
+GlyphFPECipher CipherIndexSnapshot::create_cipher(
+    const uint16_t id,
+    std::shared_ptr<const FPEKeyContext> key,
+    const std::vector<uint8_t>& tweak,
+    const FPEAlgorithm algorithm,
+    SmallDomainTables small_domain
+) const
+{
+    if (id >= _set_count)
+        throw std::out_of_range("CipherIndexSnapshot: no glyph set " + std::to_string(id));
+    const SetRecord& set = _sets[id];
+    if (set.kind == CODEPOINT_RANGE)
+        return GlyphFPECipher(&*_ranges[id], std::move(key), tweak, algorithm, small_domain);
+    if (set.kind == NOOP_GLYPHS)
+        return GlyphFPECipher(&indexed_set(id));
+    return GlyphFPECipher(&indexed_set(id), std::move(key), tweak, false, algorithm, small_domain);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CodepointCipherTable.hpp"
+#include "CodepointGlyphTable.hpp"
+#include "CodepointRangeGlyphSet.hpp"
+#include "GlyphFPECipher.hpp"
+#include "IndexedGlyphSet.hpp"
+
+class UnicodeGlyphCipherIndex;
+
+// The glyph sets and code point table of a UnicodeGlyphCipherIndex saved to a file, so a process can start from it
+// instead of building them. open() maps the file read-only and shared: the table is read in place, and every process
+// on a host that opens the same file shares one copy of it in the page cache.
+//
+// No key material is written. Key, tweak and algorithm are supplied to the index built over the snapshot, so one file
+// serves every key.
+//
+// Layout, native byte order, every section 64-byte aligned:
+//   header     magic, format version, byte order mark, section offsets and an FNV-1a checksum of all that follows
+//   sets       one record per glyph set, in cipher id order: a code point range, or the glyphs of an IndexedGlyphSet
+//   names      set names back to back
+//   glyphs     IndexedGlyphSet glyphs in index order
+//   directory  CodepointCipherTable directory
+//   pages      CodepointCipherTable pages
+class CipherIndexSnapshot
+{
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    // Writes the glyph sets and table of index to path, through a uniquely named, fsynced temporary file renamed into
+    // place, so readers never see a partial file and concurrent writers never clobber each other's. Creates every
+    // cipher of a lazy index.
+    static void write(const std::string& path, const UnicodeGlyphCipherIndex& index);
+
+    // Maps a file written by write(). Throws std::runtime_error if it cannot be read or is not a valid snapshot of
+    // this version.
+    static std::shared_ptr<const CipherIndexSnapshot> open(const std::string& path);
+
+    ~CipherIndexSnapshot();
+
+    CipherIndexSnapshot(const CipherIndexSnapshot&) = delete;
+    CipherIndexSnapshot& operator=(const CipherIndexSnapshot&) = delete;
+
+    size_t glyph_set_count() const noexcept { return _set_count; }
+    std::string_view glyph_set_name(uint16_t id) const;
+
+    // Table over the mapped pages; valid while the snapshot is
+    CodepointCipherTable table() const;
+
+    // The glyph set at id, for CodepointGlyphTable::build(). An IndexedGlyphSet is built as create_cipher() builds it.
+    CodepointGlyphTable::GlyphSource glyph_source(uint16_t id) const;
+
+    // Cipher over the glyph set at id. An IndexedGlyphSet is built from the mapped glyphs on first use and kept.
+    GlyphFPECipher create_cipher(
+        uint16_t id,
+        std::shared_ptr<const FPEKeyContext> key,
+        const std::vector<uint8_t>& tweak,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {}
+    ) const;
+
+    size_t file_size() const noexcept { return _size; }
+
+private:
+    struct SetRecord;
+
+    const std::byte* _base = nullptr;
+    size_t _size = 0;
+    const SetRecord* _sets = nullptr;
+    size_t _set_count = 0;
+    const char* _names = nullptr;
+    const char* _glyphs = nullptr;
+    std::span<const uint16_t> _directory;
+    std::span<const uint16_t> _pages;
+
+    std::vector<std::optional<CodepointRangeGlyphSet>> _ranges;
+    mutable std::vector<std::unique_ptr<IndexedGlyphSet>> _indexed;
+    mutable std::mutex _indexed_mutex;
+
+    CipherIndexSnapshot(const std::byte* base, size_t size);
+
+    void validate();
+    std::string_view name_of(const SetRecord& set) const noexcept;
+    const IndexedGlyphSet& indexed_set(uint16_t id) const;
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Code point → cipher id map as a two-level page table. A directory entry per 256 code points names a page of 256
+// uint16 ids. Pages that would hold a single id throughout, including the unmapped ones, are shared, so whole Unicode
+// blocks cost little more than the directory and the pages the BMP actually touches stay in L2. Lookups are two
+// dependent loads; the table is a plain value, cheap to copy per thread or tenant.
+//
+// A table either owns its pages or reads static pages in place, generated at compile time (see UnicodeBlockTables.hpp)
+// or mapped from a snapshot (see CipherIndexSnapshot.hpp), until its first assign() copies them.
+class CodepointCipherTable
+{
+public:
+    static constexpr uint16_t NO_CIPHER = UINT16_MAX;
+    static constexpr uint32_t MAX_CODEPOINT = 0x10FFFF;
+
+    static constexpr uint32_t PAGE_BITS = 8;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static constexpr uint32_t PAGE_MASK = PAGE_SIZE - 1;
+    static constexpr uint32_t PAGE_COUNT = (MAX_CODEPOINT >> PAGE_BITS) + 1;
+
+    CodepointCipherTable()
+        : _owned_directory(PAGE_COUNT, 0)
+        , _owned_ids(PAGE_SIZE, NO_CIPHER)
+        , _shared_id(1, NO_CIPHER)
+    {
+        point_at_owned();
+    }
+
+    // A table over static pages laid out like owned ones: page 0 unmapped, every other page either named by a single
+    // directory entry or filled with a single id
+    static CodepointCipherTable over(const std::span<const uint16_t> directory, const std::span<const uint16_t> ids)
+    {
+        if (directory.size() != PAGE_COUNT || ids.empty() || ids.size() % PAGE_SIZE != 0)
+            throw std::invalid_argument("CodepointCipherTable: static pages have the wrong shape");
+        CodepointCipherTable table(nullptr);
+        table._directory = directory.data();
+        table._ids = ids.data();
+        table._page_count = ids.size() / PAGE_SIZE;
+        return table;
+    }
+
+    CodepointCipherTable(const CodepointCipherTable& other)
+        : _owned_directory(other._owned_directory)
+        , _owned_ids(other._owned_ids)
+        , _shared_id(other._shared_id)
+        , _directory(other._directory)
+        , _ids(other._ids)
+        , _page_count(other._page_count)
+    {
+        if (other.owns_pages())
+            point_at_owned();
+    }
+
+    CodepointCipherTable& operator=(const CodepointCipherTable& other)
+    {
+        if (this != &other)
+            *this = CodepointCipherTable(other);
+        return *this;
+    }
+
+    // Moving a vector keeps its buffer, so the lookup pointers stay valid
+    CodepointCipherTable(CodepointCipherTable&&) noexcept = default;
+    CodepointCipherTable& operator=(CodepointCipherTable&&) noexcept = default;
+
+    // Cipher id of a code point, NO_CIPHER when unmapped or beyond MAX_CODEPOINT
+    uint16_t operator[](const uint32_t cp) const noexcept
+    {
+        if (cp > MAX_CODEPOINT)
+            return NO_CIPHER;
+        return _ids[size_t{_directory[cp >> PAGE_BITS]} * PAGE_SIZE + (cp & PAGE_MASK)];
+    }
+
+    // The PAGE_SIZE ids of the page holding cp, a code point up to MAX_CODEPOINT; for loops that stay on one page
+    const uint16_t* page(const uint32_t cp) const noexcept
+    {
+        return _ids + size_t{_directory[cp >> PAGE_BITS]} * PAGE_SIZE;
+    }
+
+    // Maps [first, last] to id. Throws if any of them is already mapped.
+    void assign(const uint32_t first, const uint32_t last, const uint16_t id)
+    {
+        if (first > last || last > MAX_CODEPOINT || id == NO_CIPHER)
+            throw std::invalid_argument("CodepointCipherTable: invalid code point range or cipher id");
+        if (!owns_pages())
+            copy_static_pages();
+
+        uint16_t filled = 0;
+        for (uint32_t page = first >> PAGE_BITS; page <= last >> PAGE_BITS; ++page)
+        {
+            const uint32_t lo = std::max(first, page << PAGE_BITS);
+            const uint32_t hi = std::min(last, (page << PAGE_BITS) | PAGE_MASK);
+            if (hi - lo == PAGE_MASK && _owned_directory[page] == 0)
+            {
+                if (filled == 0)
+                    filled = shared_page(id);
+                _owned_directory[page] = filled;
+                continue;
+            }
+
+            uint16_t* ids = private_page(page);
+            for (uint32_t cp = lo; cp <= hi; ++cp)
+            {
+                if (ids[cp & PAGE_MASK] != NO_CIPHER)
+                    throw std::invalid_argument("Code point assigned to multiple glyph sets: " + std::to_string(cp));
+                ids[cp & PAGE_MASK] = id;
+            }
+        }
+    }
+
+    // What lookups read, laid out as over() takes them
+    std::span<const uint16_t> directory() const noexcept { return {_directory, PAGE_COUNT}; }
+    std::span<const uint16_t> pages() const noexcept { return {_ids, _page_count * PAGE_SIZE}; }
+
+    // False while the table reads static pages
+    bool owns_pages() const noexcept { return _directory == _owned_directory.data(); }
+    size_t page_count() const noexcept { return _page_count; }
+    size_t byte_size() const noexcept
+    {
+        return (size_t{PAGE_COUNT} + _page_count * PAGE_SIZE + _shared_id.size()) * sizeof(uint16_t);
+    }
+
+private:
+    std::vector<uint16_t> _owned_directory; // code point >> PAGE_BITS → page
+    std::vector<uint16_t> _owned_ids;       // pages back to back; page 0 is the shared unmapped page
+    std::vector<uint16_t> _shared_id;       // page → the id it is filled with if shared, else NO_CIPHER
+
+    // What lookups read: the owned vectors or static pages
+    const uint16_t* _directory = nullptr;
+    const uint16_t* _ids = nullptr;
+    size_t _page_count = 0;
+
+    explicit CodepointCipherTable(std::nullptr_t) {}
+
+    void point_at_owned() noexcept
+    {
+        _directory = _owned_directory.data();
+        _ids = _owned_ids.data();
+        _page_count = _owned_ids.size() / PAGE_SIZE;
+    }
+
+    // Static pages filled with one id may be named by several entries, so they are shared like owned ones
+    void copy_static_pages()
+    {
+        _owned_directory.assign(_directory, _directory + PAGE_COUNT);
+        _owned_ids.assign(_ids, _ids + _page_count * PAGE_SIZE);
+        _shared_id.assign(_page_count, NO_CIPHER);
+        for (size_t page = 1; page < _page_count; ++page)
+        {
+            const uint16_t* ids = _owned_ids.data() + page * PAGE_SIZE;
+            if (std::all_of(ids, ids + PAGE_SIZE, [&](const uint16_t id) { return id == ids[0]; }))
+                _shared_id[page] = ids[0];
+        }
+        point_at_owned();
+    }
+
+    uint16_t add_page(const uint16_t* ids, const uint16_t shared_id)
+    {
+        if (_page_count > UINT16_MAX)
+            throw std::length_error("CodepointCipherTable: too many pages");
+        const auto page = static_cast<uint16_t>(_page_count);
+        _owned_ids.insert(_owned_ids.end(), ids, ids + PAGE_SIZE);
+        _shared_id.push_back(shared_id);
+        point_at_owned();
+        return page;
+    }
+
+    // The shared page filled with id, added on first use
+    uint16_t shared_page(const uint16_t id)
+    {
+        for (size_t page = 1; page < _shared_id.size(); ++page)
+            if (_shared_id[page] == id)
+                return static_cast<uint16_t>(page);
+        const std::vector<uint16_t> filled(PAGE_SIZE, id);
+        return add_page(filled.data(), id);
+    }
+
+    // Ids of a directory entry, copied out of a shared page first so writes stay local to it
+    uint16_t* private_page(const uint32_t entry)
+    {
+        uint16_t page = _owned_directory[entry];
+        if (page == 0 || _shared_id[page] != NO_CIPHER)
+        {
+            const std::vector<uint16_t> copy(_owned_ids.begin() + size_t{page} * PAGE_SIZE,
+                                             _owned_ids.begin() + (size_t{page} + 1) * PAGE_SIZE);
+            page = add_page(copy.data(), NO_CIPHER);
+            _owned_directory[entry] = page;
+        }
+        return _owned_ids.data() + size_t{page} * PAGE_SIZE;
+    }
+};
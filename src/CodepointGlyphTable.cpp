@@ -0,0 +1,85 @@
+#include "CodepointGlyphTable.hpp"
+#include "UnicodeGlyphCipherIndex.hpp" // for decode_utf8
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+CodepointGlyphTable::CodepointGlyphTable()
+    : _directory(PAGE_COUNT, 0)
+{
+    add_page(NO_CIPHER, 0);
+}
+
+CodepointGlyphTable CodepointGlyphTable::build(const CodepointCipherTable& ids, const std::vector<GlyphSource>& sources)
+{
+    auto mapped = [&](const uint16_t id) {
+        return id != NO_CIPHER && (sources.at(id).range != nullptr || sources[id].indexed != nullptr);
+    };
+
+    // Source pages filled with a single id, which is most of them, are found once per page rather than per entry
+    std::vector<int8_t> uniform(ids.page_count(), -1);
+    std::map<std::pair<uint16_t, uint32_t>, uint16_t> filled; // (id, base) → page of a range filled with it
+
+    CodepointGlyphTable table;
+    for (uint32_t entry = 0; entry < PAGE_COUNT; ++entry)
+    {
+        const uint32_t page_first = entry << PAGE_BITS;
+        const uint16_t source_page = ids.directory()[entry];
+        const uint16_t* page = ids.page(page_first);
+        if (uniform[source_page] < 0)
+            uniform[source_page] = std::all_of(page, page + PAGE_SIZE, [&](const uint16_t id) { return id == page[0]; });
+
+        if (uniform[source_page] && !mapped(page[0]))
+            continue;
+        if (uniform[source_page] && sources[page[0]].range)
+        {
+            const uint32_t base = page_first - sources[page[0]].range->index_of(page_first);
+            auto [at, added] = filled.try_emplace({page[0], base}, 0);
+            if (added)
+                at->second = table.add_page(page[0], base);
+            table._directory[entry] = at->second;
+            continue;
+        }
+
+        const uint16_t own = table.add_page(NO_CIPHER, 0);
+        table._directory[entry] = own;
+        for (uint32_t offset = 0; offset < PAGE_SIZE; ++offset)
+        {
+            const uint16_t id = page[offset];
+            if (!mapped(id))
+                continue;
+            const size_t at = size_t{own} * PAGE_SIZE + offset;
+            table._ids[at] = id;
+            if (sources[id].range)
+                table._bases[at] = (page_first | offset) - sources[id].range->index_of(page_first | offset);
+        }
+    }
+
+    // Glyphs of an IndexedGlyphSet are numbered by position, so their bases come from walking the set
+    for (size_t id = 0; id < sources.size(); ++id)
+    {
+        const IndexedGlyphSet* set = sources[id].range ? nullptr : sources[id].indexed;
+        if (set == nullptr)
+            continue;
+        for (unsigned index = 0; index < set->size(); ++index)
+        {
+            const uint32_t cp = decode_utf8(set->from_index(index));
+            const size_t at = size_t{table._directory[cp >> PAGE_BITS]} * PAGE_SIZE + (cp & PAGE_MASK);
+            if (table._ids[at] == id)
+                table._bases[at] = cp - index;
+        }
+    }
+    return table;
+}
+
+uint16_t CodepointGlyphTable::add_page(const uint16_t id, const uint32_t base)
+{
+    if (page_count() > UINT16_MAX)
+        throw std::length_error("CodepointGlyphTable: too many pages");
+    const auto page = static_cast<uint16_t>(page_count());
+    _ids.insert(_ids.end(), PAGE_SIZE, id);
+    _bases.insert(_bases.end(), PAGE_SIZE, base);
+    return page;
+}
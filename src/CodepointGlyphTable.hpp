@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CodepointCipherTable.hpp"
+#include "CodepointRangeGlyphSet.hpp"
+#include "IndexedGlyphSet.hpp"
+
+// Code point → (cipher id, glyph index) in one lookup, so UnicodeFPECipher learns both while it decodes and never
+// parses a glyph again. Laid out like the CodepointCipherTable it is built from: a directory entry per 256 code points
+// names a page of ids and a parallel page of bases, a base being a code point minus its glyph index. A code point
+// range keeps one base throughout, so its pages are shared as its id pages are; only pages holding glyphs of an
+// IndexedGlyphSet need one of their own.
+class CodepointGlyphTable
+{
+public:
+    static constexpr uint16_t NO_CIPHER = CodepointCipherTable::NO_CIPHER;
+    static constexpr uint32_t MAX_CODEPOINT = CodepointCipherTable::MAX_CODEPOINT;
+
+    static constexpr uint32_t PAGE_BITS = CodepointCipherTable::PAGE_BITS;
+    static constexpr uint32_t PAGE_SIZE = CodepointCipherTable::PAGE_SIZE;
+    static constexpr uint32_t PAGE_MASK = CodepointCipherTable::PAGE_MASK;
+    static constexpr uint32_t PAGE_COUNT = CodepointCipherTable::PAGE_COUNT;
+
+    // index is unspecified when cipher is NO_CIPHER
+    struct Glyph
+    {
+        uint16_t cipher;
+        uint32_t index;
+    };
+
+    // The glyph set behind a cipher id, as build() needs it. With neither set the cipher is a noop one, and its
+    // glyphs are left unmapped so they pass through.
+    struct GlyphSource
+    {
+        const CodepointRangeGlyphSet* range = nullptr;
+        const IndexedGlyphSet* indexed = nullptr;
+    };
+
+    // Every code point unmapped
+    CodepointGlyphTable();
+
+    // The mapping of ids with the glyph index of every code point added, sources holding one entry per cipher id
+    static CodepointGlyphTable build(const CodepointCipherTable& ids, const std::vector<GlyphSource>& sources);
+
+    Glyph operator[](const uint32_t cp) const noexcept
+    {
+        if (cp > MAX_CODEPOINT)
+            return {NO_CIPHER, 0};
+        const size_t at = size_t{_directory[cp >> PAGE_BITS]} * PAGE_SIZE + (cp & PAGE_MASK);
+        return {_ids[at], cp - _bases[at]};
+    }
+
+    // The PAGE_SIZE ids and bases of the page holding cp, a code point up to MAX_CODEPOINT
+    const uint16_t* page_ids(const uint32_t cp) const noexcept
+    {
+        return _ids.data() + size_t{_directory[cp >> PAGE_BITS]} * PAGE_SIZE;
+    }
+    const uint32_t* page_bases(const uint32_t cp) const noexcept
+    {
+        return _bases.data() + size_t{_directory[cp >> PAGE_BITS]} * PAGE_SIZE;
+    }
+
+    size_t page_count() const noexcept { return _ids.size() / PAGE_SIZE; }
+    size_t byte_size() const noexcept
+    {
+        return _directory.size() * sizeof(uint16_t) + _ids.size() * sizeof(uint16_t) + _bases.size() * sizeof(uint32_t);
+    }
+
+private:
+    std::vector<uint16_t> _directory; // code point >> PAGE_BITS → page; page 0 is the shared unmapped page
+    std::vector<uint16_t> _ids;       // pages back to back
+    std::vector<uint32_t> _bases;     // likewise
+
+    uint16_t add_page(uint16_t id, uint32_t base);
+};
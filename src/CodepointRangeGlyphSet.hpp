@@ -0,0 +1,206 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "GlyphKernels.hpp"
+
+// One glyph's UTF-8 bytes, held by value
+struct EncodedGlyph
+{
+    char bytes[4]{};
+    uint8_t length = 0;
+
+    const char* data() const noexcept { return bytes; }
+    size_t size() const noexcept { return length; }
+    std::string_view view() const noexcept { return {bytes, length}; }
+    operator std::string_view() const noexcept { return view(); }
+
+    friend bool operator==(const EncodedGlyph& a, const std::string_view b) noexcept { return a.view() == b; }
+};
+
+// Glyph set of every code point in [first, last] except surrogates, numbered in code point order. Indexes and glyphs
+// are computed from code points, so a whole Unicode block costs a few bytes however large it is. Numbering matches
+// an IndexedGlyphSet built from the same glyphs, so either can back the same cipher.
+//
+// A literal type: sets can be built at compile time, as the Unicode block sets of UnicodeBlockTables.hpp are. The
+// name is not copied and must outlive the set.
+class CodepointRangeGlyphSet
+{
+public:
+    static constexpr unsigned NOT_FOUND = std::numeric_limits<unsigned>::max();
+
+    constexpr CodepointRangeGlyphSet(const std::string_view name, const uint32_t first, const uint32_t last)
+        : _name(name)
+        , _first(first)
+        , _last(last)
+        , _glyph_size(utf8_width(first))
+    {
+        if (first > last || last > 0x10FFFF)
+            throw std::invalid_argument("CodepointRangeGlyphSet: invalid code point range");
+        if (utf8_width(last) != _glyph_size)
+            throw std::invalid_argument("CodepointRangeGlyphSet: range mixes UTF-8 widths");
+        _size = last - first + 1 - surrogates_before(last + 1);
+        if (_size < 2)
+            throw std::invalid_argument("CodepointRangeGlyphSet: range needs at least two non-surrogate code points");
+    }
+
+    constexpr size_t glyph_size() const noexcept { return _glyph_size; }
+    constexpr size_t size() const noexcept { return _size; }
+    constexpr std::string_view name() const noexcept { return _name; }
+    constexpr uint32_t first_codepoint() const noexcept { return _first; }
+    constexpr uint32_t last_codepoint() const noexcept { return _last; }
+
+    // Index of glyph, or NOT_FOUND unless it is one well-formed UTF-8 sequence for a code point of the range
+    unsigned find_index(const std::string_view glyph) const noexcept
+    {
+        if (glyph.size() != _glyph_size)
+            return NOT_FOUND;
+        const auto* s = reinterpret_cast<const unsigned char*>(glyph.data());
+        uint32_t cp;
+        switch (_glyph_size)
+        {
+        case 1:
+            cp = s[0];
+            break;
+        case 2:
+            if ((s[0] & 0xE0) != 0xC0 || (s[1] & 0xC0) != 0x80)
+                return NOT_FOUND;
+            cp = ((s[0] & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+            break;
+        case 3:
+            if ((s[0] & 0xF0) != 0xE0 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80)
+                return NOT_FOUND;
+            cp = ((s[0] & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+            break;
+        default:
+            if ((s[0] & 0xF8) != 0xF0 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80)
+                return NOT_FOUND;
+            cp = ((s[0] & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) | ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+            break;
+        }
+        // Overlong forms decode below the range, which never crosses a width boundary
+        if (cp < _first || cp > _last || is_surrogate(cp))
+            return NOT_FOUND;
+        return cp - _first - surrogates_before(cp);
+    }
+
+    unsigned to_index(const std::string_view glyph) const
+    {
+        const unsigned index = find_index(glyph);
+        if (index == NOT_FOUND)
+            throw std::out_of_range("CodepointRangeGlyphSet: glyph not found");
+        return index;
+    }
+
+    bool contains(const std::string_view glyph) const noexcept { return find_index(glyph) != NOT_FOUND; }
+
+    // Maps count glyphs read back to back from in, returning count or the position of the first glyph not in the
+    // set. Ranges clear of the surrogates, which is every Unicode block, run the vector kernels of glyph_kernels.
+    size_t map_glyphs(const char* in, const size_t count, uint32_t* out) const noexcept
+    {
+        if (!spans_surrogates())
+            return glyph_kernels::map_range(kernel_range(), in, count, out);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const unsigned index = find_index({in + i * _glyph_size, _glyph_size});
+            if (index == NOT_FOUND)
+                return i;
+            out[i] = index;
+        }
+        return count;
+    }
+
+    // Writes the glyphs of count indexes, each below size(), back to back to out
+    void unmap_glyphs(const uint32_t* indexes, const size_t count, char* out) const noexcept
+    {
+        if (!spans_surrogates())
+            glyph_kernels::unmap_range(kernel_range(), indexes, count, out);
+        else
+            for (size_t i = 0; i < count; ++i)
+                copy_glyph(indexes[i], out + i * _glyph_size);
+    }
+
+    // Code point of an index below size()
+    constexpr uint32_t codepoint(const unsigned index) const noexcept
+    {
+        const uint32_t cp = _first + index;
+        return cp >= SURROGATE_FIRST && _first <= SURROGATE_LAST ? cp + surrogates_before(SURROGATE_LAST + 1) : cp;
+    }
+
+    // Index of a code point of the range that is not a surrogate
+    constexpr unsigned index_of(const uint32_t cp) const noexcept { return cp - _first - surrogates_before(cp); }
+
+    EncodedGlyph from_index(const unsigned index) const
+    {
+        if (index >= _size)
+            throw std::out_of_range("CodepointRangeGlyphSet: index out of range");
+        EncodedGlyph glyph;
+        glyph.length = static_cast<uint8_t>(_glyph_size);
+        copy_glyph(index, glyph.bytes);
+        return glyph;
+    }
+
+    // Writes the glyph_size() bytes of an index below size() to out
+    void copy_glyph(const unsigned index, char* out) const noexcept
+    {
+        const uint32_t cp = codepoint(index);
+        switch (_glyph_size)
+        {
+        case 1:
+            out[0] = static_cast<char>(cp);
+            break;
+        case 2:
+            out[0] = static_cast<char>(0xC0 | (cp >> 6));
+            out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        case 3:
+            out[0] = static_cast<char>(0xE0 | (cp >> 12));
+            out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        default:
+            out[0] = static_cast<char>(0xF0 | (cp >> 18));
+            out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        }
+    }
+
+private:
+    static constexpr uint32_t SURROGATE_FIRST = 0xD800;
+    static constexpr uint32_t SURROGATE_LAST = 0xDFFF;
+
+    std::string_view _name;
+    uint32_t _first;
+    uint32_t _last;
+    size_t _glyph_size;
+    size_t _size = 0;
+
+    static constexpr bool is_surrogate(const uint32_t cp) noexcept { return cp >= SURROGATE_FIRST && cp <= SURROGATE_LAST; }
+
+    constexpr bool spans_surrogates() const noexcept { return _first <= SURROGATE_LAST && _last >= SURROGATE_FIRST; }
+
+    glyph_kernels::CodepointRange kernel_range() const noexcept
+    {
+        return {_first, static_cast<uint32_t>(_size), static_cast<uint32_t>(_glyph_size)};
+    }
+
+    static constexpr size_t utf8_width(const uint32_t cp) noexcept
+    {
+        return cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+    }
+
+    // Surrogates in [_first, cp)
+    constexpr uint32_t surrogates_before(const uint32_t cp) const noexcept
+    {
+        const uint32_t lo = std::max(_first, SURROGATE_FIRST);
+        const uint32_t hi = std::min(cp, SURROGATE_LAST + 1);
+        return hi > lo ? hi - lo : 0;
+    }
+};
@@ -1,33 +1,842 @@
 #include "FF1Cipher.hpp"
+#include "AesPrf.hpp"
+#include "NumeralConversion.hpp"
 #include <stdexcept>
 #include <utility>
 #include <cstring>
-#include <fpe.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
 
 namespace {
+    using uint128_t = unsigned __int128;
+
+    constexpr int FF1_ROUNDS = 10;
+    constexpr size_t BLOCK_SIZE = 16;
+
+    // Largest radix^v handled natively. The 8 bits of headroom let y be reduced one byte at a time without overflow.
+    constexpr uint128_t NATIVE64_LIMIT = uint128_t(1) << 56;
+    constexpr uint128_t NATIVE128_LIMIT = uint128_t(1) << 120;
+
     // Validates and converts digits in-place (no extra copy)
-    void validate_digits(const std::vector<uint32_t>& input, const uint32_t radix) {
+    void validate_digits(const std::span<const uint32_t> input, const uint32_t radix) {
         for (const auto digit : input) {
             if (digit >= radix) {
                 throw std::invalid_argument("Digit out of range");
             }
         }
     }
+
+    // radix^exponent, or 0 when it exceeds limit
+    uint128_t bounded_pow(const uint32_t radix, const size_t exponent, const uint128_t limit)
+    {
+        uint128_t result = 1;
+        for (size_t i = 0; i < exponent; ++i)
+        {
+            if (__builtin_mul_overflow(result, static_cast<uint128_t>(radix), &result) || result > limit)
+                return 0;
+        }
+        return result;
+    }
+
+    size_t bit_length(uint128_t value)
+    {
+        size_t bits = 0;
+        for (; value != 0; value >>= 1)
+            ++bits;
+        return bits;
+    }
+
+    // Per-length constants of SP 800-38G Algorithm 7, steps 1-5
+    struct RoundParams
+    {
+        size_t b;     // byte length of NUM(B) inside Q
+        size_t d;     // byte length of S used for y
+        size_t pad;   // zero bytes between the tweak and the round number
+        size_t q_len; // byte length of Q, a multiple of 16
+        uint8_t p[BLOCK_SIZE];
+    };
+
+    RoundParams make_round_params(const uint32_t radix, const size_t n, const size_t tweak_len, const size_t b)
+    {
+        RoundParams params{};
+        params.b = b;
+        params.d = 4 * ((b + 3) / 4) + 4;
+        params.pad = (BLOCK_SIZE - (tweak_len + b + 1) % BLOCK_SIZE) % BLOCK_SIZE;
+        params.q_len = tweak_len + params.pad + 1 + b;
+
+        const size_t u = n / 2;
+        params.p[0] = 0x01;
+        params.p[1] = 0x02;
+        params.p[2] = 0x01;
+        params.p[3] = static_cast<uint8_t>(radix >> 16);
+        params.p[4] = static_cast<uint8_t>(radix >> 8);
+        params.p[5] = static_cast<uint8_t>(radix);
+        params.p[6] = FF1_ROUNDS;
+        params.p[7] = static_cast<uint8_t>(u);
+        for (int i = 0; i < 4; ++i)
+        {
+            params.p[8 + i] = static_cast<uint8_t>(n >> (24 - 8 * i));
+            params.p[12 + i] = static_cast<uint8_t>(tweak_len >> (24 - 8 * i));
+        }
+        return params;
+    }
+
+    // Fills the CBC-MAC blocks numbered 1.. of S from the first block R (step 6.iii). The blocks are independent, so
+    // they go to the cipher in one call.
+    void expand_s(const AesPrf& prf, uint8_t* s, const size_t d)
+    {
+        const size_t extra_blocks = (d + BLOCK_SIZE - 1) / BLOCK_SIZE - 1;
+        for (size_t j = 1; j <= extra_blocks; ++j)
+        {
+            uint8_t* block = s + j * BLOCK_SIZE;
+            std::memcpy(block, s, BLOCK_SIZE);
+            for (int k = 0; k < 4; ++k)
+                block[BLOCK_SIZE - 1 - k] ^= static_cast<uint8_t>(j >> (8 * k));
+        }
+        prf.encrypt_blocks(s + BLOCK_SIZE, s + BLOCK_SIZE, extra_blocks);
+    }
+
+    // --- Native path: every intermediate value fits in Word ---
+
+    // Up to this many same-length numeral strings share each round's AES calls in the batch path
+    constexpr size_t MAX_LANES = 8;
+
+    // Kernels are instantiated per Radix; Radix == 0 reads the radix at run time instead. With a fixed radix every
+    // multiply and divide by it is a compile-time constant, which the compiler strength-reduces to shifts for powers
+    // of two and to multiplications by a precomputed reciprocal otherwise.
+    template <uint32_t Radix>
+    constexpr bool POW2_RADIX = Radix != 0 && std::has_single_bit(Radix);
+
+    template <uint32_t Radix>
+    constexpr uint32_t select_radix(const uint32_t runtime_radix)
+    {
+        return Radix != 0 ? Radix : runtime_radix;
+    }
+
+    // Largest power of the radix that fits in 64 bits, and its exponent. Wide values are converted in chunks of that
+    // many numerals so only one 128-bit multiply or divide is paid per chunk.
+    struct RadixChunk
+    {
+        uint64_t power;
+        size_t digits;
+    };
+
+    constexpr RadixChunk radix_chunk(const uint32_t radix)
+    {
+        RadixChunk chunk{1, 0};
+        while (chunk.power <= ~uint64_t{0} / radix)
+        {
+            chunk.power *= radix;
+            ++chunk.digits;
+        }
+        return chunk;
+    }
+
+    template <uint32_t Radix>
+    RadixChunk select_chunk(const uint32_t runtime_radix)
+    {
+        if constexpr (Radix != 0)
+        {
+            constexpr RadixChunk chunk = radix_chunk(Radix);
+            return chunk;
+        }
+        else
+        {
+            return radix_chunk(runtime_radix);
+        }
+    }
+
+    template <typename Word, uint32_t Radix>
+    Word num_radix(const uint32_t* digits, const size_t count, const uint32_t runtime_radix)
+    {
+        const uint32_t radix = select_radix<Radix>(runtime_radix);
+        if constexpr (POW2_RADIX<Radix>)
+        {
+            Word value = 0;
+            for (size_t i = 0; i < count; ++i)
+                value = (value << std::countr_zero(Radix)) | digits[i];
+            return value;
+        }
+        else
+        {
+            size_t i = 0;
+            Word value = 0;
+            if constexpr (sizeof(Word) > sizeof(uint64_t))
+            {
+                const RadixChunk chunk = select_chunk<Radix>(radix);
+                for (; i + chunk.digits <= count; i += chunk.digits)
+                {
+                    uint64_t part = 0;
+                    for (size_t j = 0; j < chunk.digits; ++j)
+                        part = part * radix + digits[i + j];
+                    value = value * chunk.power + part;
+                }
+            }
+            for (; i < count; ++i)
+                value = value * radix + digits[i];
+            return value;
+        }
+    }
+
+    // A fixed radix lets the compiler turn each division into a multiply; a runtime radix pays a hardware divide per
+    // numeral, so it goes through the AVX2 kernel where the CPU has one
+    template <uint32_t Radix>
+    void str_radix_u64(uint64_t value, uint32_t* digits, size_t count, const uint32_t radix)
+    {
+        if constexpr (Radix == 0)
+        {
+            numeral_conversion::str_radix(value, digits, count, radix);
+        }
+        else
+        {
+            while (count-- > 0)
+            {
+                digits[count] = static_cast<uint32_t>(value % Radix);
+                value /= Radix;
+            }
+        }
+    }
+
+    template <typename Word, uint32_t Radix>
+    void str_radix(Word value, uint32_t* digits, size_t count, const uint32_t runtime_radix)
+    {
+        const uint32_t radix = select_radix<Radix>(runtime_radix);
+        if constexpr (POW2_RADIX<Radix>)
+        {
+            while (count-- > 0)
+            {
+                digits[count] = static_cast<uint32_t>(value) & (Radix - 1);
+                value >>= std::countr_zero(Radix);
+            }
+        }
+        else
+        {
+            if constexpr (sizeof(Word) > sizeof(uint64_t))
+            {
+                const RadixChunk chunk = select_chunk<Radix>(radix);
+                while (value > ~uint64_t{0})
+                {
+                    auto part = static_cast<uint64_t>(value % chunk.power);
+                    value /= chunk.power;
+                    count -= chunk.digits;
+                    str_radix_u64<Radix>(part, digits + count, chunk.digits, radix);
+                }
+            }
+            str_radix_u64<Radix>(static_cast<uint64_t>(value), digits, count, radix);
+        }
+    }
+
+    // x mod m for a modulus fixed per numeral-string length, by Barrett reduction with the reciprocal computed once
+    // per length. Requires m <= 2^56 so that three times m still fits in 64 bits.
+    struct InvariantModulus
+    {
+        uint64_t m = 1;
+        uint64_t reciprocal = 0; // floor((2^64 - 1) / m)
+
+        InvariantModulus() = default;
+
+        explicit InvariantModulus(const uint64_t modulus)
+            : m(modulus)
+            , reciprocal(~uint64_t{0} / modulus)
+        {}
+
+        uint64_t reduce(const uint64_t x) const
+        {
+            // The estimated quotient falls short by at most two
+            const auto q = static_cast<uint64_t>((static_cast<uint128_t>(x) * reciprocal) >> 64);
+            uint64_t r = x - q * m;
+            if (r >= m)
+                r -= m;
+            if (r >= m)
+                r -= m;
+            return r;
+        }
+    };
+
+    enum class DomainWidth
+    {
+        Native64,
+        Native128,
+        BigNum
+    };
+
+    // Round-independent state shared by every numeral string of one length
+    struct NativeDomain
+    {
+        DomainWidth width;
+        size_t u;
+        size_t v;
+        uint128_t mod_u;
+        uint128_t mod_v;
+        InvariantModulus fast_mod_u; // Native64 only
+        InvariantModulus fast_mod_v;
+        size_t b;
+        size_t d;
+        uint8_t prefix[BLOCK_SIZE];     // CBC-MAC state after P and the leading blocks of Q
+        uint8_t last_block[BLOCK_SIZE]; // last block of Q with the round number and NUM(B) still zero
+    };
+
+    NativeDomain make_domain(
+        const AesPrf& prf,
+        const std::span<const uint8_t> tweak,
+        const uint32_t radix,
+        const size_t n
+    )
+    {
+        NativeDomain domain{};
+        domain.u = n / 2;
+        domain.v = n - domain.u;
+
+        // v >= u, so radix^v bounds every intermediate value
+        domain.mod_v = bounded_pow(radix, domain.v, NATIVE128_LIMIT);
+        if (domain.mod_v == 0)
+        {
+            domain.width = DomainWidth::BigNum;
+            return domain;
+        }
+        domain.mod_u = bounded_pow(radix, domain.u, NATIVE128_LIMIT);
+        domain.width = domain.mod_v <= NATIVE64_LIMIT ? DomainWidth::Native64 : DomainWidth::Native128;
+        if (domain.width == DomainWidth::Native64)
+        {
+            domain.fast_mod_u = InvariantModulus(static_cast<uint64_t>(domain.mod_u));
+            domain.fast_mod_v = InvariantModulus(static_cast<uint64_t>(domain.mod_v));
+        }
+
+        const RoundParams params = make_round_params(radix, n, tweak.size(), (bit_length(domain.mod_v - 1) + 7) / 8);
+        domain.b = params.b;
+        domain.d = params.d;
+
+        // With b <= 15 the round number and NUM(B) always sit in the last block of Q, so the MAC over P and the
+        // leading blocks of Q is the same for all ten rounds.
+        auto q_byte = [&](const size_t i) -> uint8_t { return i < tweak.size() ? tweak[i] : 0; };
+
+        prf.encrypt(params.p, domain.prefix);
+        for (size_t offset = 0; offset + BLOCK_SIZE < params.q_len; offset += BLOCK_SIZE)
+        {
+            uint8_t block[BLOCK_SIZE];
+            for (size_t j = 0; j < BLOCK_SIZE; ++j)
+                block[j] = domain.prefix[j] ^ q_byte(offset + j);
+            prf.encrypt(block, domain.prefix);
+        }
+
+        const size_t last_offset = params.q_len - BLOCK_SIZE;
+        for (size_t j = 0; j + 1 + params.b < BLOCK_SIZE; ++j)
+            domain.last_block[j] = q_byte(last_offset + j);
+
+        return domain;
+    }
+
+    // y = NUM(S[0..d)) mod modulus (step 6.vi)
+    template <typename Word, uint32_t Radix>
+    Word reduce_y(const NativeDomain& domain, const uint8_t* r, const uint8_t* r_next, const bool use_u)
+    {
+        auto byte_at = [&](const size_t j) { return j < BLOCK_SIZE ? r[j] : r_next[j - BLOCK_SIZE]; };
+        const Word modulus = static_cast<Word>(use_u ? domain.mod_u : domain.mod_v);
+
+        Word y = 0;
+        if constexpr (POW2_RADIX<Radix>)
+        {
+            // The modulus is a power of two, so only the trailing bits of S matter and wrap-around is harmless
+            for (size_t j = 0; j < domain.d; ++j)
+                y = (y << 8) | byte_at(j);
+            return y & (modulus - 1);
+        }
+        else
+        {
+            // The leading bytes fit below 2^(8 * (sizeof(Word) - 1)) unreduced; after that y < modulus leaves room for
+            // one more byte per step
+            const size_t head = std::min(domain.d, sizeof(Word) - 1);
+            for (size_t j = 0; j < head; ++j)
+                y = (y << 8) | byte_at(j);
+
+            if constexpr (sizeof(Word) == sizeof(uint64_t))
+            {
+                const InvariantModulus& fast_mod = use_u ? domain.fast_mod_u : domain.fast_mod_v;
+                y = fast_mod.reduce(y);
+                for (size_t j = head; j < domain.d; ++j)
+                    y = fast_mod.reduce((y << 8) | byte_at(j));
+            }
+            else
+            {
+                y %= modulus;
+                for (size_t j = head; j < domain.d; ++j)
+                    y = ((y << 8) | byte_at(j)) % modulus;
+            }
+            return y;
+        }
+    }
+
+    // Runs the ten rounds for `lanes` numeral strings of the domain's length, handing each round's PRF blocks for all
+    // lanes to a single encrypt_blocks call.
+    template <typename Word, uint32_t Radix>
+    void ff1_native(
+        const NativeDomain& domain,
+        const AesPrf& prf,
+        const uint32_t radix,
+        const uint32_t* const* in,
+        uint32_t* const* out,
+        const size_t lanes,
+        const bool encrypt
+    )
+    {
+        const Word mod_u = static_cast<Word>(domain.mod_u);
+        const Word mod_v = static_cast<Word>(domain.mod_v);
+
+        Word a[MAX_LANES];
+        Word b[MAX_LANES];
+        for (size_t lane = 0; lane < lanes; ++lane)
+        {
+            a[lane] = num_radix<Word, Radix>(in[lane], domain.u, radix);
+            b[lane] = num_radix<Word, Radix>(in[lane] + domain.u, domain.v, radix);
+        }
+
+        for (int round = 0; round < FF1_ROUNDS; ++round)
+        {
+            const int i = encrypt ? round : FF1_ROUNDS - 1 - round;
+            const bool even = i % 2 == 0;
+            const Word modulus = even ? mod_u : mod_v;
+
+            uint8_t blocks[MAX_LANES * BLOCK_SIZE];
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                uint8_t* block = blocks + lane * BLOCK_SIZE;
+                std::memcpy(block, domain.last_block, BLOCK_SIZE);
+                block[BLOCK_SIZE - 1 - domain.b] = static_cast<uint8_t>(i);
+                Word feed = encrypt ? b[lane] : a[lane];
+                for (size_t j = 0; j < domain.b; ++j)
+                {
+                    block[BLOCK_SIZE - 1 - j] = static_cast<uint8_t>(feed);
+                    feed >>= 8;
+                }
+                for (size_t j = 0; j < BLOCK_SIZE; ++j)
+                    block[j] ^= domain.prefix[j];
+            }
+
+            // d <= 20 on this path, so S is R plus at most one more block CIPH(R xor [1]16)
+            uint8_t r[MAX_LANES * BLOCK_SIZE];
+            uint8_t r_next[MAX_LANES * BLOCK_SIZE];
+            prf.encrypt_blocks(blocks, r, lanes);
+            if (domain.d > BLOCK_SIZE)
+            {
+                std::memcpy(blocks, r, lanes * BLOCK_SIZE);
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    blocks[lane * BLOCK_SIZE + BLOCK_SIZE - 1] ^= 0x01;
+                prf.encrypt_blocks(blocks, r_next, lanes);
+            }
+
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                const Word y =
+                    reduce_y<Word, Radix>(domain, r + lane * BLOCK_SIZE, r_next + lane * BLOCK_SIZE, even);
+
+                if (encrypt)
+                {
+                    const Word sum = a[lane] + y;
+                    a[lane] = b[lane];
+                    b[lane] = sum >= modulus ? sum - modulus : sum;
+                }
+                else
+                {
+                    const Word diff = b[lane] >= y ? b[lane] - y : b[lane] + (modulus - y);
+                    b[lane] = a[lane];
+                    a[lane] = diff;
+                }
+            }
+        }
+
+        for (size_t lane = 0; lane < lanes; ++lane)
+        {
+            str_radix<Word, Radix>(a[lane], out[lane], domain.u, radix);
+            str_radix<Word, Radix>(b[lane], out[lane] + domain.u, domain.v, radix);
+        }
+    }
+
+    // --- BIGNUM path for domains wider than 120 bits ---
+
+    struct BnDeleter
+    {
+        void operator()(BIGNUM* bn) const noexcept { BN_clear_free(bn); }
+    };
+
+    struct BnCtxDeleter
+    {
+        void operator()(BN_CTX* ctx) const noexcept { BN_CTX_free(ctx); }
+    };
+
+    using BnPtr = std::unique_ptr<BIGNUM, BnDeleter>;
+    using BnCtxPtr = std::unique_ptr<BN_CTX, BnCtxDeleter>;
+
+    BnPtr make_bn()
+    {
+        BnPtr bn(BN_new());
+        if (!bn)
+            throw std::bad_alloc();
+        return bn;
+    }
+
+    void check_bn(const int ok)
+    {
+        if (!ok)
+            throw std::runtime_error("FF1Cipher: BIGNUM operation failed");
+    }
+
+    void bn_num_radix(BIGNUM* value, const uint32_t* digits, const size_t count, const uint32_t radix)
+    {
+        BN_zero(value);
+        for (size_t i = 0; i < count; ++i)
+        {
+            check_bn(BN_mul_word(value, radix));
+            check_bn(BN_add_word(value, digits[i]));
+        }
+    }
+
+    void bn_str_radix(BIGNUM* value, uint32_t* digits, const size_t count, const uint32_t radix)
+    {
+        for (size_t i = count; i-- > 0;)
+            digits[i] = static_cast<uint32_t>(BN_div_word(value, radix));
+    }
+
+    void bn_pow(BIGNUM* result, const uint32_t radix, const size_t exponent, BN_CTX* ctx)
+    {
+        BnPtr base = make_bn();
+        BnPtr power = make_bn();
+        check_bn(BN_set_word(base.get(), radix));
+        check_bn(BN_set_word(power.get(), exponent));
+        check_bn(BN_exp(result, base.get(), power.get(), ctx));
+    }
+
+    void ff1_bignum(
+        const AesPrf& prf,
+        const std::span<const uint8_t> tweak,
+        const uint32_t radix,
+        const uint32_t* in,
+        uint32_t* out,
+        const size_t n,
+        const bool encrypt
+    )
+    {
+        const size_t u = n / 2;
+        const size_t v = n - u;
+
+        BnCtxPtr ctx(BN_CTX_new());
+        if (!ctx)
+            throw std::bad_alloc();
+
+        BnPtr mod_u = make_bn();
+        BnPtr mod_v = make_bn();
+        BnPtr a = make_bn();
+        BnPtr b = make_bn();
+        BnPtr c = make_bn();
+        BnPtr y = make_bn();
+
+        bn_pow(mod_u.get(), radix, u, ctx.get());
+        bn_pow(mod_v.get(), radix, v, ctx.get());
+
+        check_bn(BN_copy(c.get(), mod_v.get()) != nullptr);
+        check_bn(BN_sub_word(c.get(), 1));
+        const RoundParams params =
+            make_round_params(radix, n, tweak.size(), (static_cast<size_t>(BN_num_bits(c.get())) + 7) / 8);
+
+        std::vector<uint8_t> q(params.q_len, 0);
+        std::copy(tweak.begin(), tweak.end(), q.begin());
+        std::vector<uint8_t> s(((params.d + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE);
+
+        bn_num_radix(a.get(), in, u, radix);
+        bn_num_radix(b.get(), in + u, v, radix);
+
+        for (int round = 0; round < FF1_ROUNDS; ++round)
+        {
+            const int i = encrypt ? round : FF1_ROUNDS - 1 - round;
+            const BIGNUM* modulus = (i % 2 == 0) ? mod_u.get() : mod_v.get();
+
+            q[tweak.size() + params.pad] = static_cast<uint8_t>(i);
+            check_bn(BN_bn2binpad(encrypt ? b.get() : a.get(), &q[params.q_len - params.b], static_cast<int>(params.b)) >= 0);
+
+            uint8_t r[BLOCK_SIZE];
+            prf.encrypt(params.p, r);
+            for (size_t offset = 0; offset < params.q_len; offset += BLOCK_SIZE)
+            {
+                uint8_t block[BLOCK_SIZE];
+                for (size_t j = 0; j < BLOCK_SIZE; ++j)
+                    block[j] = r[j] ^ q[offset + j];
+                prf.encrypt(block, r);
+            }
+
+            std::memcpy(s.data(), r, BLOCK_SIZE);
+            expand_s(prf, s.data(), params.d);
+            check_bn(BN_bin2bn(s.data(), static_cast<int>(params.d), y.get()) != nullptr);
+
+            if (encrypt)
+            {
+                check_bn(BN_mod_add(c.get(), a.get(), y.get(), modulus, ctx.get()));
+                std::swap(a, b);
+                std::swap(b, c);
+            }
+            else
+            {
+                check_bn(BN_mod_sub(c.get(), b.get(), y.get(), modulus, ctx.get()));
+                std::swap(b, a);
+                std::swap(a, c);
+            }
+        }
+
+        bn_str_radix(a.get(), out, u, radix);
+        bn_str_radix(b.get(), out + u, v, radix);
+    }
+
+    // Encrypts or decrypts `lanes` numeral strings of the domain's length with the width the domain calls for
+    template <uint32_t Radix>
+    void ff1_run(
+        const NativeDomain& domain,
+        const AesPrf& prf,
+        const std::span<const uint8_t> tweak,
+        const uint32_t radix,
+        const uint32_t* const* in,
+        uint32_t* const* out,
+        const size_t lanes,
+        const bool encrypt
+    )
+    {
+        switch (domain.width)
+        {
+        case DomainWidth::Native64:
+            ff1_native<uint64_t, Radix>(domain, prf, radix, in, out, lanes, encrypt);
+            break;
+        case DomainWidth::Native128:
+            ff1_native<uint128_t, Radix>(domain, prf, radix, in, out, lanes, encrypt);
+            break;
+        case DomainWidth::BigNum:
+            for (size_t lane = 0; lane < lanes; ++lane)
+                ff1_bignum(prf, tweak, radix, in[lane], out[lane], domain.u + domain.v, encrypt);
+            break;
+        }
+    }
+
+    // --- Small-domain path: the whole permutation of one length, tabulated ---
+
+    // Table entries are uint16_t, which bounds the domains that can be tabulated
+    constexpr size_t MAX_TABLE_DOMAIN = size_t{1} << 16;
+
+    // Entries [0, radix^n) map plaintext values to ciphertext values and entries [radix^n, 2 * radix^n) map them back
+    void table_lookup(
+        const uint16_t* table,
+        const uint32_t radix,
+        const uint32_t* in,
+        uint32_t* out,
+        const size_t n,
+        const bool encrypt
+    )
+    {
+        uint32_t value = 0;
+        uint32_t size = 1;
+        for (size_t i = 0; i < n; ++i)
+        {
+            value = value * radix + in[i];
+            size *= radix;
+        }
+
+        value = table[encrypt ? value : size + value];
+        for (size_t i = n; i-- > 0;)
+        {
+            out[i] = value % radix;
+            value /= radix;
+        }
+    }
 }
 
+// FF1 entry points for one radix, picked once at construction. The alphabets of PreconfiguredIndexedGlyphSet and all
+// power-of-two radices get kernels with the radix compiled in; every other radix uses the run-time kernel.
+struct FF1Cipher::RadixKernel
+{
+    using Run = void (*)(
+        const NativeDomain&,
+        const AesPrf&,
+        std::span<const uint8_t>,
+        uint32_t,
+        const uint32_t* const*,
+        uint32_t* const*,
+        size_t,
+        bool
+    );
+
+    Run run;
+
+    template <uint32_t Radix>
+    static constexpr RadixKernel make()
+    {
+        return {&ff1_run<Radix>};
+    }
+
+    static const RadixKernel& select(const uint32_t radix)
+    {
+        static constexpr RadixKernel runtime = make<0>();
+        static constexpr RadixKernel control = make<33>();
+        static constexpr RadixKernel whitespace = make<6>();
+        static constexpr RadixKernel digits = make<10>();
+        static constexpr RadixKernel letters = make<52>();
+        static constexpr auto pow2 = []<size_t... Shift>(std::index_sequence<Shift...>) {
+            return std::array<RadixKernel, sizeof...(Shift)>{make<uint32_t{1} << Shift>()...};
+        }(std::make_index_sequence<17>{});
+
+        switch (radix)
+        {
+        case 6: return whitespace;
+        case 10: return digits;
+        case 33: return control;
+        case 52: return letters;
+        default:
+            return std::has_single_bit(radix) ? pow2[std::countr_zero(radix)] : runtime;
+        }
+    }
+};
+
+// Lazily computed round-independent state, one slot per short length. Under a fixed key and tweak the P block and the
+// CBC-MAC over P and the tweak blocks of Q depend only on the length, so each length pays for them once.
+struct FF1Cipher::LengthCache
+{
+    static constexpr size_t MAX_LENGTH = 32;
+
+    struct Slot
+    {
+        std::once_flag once;
+        NativeDomain domain;
+        std::once_flag table_once;
+        std::unique_ptr<uint16_t[]> table;
+    };
+
+    std::array<Slot, MAX_LENGTH + 1> slots;
+    SmallDomainTables limits; // all zero for the caches of per-call tweaks
+    std::atomic<size_t> table_bytes{0};
+
+    explicit LengthCache(const SmallDomainTables limits = {})
+        : limits(limits)
+    {}
+
+    // Returns the state for length n. Lengths beyond MAX_LENGTH are computed into `uncached` instead.
+    const NativeDomain& get(
+        const AesPrf& prf,
+        const std::span<const uint8_t> tweak,
+        const uint32_t radix,
+        const size_t n,
+        NativeDomain& uncached
+    )
+    {
+        if (n > MAX_LENGTH)
+        {
+            uncached = make_domain(prf, tweak, radix, n);
+            return uncached;
+        }
+
+        Slot& slot = slots[n];
+        std::call_once(slot.once, [&] { slot.domain = make_domain(prf, tweak, radix, n); });
+        return slot.domain;
+    }
+
+    // Returns the permutation table of length n, calling build() on first use, or nullptr when the table would not fit
+    // in what is left of the byte budget. domain_size is radix^n, at most limits.max_domain.
+    template <typename Build>
+    const uint16_t* table(const size_t n, const size_t domain_size, Build&& build)
+    {
+        Slot& slot = slots[n];
+        std::call_once(slot.table_once, [&] {
+            const size_t bytes = 2 * domain_size * sizeof(uint16_t);
+            size_t used = table_bytes.load(std::memory_order_relaxed);
+            do
+            {
+                if (bytes > limits.max_bytes - used)
+                    return;
+            } while (!table_bytes.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+
+            try
+            {
+                slot.table = build();
+            }
+            catch (...)
+            {
+                table_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+                throw;
+            }
+        });
+        return slot.table.get();
+    }
+};
+
+// Length caches of the most recently used per-call tweaks. Entries are handed out as shared_ptr so an eviction never
+// pulls a cache out from under a call that is still using it.
+struct FF1Cipher::TweakCache
+{
+    static constexpr size_t CAPACITY = 64;
+
+    using Entry = std::pair<std::string, std::shared_ptr<LengthCache>>;
+
+    std::mutex mutex;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index; // keys view into entries' strings
+
+    std::shared_ptr<LengthCache> get(const std::span<const uint8_t> tweak)
+    {
+        const std::string_view key(reinterpret_cast<const char*>(tweak.data()), tweak.size());
+
+        std::lock_guard lock(mutex);
+        if (const auto it = index.find(key); it != index.end())
+        {
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->second;
+        }
+
+        if (entries.size() == CAPACITY)
+        {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+
+        entries.emplace_front(std::string(key), std::make_shared<LengthCache>());
+        index.emplace(entries.front().first, entries.begin());
+        return entries.front().second;
+    }
+};
+
 FF1Cipher::FF1Cipher(
     const std::vector<uint8_t>& key,
     const std::vector<uint8_t>& tweak,
-    const int32_t radix
-) : _radix(radix)
+    const int32_t radix,
+    const SmallDomainTables small_domain
+) : FF1Cipher(std::make_shared<const FPEKeyContext>(key), tweak, radix, small_domain)
+{}
+
+FF1Cipher::FF1Cipher(
+    std::shared_ptr<const FPEKeyContext> key,
+    const std::vector<uint8_t>& tweak,
+    const int32_t radix,
+    const SmallDomainTables small_domain
+) : _key(std::move(key))
+  , _tweak(tweak)
+  , _radix(radix)
+  , _length_cache(std::make_shared<LengthCache>(small_domain))
+  , _tweak_cache(std::make_unique<TweakCache>())
 {
-    const int bits = static_cast<int>(key.size() * 8);
-    if (bits != 128 && bits != 192 && bits != 256)
-        throw std::invalid_argument("FF1Cipher: Key must be 128, 192, or 256 bits");
+    if (!_key)
+        throw std::invalid_argument("FF1Cipher: Key context must not be null");
+
+    if (radix < 2 || radix > (1 << 16))
+        throw std::invalid_argument("FF1Cipher: Radix must be in [2, 65536]");
+    _kernel = &RadixKernel::select(static_cast<uint32_t>(radix));
 
-    if (FPE_set_ff1_key(key.data(), bits, tweak.data(), tweak.size(), _radix, &_key) != 0)
-        throw std::runtime_error("FF1Cipher: Failed to initialize FF1 key");
+    if (small_domain.max_domain > MAX_TABLE_DOMAIN)
+        throw std::invalid_argument("FF1Cipher: Small-domain tables cover at most 65536 values");
 
     _valid = true;
 }
@@ -38,12 +847,15 @@ FF1Cipher::~FF1Cipher() noexcept
 }
 
 FF1Cipher::FF1Cipher(FF1Cipher&& other) noexcept
-    : _key(other._key)
+    : _key(std::move(other._key))
+    , _tweak(std::move(other._tweak))
     , _valid(other._valid)
     , _radix(other._radix)
+    , _kernel(other._kernel)
+    , _length_cache(std::move(other._length_cache))
+    , _tweak_cache(std::move(other._tweak_cache))
 {
     other._valid = false;
-    std::memset(&other._key, 0, sizeof(FPE_KEY));
 }
 
 FF1Cipher& FF1Cipher::operator=(FF1Cipher&& other) noexcept
@@ -51,67 +863,265 @@ FF1Cipher& FF1Cipher::operator=(FF1Cipher&& other) noexcept
     if (this != &other)
     {
         cleanup();
-        _key = other._key;
+        _key = std::move(other._key);
+        _tweak = std::move(other._tweak);
         _valid = other._valid;
         _radix = other._radix;
+        _kernel = other._kernel;
+        _length_cache = std::move(other._length_cache);
+        _tweak_cache = std::move(other._tweak_cache);
 
         other._valid = false;
-        std::memset(&other._key, 0, sizeof(FPE_KEY));
     }
     return *this;
 }
 
-std::vector<uint32_t> FF1Cipher::encrypt(std::vector<uint32_t>&& digits) const
+void FF1Cipher::encrypt(const std::span<const uint32_t> digits, const std::span<uint32_t> out) const
 {
-    if (!_valid)
-        throw std::logic_error("FF1Cipher not initialized");
-    if (digits.empty())
-        return std::move(digits);
+    transform(digits, out, _tweak, _length_cache.get(), true);
+}
 
-    validate_digits(digits, _radix);
+void FF1Cipher::decrypt(const std::span<const uint32_t> digits, const std::span<uint32_t> out) const
+{
+    transform(digits, out, _tweak, _length_cache.get(), false);
+}
 
-    // Allocate output buffer
-    std::vector<uint32_t> out(digits.size());
+void FF1Cipher::encrypt(
+    const std::span<const uint32_t> digits, const std::span<uint32_t> out, const std::span<const uint8_t> tweak
+) const
+{
+    transform(digits, out, tweak, length_cache_for(tweak).get(), true);
+}
 
-    // reinterpret_cast is safe if sizeof(uint32_t) == sizeof(unsigned int)
-    FPE_ff1_encrypt(
-        digits.data(),
-        reinterpret_cast<unsigned int*>(out.data()),
-        static_cast<unsigned int>(digits.size()),
-        const_cast<FPE_KEY*>(&_key),
-        FPE_ENCRYPT
-    );
+void FF1Cipher::decrypt(
+    const std::span<const uint32_t> digits, const std::span<uint32_t> out, const std::span<const uint8_t> tweak
+) const
+{
+    transform(digits, out, tweak, length_cache_for(tweak).get(), false);
+}
 
+std::vector<uint32_t> FF1Cipher::encrypt(std::vector<uint32_t>&& digits) const
+{
+    std::vector<uint32_t> out(digits.size());
+    encrypt(digits, out);
     return out;
 }
 
 std::vector<uint32_t> FF1Cipher::decrypt(std::vector<uint32_t>&& digits) const
+{
+    std::vector<uint32_t> out(digits.size());
+    decrypt(digits, out);
+    return out;
+}
+
+std::vector<uint32_t> FF1Cipher::encrypt(std::vector<uint32_t>&& digits, const std::span<const uint8_t> tweak) const
+{
+    std::vector<uint32_t> out(digits.size());
+    encrypt(digits, out, tweak);
+    return out;
+}
+
+std::vector<uint32_t> FF1Cipher::decrypt(std::vector<uint32_t>&& digits, const std::span<const uint8_t> tweak) const
+{
+    std::vector<uint32_t> out(digits.size());
+    decrypt(digits, out, tweak);
+    return out;
+}
+
+std::vector<std::vector<uint32_t>> FF1Cipher::encrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const
+{
+    return transform_batch(digits, _tweak, _length_cache.get(), true);
+}
+
+std::vector<std::vector<uint32_t>> FF1Cipher::decrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const
+{
+    return transform_batch(digits, _tweak, _length_cache.get(), false);
+}
+
+std::vector<std::vector<uint32_t>> FF1Cipher::encrypt_batch(
+    const std::vector<std::vector<uint32_t>>& digits, const std::span<const uint8_t> tweak
+) const
+{
+    return transform_batch(digits, tweak, length_cache_for(tweak).get(), true);
+}
+
+std::vector<std::vector<uint32_t>> FF1Cipher::decrypt_batch(
+    const std::vector<std::vector<uint32_t>>& digits, const std::span<const uint8_t> tweak
+) const
+{
+    return transform_batch(digits, tweak, length_cache_for(tweak).get(), false);
+}
+
+std::shared_ptr<FF1Cipher::LengthCache> FF1Cipher::length_cache_for(const std::span<const uint8_t> tweak) const
+{
+    if (!_valid)
+        throw std::logic_error("FF1Cipher not initialized");
+
+    if (std::ranges::equal(tweak, _tweak))
+        return _length_cache;
+    return _tweak_cache->get(tweak);
+}
+
+void FF1Cipher::transform(
+    const std::span<const uint32_t> digits,
+    const std::span<uint32_t> out,
+    const std::span<const uint8_t> tweak,
+    LengthCache* length_cache,
+    const bool encrypt
+) const
 {
     if (!_valid)
         throw std::logic_error("FF1Cipher not initialized");
+    if (digits.size() != out.size())
+        throw std::invalid_argument("FF1Cipher: output size must match input size");
     if (digits.empty())
-        return std::move(digits);
+        return;
 
     validate_digits(digits, _radix);
 
-    std::vector<uint32_t> out(digits.size());
+    const auto radix = static_cast<uint32_t>(_radix);
+    if (const uint16_t* table = small_domain_table(tweak, length_cache, digits.size()))
+    {
+        table_lookup(table, radix, digits.data(), out.data(), digits.size(), encrypt);
+        return;
+    }
 
-    FPE_ff1_encrypt(
-        digits.data(),
-        reinterpret_cast<unsigned int*>(out.data()),
-        static_cast<unsigned int>(digits.size()),
-        &_key,
-        FPE_DECRYPT
-    );
+    const AesPrf& prf = _key->prf();
+    NativeDomain uncached;
+    const NativeDomain& domain = length_cache->get(prf, tweak, radix, digits.size(), uncached);
 
-    return out;
+    // Both paths read the whole input before writing any output, so digits and out may alias
+    const uint32_t* in = digits.data();
+    uint32_t* dst = out.data();
+    _kernel->run(domain, prf, tweak, radix, &in, &dst, 1, encrypt);
 }
 
-void FF1Cipher::cleanup() noexcept
+std::vector<std::vector<uint32_t>> FF1Cipher::transform_batch(
+    const std::vector<std::vector<uint32_t>>& inputs,
+    const std::span<const uint8_t> tweak,
+    LengthCache* length_cache,
+    const bool encrypt
+) const
 {
-    if (_valid)
+    if (!_valid)
+        throw std::logic_error("FF1Cipher not initialized");
+
+    const auto radix = static_cast<uint32_t>(_radix);
+
+    std::vector<std::vector<uint32_t>> outputs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        validate_digits(inputs[i], radix);
+        outputs[i].resize(inputs[i].size());
+    }
+
+    // Group by length so each group shares its round constants and its AES calls
+    std::vector<size_t> order(inputs.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::stable_sort(order.begin(), order.end(), [&](const size_t lhs, const size_t rhs) {
+        return inputs[lhs].size() < inputs[rhs].size();
+    });
+
+    const AesPrf& prf = _key->prf();
+
+    size_t group_begin = 0;
+    while (group_begin < order.size())
     {
-        FPE_unset_ff1_key(&_key);
-        _valid = false;
+        const size_t n = inputs[order[group_begin]].size();
+        size_t group_end = group_begin;
+        while (group_end < order.size() && inputs[order[group_end]].size() == n)
+            ++group_end;
+
+        if (const uint16_t* table = n != 0 ? small_domain_table(tweak, length_cache, n) : nullptr)
+        {
+            for (size_t i = group_begin; i < group_end; ++i)
+                table_lookup(table, radix, inputs[order[i]].data(), outputs[order[i]].data(), n, encrypt);
+        }
+        else if (n != 0)
+        {
+            NativeDomain uncached;
+            const NativeDomain& domain = length_cache->get(prf, tweak, radix, n, uncached);
+
+            for (size_t first = group_begin; first < group_end; first += MAX_LANES)
+            {
+                const size_t lanes = std::min(MAX_LANES, group_end - first);
+                const uint32_t* in[MAX_LANES];
+                uint32_t* out[MAX_LANES];
+                for (size_t lane = 0; lane < lanes; ++lane)
+                {
+                    in[lane] = inputs[order[first + lane]].data();
+                    out[lane] = outputs[order[first + lane]].data();
+                }
+                _kernel->run(domain, prf, tweak, radix, in, out, lanes, encrypt);
+            }
+        }
+
+        group_begin = group_end;
     }
+
+    return outputs;
+}
+
+size_t FF1Cipher::small_domain_table_bytes() const noexcept
+{
+    return _length_cache ? _length_cache->table_bytes.load(std::memory_order_relaxed) : 0;
+}
+
+// The table of length n under the given length cache, or nullptr when that length runs the Feistel rounds. Building a
+// table encrypts every value of the domain once, eight strings per batch call.
+const uint16_t* FF1Cipher::small_domain_table(
+    const std::span<const uint8_t> tweak, LengthCache* length_cache, const size_t n
+) const
+{
+    const auto radix = static_cast<uint32_t>(_radix);
+    const auto size = static_cast<size_t>(bounded_pow(radix, n, length_cache->limits.max_domain));
+    if (size == 0)
+        return nullptr;
+
+    return length_cache->table(n, size, [&] {
+        const AesPrf& prf = _key->prf();
+        NativeDomain uncached;
+        const NativeDomain& domain = length_cache->get(prf, tweak, radix, n, uncached);
+
+        std::vector<uint32_t> plain(MAX_LANES * n);
+        std::vector<uint32_t> cipher(MAX_LANES * n);
+        const uint32_t* in[MAX_LANES];
+        uint32_t* out[MAX_LANES];
+        for (size_t lane = 0; lane < MAX_LANES; ++lane)
+        {
+            in[lane] = plain.data() + lane * n;
+            out[lane] = cipher.data() + lane * n;
+        }
+
+        auto table = std::make_unique<uint16_t[]>(2 * size);
+        for (size_t first = 0; first < size; first += MAX_LANES)
+        {
+            const size_t lanes = std::min(MAX_LANES, size - first);
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                size_t value = first + lane;
+                for (size_t i = n; i-- > 0; value /= radix)
+                    plain[lane * n + i] = static_cast<uint32_t>(value % radix);
+            }
+
+            _kernel->run(domain, prf, tweak, radix, in, out, lanes, true);
+
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                size_t value = 0;
+                for (size_t i = 0; i < n; ++i)
+                    value = value * radix + cipher[lane * n + i];
+                table[first + lane] = static_cast<uint16_t>(value);
+                table[size + value] = static_cast<uint16_t>(first + lane);
+            }
+        }
+        return table;
+    });
+}
+
+void FF1Cipher::cleanup() noexcept
+{
+    // The key context cleanses itself once its last cipher lets go
+    _key.reset();
+    _valid = false;
 }
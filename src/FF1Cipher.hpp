@@ -2,13 +2,41 @@
 
 #include <vector>
 #include <cstdint>
-#include <fpe.h>
+#include <memory>
+#include <span>
+#include "FPEKeyContext.hpp"
 
+// Opt-in whole-domain lookup tables for FF1Cipher. Each length whose domain radix^n is at most max_domain (which may
+// not exceed 65536) gets its encrypt and decrypt permutations tabulated on first use, for as long as the cipher's tables
+// fit in max_bytes. Lengths that do not fit keep running the Feistel rounds. The default disables tables.
+struct SmallDomainTables
+{
+    size_t max_domain = 0;
+    size_t max_bytes = 0;
+};
+
+// NIST SP 800-38G FF1 over numeral strings of a fixed radix.
+//
+// Numeral strings whose halves fit in a native integer (radix^ceil(n/2) <= 2^120) run the Feistel rounds entirely in
+// 64- or 128-bit arithmetic; longer inputs fall back to OpenSSL BIGNUM. Both paths produce identical ciphertexts.
+// The round-independent PRF state of each short length is computed on first use and cached for the cipher's lifetime.
+// Common radices (6, 10, 33, 52 and every power of two) run kernels with the radix fixed at compile time.
+// With SmallDomainTables enabled, short inputs under the constructor tweak become two table lookups instead.
 class FF1Cipher
 {
   public:
     FF1Cipher(
-        const std::vector<uint8_t>& key, const std::vector<uint8_t>& tweak, int32_t radix
+        const std::vector<uint8_t>& key,
+        const std::vector<uint8_t>& tweak,
+        int32_t radix,
+        SmallDomainTables small_domain = {}
+    );
+    // Same, over a key context that other ciphers may share. Only the radix, tweak and caches are per cipher.
+    FF1Cipher(
+        std::shared_ptr<const FPEKeyContext> key,
+        const std::vector<uint8_t>& tweak,
+        int32_t radix,
+        SmallDomainTables small_domain = {}
     );
     ~FF1Cipher() noexcept;
 
@@ -17,13 +45,63 @@ class FF1Cipher
     FF1Cipher(FF1Cipher&&) noexcept;
     FF1Cipher& operator=(FF1Cipher&&) noexcept;
 
+    // Encrypts/decrypts digits into out, which must be the same size and may be the same memory. Inputs whose
+    // domain fits in 120 bits never touch the heap.
+    void encrypt(std::span<const uint32_t> digits, std::span<uint32_t> out) const;
+    void decrypt(std::span<const uint32_t> digits, std::span<uint32_t> out) const;
+
+    // Same, under a per-call tweak instead of the constructor's. The key schedule is shared across tweaks and the
+    // per-length state of the most recently used tweaks is kept in a small LRU.
+    void encrypt(std::span<const uint32_t> digits, std::span<uint32_t> out, std::span<const uint8_t> tweak) const;
+    void decrypt(std::span<const uint32_t> digits, std::span<uint32_t> out, std::span<const uint8_t> tweak) const;
+
+    // Allocating wrappers over the span overloads
     std::vector<uint32_t> encrypt(std::vector<uint32_t>&& digits) const;
     std::vector<uint32_t> decrypt(std::vector<uint32_t>&& digits) const;
+    std::vector<uint32_t> encrypt(std::vector<uint32_t>&& digits, std::span<const uint8_t> tweak) const;
+    std::vector<uint32_t> decrypt(std::vector<uint32_t>&& digits, std::span<const uint8_t> tweak) const;
+
+    // Encrypts/decrypts many numeral strings at once. Strings are grouped by length and up to eight of a length run
+    // their rounds side by side, so the AES calls of independent strings overlap. Results keep the input order.
+    std::vector<std::vector<uint32_t>> encrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const;
+    std::vector<std::vector<uint32_t>> decrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const;
+    std::vector<std::vector<uint32_t>> encrypt_batch(
+        const std::vector<std::vector<uint32_t>>& digits, std::span<const uint8_t> tweak
+    ) const;
+    std::vector<std::vector<uint32_t>> decrypt_batch(
+        const std::vector<std::vector<uint32_t>>& digits, std::span<const uint8_t> tweak
+    ) const;
+
+    // Bytes currently held by small-domain tables, never more than SmallDomainTables::max_bytes
+    size_t small_domain_table_bytes() const noexcept;
 
   private:
-    mutable FPE_KEY _key{};
+    struct LengthCache;
+    struct TweakCache;
+    struct RadixKernel;
+
+    std::shared_ptr<const FPEKeyContext> _key;
+    std::vector<uint8_t> _tweak;
     bool _valid = false;
     int32_t _radix = 10;
+    const RadixKernel* _kernel = nullptr;       // chosen from the radix at construction
+    std::shared_ptr<LengthCache> _length_cache; // for the constructor tweak
+    std::unique_ptr<TweakCache> _tweak_cache;   // for per-call tweaks
 
+    std::shared_ptr<LengthCache> length_cache_for(std::span<const uint8_t> tweak) const;
+    const uint16_t* small_domain_table(std::span<const uint8_t> tweak, LengthCache* length_cache, size_t n) const;
+    void transform(
+        std::span<const uint32_t> digits,
+        std::span<uint32_t> out,
+        std::span<const uint8_t> tweak,
+        LengthCache* length_cache,
+        bool encrypt
+    ) const;
+    std::vector<std::vector<uint32_t>> transform_batch(
+        const std::vector<std::vector<uint32_t>>& digits,
+        std::span<const uint8_t> tweak,
+        LengthCache* length_cache,
+        bool encrypt
+    ) const;
     void cleanup() noexcept;
 };
@@ -0,0 +1,312 @@
+#include "FF3_1Cipher.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <openssl/crypto.h>
+
+namespace {
+    using uint128_t = unsigned __int128;
+
+    constexpr int FF3_1_ROUNDS = 8;
+    constexpr size_t BLOCK_SIZE = 16;
+
+    // Each half is packed into the 12 low bytes of the PRF input
+    constexpr uint128_t HALF_LIMIT = uint128_t(1) << 96;
+
+    void validate_digits(const std::span<const uint32_t> input, const uint32_t radix) {
+        for (const auto digit : input) {
+            if (digit >= radix) {
+                throw std::invalid_argument("Digit out of range");
+            }
+        }
+    }
+
+    // NUM_radix(REV(X)): the first numeral is the least significant
+    uint128_t num_rev(const uint32_t* digits, const size_t m, const uint32_t radix)
+    {
+        uint128_t value = 0;
+        for (size_t j = m; j-- > 0;)
+            value = value * radix + digits[j];
+        return value;
+    }
+
+    // REV(STR^m_radix(value))
+    void str_rev(uint128_t value, uint32_t* digits, const size_t m, const uint32_t radix)
+    {
+        for (size_t j = 0; j < m; ++j)
+        {
+            digits[j] = static_cast<uint32_t>(value % radix);
+            value /= radix;
+        }
+    }
+
+    uint128_t pow_radix(const uint32_t radix, const size_t exponent)
+    {
+        uint128_t result = 1;
+        for (size_t i = 0; i < exponent; ++i)
+            result *= radix;
+        return result;
+    }
+
+    // NUM(S) for S = REVB(CIPH_REVB(K)(REVB(W xor [i]_4 || [x]_12))), steps 4.ii-4.iv of Algorithm 9. The reversals
+    // cancel out into a little-endian load of x and a little-endian read of the AES output.
+    uint128_t prf(const AesPrf& key, const uint8_t w[4], const int round, uint128_t x)
+    {
+        uint8_t block[BLOCK_SIZE];
+        for (size_t k = 0; k < 12; ++k, x >>= 8)
+            block[k] = static_cast<uint8_t>(x);
+        block[12] = static_cast<uint8_t>(w[0] ^ round);
+        block[13] = w[1];
+        block[14] = w[2];
+        block[15] = w[3];
+
+        key.encrypt(block, block);
+
+        uint128_t y = 0;
+        for (size_t k = BLOCK_SIZE; k-- > 0;)
+            y = (y << 8) | block[k];
+        return y;
+    }
+}
+
+FF3_1Cipher::FF3_1Cipher(
+    const std::vector<uint8_t>& key,
+    const std::vector<uint8_t>& tweak,
+    const int32_t radix
+) : FF3_1Cipher(std::make_shared<const FPEKeyContext>(key), tweak, radix)
+{}
+
+FF3_1Cipher::FF3_1Cipher(
+    std::shared_ptr<const FPEKeyContext> key,
+    const std::vector<uint8_t>& tweak,
+    const int32_t radix
+) : _key(std::move(key))
+  , _tweak(split_tweak(tweak))
+  , _radix(static_cast<uint32_t>(radix))
+{
+    if (!_key)
+        throw std::invalid_argument("FF3_1Cipher: Key context must not be null");
+
+    if (radix < 2 || radix > (1 << 16))
+        throw std::invalid_argument("FF3_1Cipher: Radix must be in [2, 65536]");
+
+    while (pow_radix(_radix, _max_half + 1) <= HALF_LIMIT)
+        ++_max_half;
+
+    _schedule = &_key->reversed_prf();
+    _valid = true;
+}
+
+FF3_1Cipher::~FF3_1Cipher() noexcept
+{
+    cleanup();
+}
+
+FF3_1Cipher::FF3_1Cipher(FF3_1Cipher&& other) noexcept
+    : _key(std::move(other._key))
+    , _schedule(other._schedule)
+    , _tweak(other._tweak)
+    , _valid(other._valid)
+    , _radix(other._radix)
+    , _max_half(other._max_half)
+{
+    other._valid = false;
+    other._schedule = nullptr;
+    OPENSSL_cleanse(&other._tweak, sizeof(TweakHalves));
+}
+
+FF3_1Cipher& FF3_1Cipher::operator=(FF3_1Cipher&& other) noexcept
+{
+    if (this != &other)
+    {
+        cleanup();
+        _key = std::move(other._key);
+        _schedule = other._schedule;
+        _tweak = other._tweak;
+        _valid = other._valid;
+        _radix = other._radix;
+        _max_half = other._max_half;
+
+        other._valid = false;
+        other._schedule = nullptr;
+        OPENSSL_cleanse(&other._tweak, sizeof(TweakHalves));
+    }
+    return *this;
+}
+
+void FF3_1Cipher::encrypt(const std::span<const uint32_t> digits, const std::span<uint32_t> out) const
+{
+    transform(digits, out, _tweak, true);
+}
+
+void FF3_1Cipher::decrypt(const std::span<const uint32_t> digits, const std::span<uint32_t> out) const
+{
+    transform(digits, out, _tweak, false);
+}
+
+void FF3_1Cipher::encrypt(
+    const std::span<const uint32_t> digits, const std::span<uint32_t> out, const std::span<const uint8_t> tweak
+) const
+{
+    transform(digits, out, split_tweak(tweak), true);
+}
+
+void FF3_1Cipher::decrypt(
+    const std::span<const uint32_t> digits, const std::span<uint32_t> out, const std::span<const uint8_t> tweak
+) const
+{
+    transform(digits, out, split_tweak(tweak), false);
+}
+
+std::vector<uint32_t> FF3_1Cipher::encrypt(std::vector<uint32_t>&& digits) const
+{
+    std::vector<uint32_t> out(digits.size());
+    encrypt(digits, out);
+    return out;
+}
+
+std::vector<uint32_t> FF3_1Cipher::decrypt(std::vector<uint32_t>&& digits) const
+{
+    std::vector<uint32_t> out(digits.size());
+    decrypt(digits, out);
+    return out;
+}
+
+std::vector<uint32_t> FF3_1Cipher::encrypt(std::vector<uint32_t>&& digits, const std::span<const uint8_t> tweak) const
+{
+    std::vector<uint32_t> out(digits.size());
+    encrypt(digits, out, tweak);
+    return out;
+}
+
+std::vector<uint32_t> FF3_1Cipher::decrypt(std::vector<uint32_t>&& digits, const std::span<const uint8_t> tweak) const
+{
+    std::vector<uint32_t> out(digits.size());
+    decrypt(digits, out, tweak);
+    return out;
+}
+
+std::vector<std::vector<uint32_t>> FF3_1Cipher::encrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const
+{
+    return transform_batch(digits, _tweak, true);
+}
+
+std::vector<std::vector<uint32_t>> FF3_1Cipher::decrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const
+{
+    return transform_batch(digits, _tweak, false);
+}
+
+std::vector<std::vector<uint32_t>> FF3_1Cipher::encrypt_batch(
+    const std::vector<std::vector<uint32_t>>& digits, const std::span<const uint8_t> tweak
+) const
+{
+    return transform_batch(digits, split_tweak(tweak), true);
+}
+
+std::vector<std::vector<uint32_t>> FF3_1Cipher::decrypt_batch(
+    const std::vector<std::vector<uint32_t>>& digits, const std::span<const uint8_t> tweak
+) const
+{
+    return transform_batch(digits, split_tweak(tweak), false);
+}
+
+// TL = T[0..27] || 0^4 and TR = T[32..55] || T[28..31] || 0^4, stored byte-reversed
+FF3_1Cipher::TweakHalves FF3_1Cipher::split_tweak(const std::span<const uint8_t> tweak)
+{
+    if (tweak.size() != TWEAK_SIZE)
+        throw std::invalid_argument("FF3_1Cipher: Tweak must be 56 bits");
+
+    TweakHalves halves{};
+    halves.left[0] = static_cast<uint8_t>(tweak[3] & 0xF0);
+    halves.left[1] = tweak[2];
+    halves.left[2] = tweak[1];
+    halves.left[3] = tweak[0];
+    halves.right[0] = static_cast<uint8_t>(tweak[3] << 4);
+    halves.right[1] = tweak[6];
+    halves.right[2] = tweak[5];
+    halves.right[3] = tweak[4];
+    return halves;
+}
+
+void FF3_1Cipher::transform(
+    const std::span<const uint32_t> digits,
+    const std::span<uint32_t> out,
+    const TweakHalves& tweak,
+    const bool encrypt
+) const
+{
+    if (!_valid)
+        throw std::logic_error("FF3_1Cipher not initialized");
+    if (digits.size() != out.size())
+        throw std::invalid_argument("FF3_1Cipher: output size must match input size");
+    if (digits.empty())
+        return;
+    // Only the maximum is enforced; see the header for why the Rev. 1 minimum domain size is not
+    if (digits.size() > max_length())
+        throw std::invalid_argument("FF3_1Cipher: Input longer than the radix allows");
+
+    validate_digits(digits, _radix);
+
+    // Algorithm 9: A is the first ceil(n/2) numerals. Both halves are held as NUM_radix(REV(.)), so every round is
+    // one AES call plus a modular add on integers below 2^97.
+    const size_t n = digits.size();
+    const size_t u = (n + 1) / 2;
+    const size_t v = n - u;
+    const uint128_t mod_u = pow_radix(_radix, u);
+    const uint128_t mod_v = pow_radix(_radix, v);
+
+    uint128_t a = num_rev(digits.data(), u, _radix);
+    uint128_t b = num_rev(digits.data() + u, v, _radix);
+
+    if (encrypt)
+    {
+        for (int i = 0; i < FF3_1_ROUNDS; ++i)
+        {
+            const bool even = i % 2 == 0;
+            const uint128_t mod = even ? mod_u : mod_v;
+            const uint128_t y = prf(*_schedule, even ? tweak.right : tweak.left, i, b) % mod;
+            const uint128_t c = (a + y) % mod;
+            a = b;
+            b = c;
+        }
+    }
+    else
+    {
+        for (int i = FF3_1_ROUNDS - 1; i >= 0; --i)
+        {
+            const bool even = i % 2 == 0;
+            const uint128_t mod = even ? mod_u : mod_v;
+            const uint128_t y = prf(*_schedule, even ? tweak.right : tweak.left, i, a) % mod;
+            const uint128_t c = (b + mod - y) % mod;
+            b = a;
+            a = c;
+        }
+    }
+
+    str_rev(a, out.data(), u, _radix);
+    str_rev(b, out.data() + u, v, _radix);
+}
+
+std::vector<std::vector<uint32_t>> FF3_1Cipher::transform_batch(
+    const std::vector<std::vector<uint32_t>>& inputs, const TweakHalves& tweak, const bool encrypt
+) const
+{
+    std::vector<std::vector<uint32_t>> outputs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        outputs[i].resize(inputs[i].size());
+        transform(inputs[i], outputs[i], tweak, encrypt);
+    }
+    return outputs;
+}
+
+void FF3_1Cipher::cleanup() noexcept
+{
+    // The key context cleanses itself once its last cipher lets go
+    if (_valid)
+        OPENSSL_cleanse(&_tweak, sizeof(TweakHalves));
+    _key.reset();
+    _schedule = nullptr;
+    _valid = false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include "FPEKeyContext.hpp"
+
+// FF3-1 of NIST SP 800-38G Rev. 1 over numeral strings of a fixed radix.
+//
+// Eight Feistel rounds of one AES call each, so short inputs cost noticeably less than FF1. Each half must satisfy
+// radix^half <= 2^96, which caps inputs at 2 * floor(log_radix(2^96)) numerals (40 for radix 26, 12 for radix 20992);
+// longer inputs throw. Tweaks are exactly 56 bits. The interface mirrors FF1Cipher.
+//
+// Deviation from Rev. 1: the standard requires radix^minlen >= 1,000,000 (six numerals for radix 10, five for radix
+// 26), but this class accepts any length from one numeral up, since GlyphFPECipher and UnicodeFPECipher hand it short
+// runs of a single glyph class. Below that minimum the domain is tiny (one numeral has only radix possible
+// ciphertexts) and offers little secrecy; callers that need conformance must reject shorter inputs themselves.
+class FF3_1Cipher
+{
+  public:
+    static constexpr size_t TWEAK_SIZE = 7;
+
+    FF3_1Cipher(
+        const std::vector<uint8_t>& key, const std::vector<uint8_t>& tweak, int32_t radix
+    );
+    // Same, over a key context that other ciphers may share
+    FF3_1Cipher(std::shared_ptr<const FPEKeyContext> key, const std::vector<uint8_t>& tweak, int32_t radix);
+    ~FF3_1Cipher() noexcept;
+
+    FF3_1Cipher(const FF3_1Cipher&) = delete;
+    FF3_1Cipher& operator=(const FF3_1Cipher&) = delete;
+    FF3_1Cipher(FF3_1Cipher&&) noexcept;
+    FF3_1Cipher& operator=(FF3_1Cipher&&) noexcept;
+
+    // Longest numeral string this radix accepts
+    size_t max_length() const noexcept { return 2 * _max_half; }
+
+    // Encrypts/decrypts digits into out, which must be the same size and may be the same memory. Never allocates.
+    void encrypt(std::span<const uint32_t> digits, std::span<uint32_t> out) const;
+    void decrypt(std::span<const uint32_t> digits, std::span<uint32_t> out) const;
+
+    // Same, under a per-call 56-bit tweak instead of the constructor's
+    void encrypt(std::span<const uint32_t> digits, std::span<uint32_t> out, std::span<const uint8_t> tweak) const;
+    void decrypt(std::span<const uint32_t> digits, std::span<uint32_t> out, std::span<const uint8_t> tweak) const;
+
+    // Allocating wrappers over the span overloads
+    std::vector<uint32_t> encrypt(std::vector<uint32_t>&& digits) const;
+    std::vector<uint32_t> decrypt(std::vector<uint32_t>&& digits) const;
+    std::vector<uint32_t> encrypt(std::vector<uint32_t>&& digits, std::span<const uint8_t> tweak) const;
+    std::vector<uint32_t> decrypt(std::vector<uint32_t>&& digits, std::span<const uint8_t> tweak) const;
+
+    // Encrypts/decrypts many numeral strings at once. Results keep the input order.
+    std::vector<std::vector<uint32_t>> encrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const;
+    std::vector<std::vector<uint32_t>> decrypt_batch(const std::vector<std::vector<uint32_t>>& digits) const;
+    std::vector<std::vector<uint32_t>> encrypt_batch(
+        const std::vector<std::vector<uint32_t>>& digits, std::span<const uint8_t> tweak
+    ) const;
+    std::vector<std::vector<uint32_t>> decrypt_batch(
+        const std::vector<std::vector<uint32_t>>& digits, std::span<const uint8_t> tweak
+    ) const;
+
+  private:
+    // Tweak halves as they appear in the byte-reversed PRF input: W reversed, round number XORed into byte 0
+    struct TweakHalves
+    {
+        uint8_t left[4];
+        uint8_t right[4];
+    };
+
+    std::shared_ptr<const FPEKeyContext> _key;
+    const AesPrf* _schedule = nullptr; // _key's REVB(K) schedule
+    TweakHalves _tweak{};
+    bool _valid = false;
+    uint32_t _radix = 10;
+    size_t _max_half = 0;
+
+    static TweakHalves split_tweak(std::span<const uint8_t> tweak);
+    void transform(
+        std::span<const uint32_t> digits, std::span<uint32_t> out, const TweakHalves& tweak, bool encrypt
+    ) const;
+    std::vector<std::vector<uint32_t>> transform_batch(
+        const std::vector<std::vector<uint32_t>>& digits, const TweakHalves& tweak, bool encrypt
+    ) const;
+    void cleanup() noexcept;
+};
@@ -0,0 +1,22 @@
+#include "FPEKeyContext.hpp"
+#include <openssl/crypto.h>
+
+namespace {
+    // REVB(K), cleansed once the reversed schedule has been expanded from it
+    struct ReversedKey
+    {
+        std::vector<uint8_t> bytes;
+
+        explicit ReversedKey(const std::vector<uint8_t>& key)
+            : bytes(key.rbegin(), key.rend())
+        {
+        }
+        ~ReversedKey() noexcept { OPENSSL_cleanse(bytes.data(), bytes.size()); }
+    };
+}
+
+FPEKeyContext::FPEKeyContext(const std::vector<uint8_t>& key)
+    : _prf(key)
+    , _reversed(ReversedKey(key).bytes)
+{
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "AesPrf.hpp"
+
+// AES key material shared by every cipher built from the same key, e.g. the ciphers of all Unicode blocks, so that
+// hundreds of ciphers keep one copy of the round keys instead of one each. Both schedules are expanded up front and the
+// raw key is not kept, so the context is immutable and any number of ciphers and threads may hold one. The round keys
+// are cleansed when the last reference goes away.
+class FPEKeyContext
+{
+  public:
+    explicit FPEKeyContext(const std::vector<uint8_t>& key);
+
+    FPEKeyContext(const FPEKeyContext&) = delete;
+    FPEKeyContext& operator=(const FPEKeyContext&) = delete;
+
+    // CIPH_K, as FF1 uses it
+    const AesPrf& prf() const noexcept { return _prf; }
+
+    // CIPH_REVB(K), as FF3-1 uses it
+    const AesPrf& reversed_prf() const noexcept { return _reversed; }
+
+  private:
+    AesPrf _prf;
+    AesPrf _reversed;
+};
@@ -1,9 +1,16 @@
 #pragma once
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <variant>
 #include <vector>
 #include <stdexcept>
+#include <type_traits>
 #include "IndexedGlyphSet.hpp"
+#include "CodepointRangeGlyphSet.hpp"
 #include "FF1Cipher.hpp"
+#include "FF3_1Cipher.hpp"
 #include <immintrin.h> // for AVX2 intrinsics if available
 
 #include <cstring>
@@ -27,119 +34,439 @@ public:
     auto& operator*() const noexcept { return *ptr_; }
 };
 
+// FPE algorithm behind a GlyphFPECipher. FF3_1 is cheaper per call but needs a 56-bit tweak and caps input length
+// (see FF3_1Cipher).
+enum class FPEAlgorithm {
+    FF1,
+    FF3_1
+};
+
+// Backends for BasicGlyphFPECipher. Each maps numeral strings (glyph indexes) to numeral strings of the same length.
+// identity marks a backend whose output is its input, so the cipher can skip glyph mapping altogether.
+namespace glyph_fpe {
+    // Per-call tweak, or nullopt for the tweak the cipher was built with
+    using Tweak = std::optional<std::span<const uint8_t>>;
+
+    template <typename Cipher>
+    class CipherBackend {
+    public:
+        static constexpr bool identity = false;
+
+        void encrypt(const std::span<uint32_t> digits, const Tweak tweak) const {
+            if (tweak)
+                _cipher.encrypt(digits, digits, *tweak);
+            else
+                _cipher.encrypt(digits, digits);
+        }
+
+        void decrypt(const std::span<uint32_t> digits, const Tweak tweak) const {
+            if (tweak)
+                _cipher.decrypt(digits, digits, *tweak);
+            else
+                _cipher.decrypt(digits, digits);
+        }
+
+        std::vector<std::vector<uint32_t>> encrypt_batch(
+            const std::vector<std::vector<uint32_t>>& digits, const Tweak tweak
+        ) const {
+            return tweak ? _cipher.encrypt_batch(digits, *tweak) : _cipher.encrypt_batch(digits);
+        }
+
+        std::vector<std::vector<uint32_t>> decrypt_batch(
+            const std::vector<std::vector<uint32_t>>& digits, const Tweak tweak
+        ) const {
+            return tweak ? _cipher.decrypt_batch(digits, *tweak) : _cipher.decrypt_batch(digits);
+        }
+
+        const Cipher& cipher() const noexcept { return _cipher; }
+
+    protected:
+        explicit CipherBackend(Cipher cipher) : _cipher(std::move(cipher)) {}
+
+        Cipher _cipher;
+    };
+
+    // FF1. With SmallDomainTables enabled this is also the lookup-table mode: every string of a small enough domain,
+    // e.g. a single digit or a two-letter code, is answered from precomputed permutation tables for the constructor
+    // tweak, and other inputs run the Feistel rounds.
+    class FF1 : public CipherBackend<FF1Cipher> {
+    public:
+        static constexpr FPEAlgorithm algorithm = FPEAlgorithm::FF1;
+
+        FF1(
+            int32_t radix,
+            std::shared_ptr<const FPEKeyContext> key,
+            const std::vector<uint8_t>& tweak,
+            SmallDomainTables small_domain = {}
+        )
+            : CipherBackend(FF1Cipher(std::move(key), tweak, radix, small_domain))
+        {}
+
+        size_t small_domain_table_bytes() const noexcept { return _cipher.small_domain_table_bytes(); }
+    };
+
+    class FF3_1 : public CipherBackend<FF3_1Cipher> {
+    public:
+        static constexpr FPEAlgorithm algorithm = FPEAlgorithm::FF3_1;
+
+        FF3_1(int32_t radix, std::shared_ptr<const FPEKeyContext> key, const std::vector<uint8_t>& tweak)
+            : CipherBackend(FF3_1Cipher(std::move(key), tweak, radix))
+        {}
+
+        size_t small_domain_table_bytes() const noexcept { return 0; }
+    };
+
+    // Passes text through unchanged. Holds no key.
+    struct Noop {
+        static constexpr bool identity = true;
+        static constexpr FPEAlgorithm algorithm = FPEAlgorithm::FF1; // as noop ciphers have always reported
+
+        explicit Noop(int32_t /*radix*/) noexcept {}
+
+        size_t small_domain_table_bytes() const noexcept { return 0; }
+    };
+}
+
+// Format-preserving encryption of text over one glyph set. Each glyph is replaced by its index in the set, the index
+// string goes through Backend (one of glyph_fpe::FF1, FF3_1 or Noop), and the result is mapped back to
+// glyphs. The backend is fixed at compile time, so the mapping and cipher calls inline into one loop; GlyphFPECipher
+// wraps any of them for containers that mix backends. GlyphSet is an IndexedGlyphSet or a CodepointRangeGlyphSet.
+template <typename Backend, typename GlyphSet = IndexedGlyphSet>
+class BasicGlyphFPECipher {
+public:
+    // Backend arguments after the radix, which comes from the glyph set
+    template <typename... Args>
+    explicit BasicGlyphFPECipher(not_null<const GlyphSet*> glyph_set, Args&&... backend_args)
+        : _glyph_set(glyph_set)
+        , _backend(static_cast<int32_t>(glyph_set->size()), std::forward<Args>(backend_args)...)
+    {}
+
+    const GlyphSet& glyphs() const noexcept {
+        return *_glyph_set;
+    }
+
+    const Backend& backend() const noexcept {
+        return _backend;
+    }
+
+    std::string encrypt(std::string_view utf8_input, glyph_fpe::Tweak tweak = std::nullopt) const {
+        return transform(utf8_input, tweak, true);
+    }
+
+    std::string decrypt(std::string_view utf8_input, glyph_fpe::Tweak tweak = std::nullopt) const {
+        return transform(utf8_input, tweak, false);
+    }
+
+    std::vector<std::string> encrypt_batch(
+        const std::vector<std::string>& utf8_inputs, glyph_fpe::Tweak tweak = std::nullopt
+    ) const {
+        return transform_batch(utf8_inputs, tweak, true);
+    }
+
+    std::vector<std::string> decrypt_batch(
+        const std::vector<std::string>& utf8_inputs, glyph_fpe::Tweak tweak = std::nullopt
+    ) const {
+        return transform_batch(utf8_inputs, tweak, false);
+    }
+
+    // Encrypts/decrypts glyph indexes in place, for callers that map glyphs themselves (see UnicodeFPECipher). Every
+    // index must be below glyphs().size().
+    void encrypt_indexes(const std::span<uint32_t> indexes, const glyph_fpe::Tweak tweak = std::nullopt) const {
+        if constexpr (!Backend::identity)
+            _backend.encrypt(indexes, tweak);
+    }
+
+    void decrypt_indexes(const std::span<uint32_t> indexes, const glyph_fpe::Tweak tweak = std::nullopt) const {
+        if constexpr (!Backend::identity)
+            _backend.decrypt(indexes, tweak);
+    }
+
+    std::vector<std::vector<uint32_t>> encrypt_indexes_batch(
+        const std::vector<std::vector<uint32_t>>& indexes, const glyph_fpe::Tweak tweak = std::nullopt
+    ) const {
+        if constexpr (Backend::identity)
+            return indexes;
+        else
+            return _backend.encrypt_batch(indexes, tweak);
+    }
+
+    std::vector<std::vector<uint32_t>> decrypt_indexes_batch(
+        const std::vector<std::vector<uint32_t>>& indexes, const glyph_fpe::Tweak tweak = std::nullopt
+    ) const {
+        if constexpr (Backend::identity)
+            return indexes;
+        else
+            return _backend.decrypt_batch(indexes, tweak);
+    }
+
+private:
+    not_null<const GlyphSet*> _glyph_set;
+    Backend _backend;
+
+    std::string transform(const std::string_view utf8_input, const glyph_fpe::Tweak tweak, const bool encrypt) const {
+        if constexpr (Backend::identity) {
+            return std::string(utf8_input);
+        } else {
+            auto glyph_indexes = utf8_to_glyph_indexes(utf8_input);
+            if (encrypt)
+                _backend.encrypt(glyph_indexes, tweak);
+            else
+                _backend.decrypt(glyph_indexes, tweak);
+            return glyph_indexes_to_utf8(glyph_indexes);
+        }
+    }
+
+    std::vector<std::string> transform_batch(
+        const std::vector<std::string>& utf8_inputs, const glyph_fpe::Tweak tweak, const bool encrypt
+    ) const {
+        if constexpr (Backend::identity) {
+            return utf8_inputs;
+        } else {
+            std::vector<std::vector<uint32_t>> glyph_indexes;
+            glyph_indexes.reserve(utf8_inputs.size());
+            for (const auto& input : utf8_inputs)
+                glyph_indexes.push_back(utf8_to_glyph_indexes(input));
+
+            const auto transformed =
+                encrypt ? _backend.encrypt_batch(glyph_indexes, tweak) : _backend.decrypt_batch(glyph_indexes, tweak);
+
+            std::vector<std::string> result;
+            result.reserve(transformed.size());
+            for (const auto& indexes : transformed)
+                result.push_back(glyph_indexes_to_utf8(indexes));
+            return result;
+        }
+    }
+
+    // Validates and maps the whole input in one pass of the glyph set's kernels
+    std::vector<uint32_t> utf8_to_glyph_indexes(std::string_view utf8_str) const {
+        const size_t glyph_len = _glyph_set->glyph_size();
+        std::vector<uint32_t> indexes(utf8_str.size() / glyph_len);
+
+        const size_t mapped = _glyph_set->map_glyphs(utf8_str.data(), indexes.size(), indexes.data());
+        if (mapped != indexes.size() || utf8_str.size() % glyph_len != 0)
+            throw std::out_of_range("GlyphFPECipher: glyph not found at byte " + std::to_string(mapped * glyph_len));
+        return indexes;
+    }
+
+    // Indexes come from the cipher and are always below the radix, so glyphs are written without checks
+    std::string glyph_indexes_to_utf8(const std::vector<uint32_t>& indexes) const {
+        std::string result(indexes.size() * _glyph_set->glyph_size(), '\0');
+        _glyph_set->unmap_glyphs(indexes.data(), indexes.size(), result.data());
+        return result;
+    }
+};
+
+// Any BasicGlyphFPECipher behind one type, for containers that mix backends such as the per-block ciphers of
+// UnicodeGlyphCipherIndex. Each call dispatches once on the backend and then runs that backend's inlined loop.
 class GlyphFPECipher {
 public:
+    using Variant = std::variant<
+        BasicGlyphFPECipher<glyph_fpe::FF1>,
+        BasicGlyphFPECipher<glyph_fpe::FF3_1>,
+        BasicGlyphFPECipher<glyph_fpe::Noop>,
+        BasicGlyphFPECipher<glyph_fpe::FF1, CodepointRangeGlyphSet>,
+        BasicGlyphFPECipher<glyph_fpe::FF3_1, CodepointRangeGlyphSet>>;
+
     explicit GlyphFPECipher(
         const IndexedGlyphSet& glyph_set,
         const std::vector<uint8_t>& key,
         const std::vector<uint8_t>& tweak,
-        bool noop = false
+        bool noop = false,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {}
     )
-        : GlyphFPECipher(not_null(&glyph_set), key, tweak, noop)
+        : GlyphFPECipher(not_null(&glyph_set), key, tweak, noop, algorithm, small_domain)
     {}
 
     GlyphFPECipher(
         not_null<const IndexedGlyphSet*> glyph_set,
         const std::vector<uint8_t>& key,
         const std::vector<uint8_t>& tweak,
-        bool noop = false
+        bool noop = false,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {} // FF1 only
     )
-        : _glyph_set(glyph_set)
-        , _noop(noop)
-        , _ff1_cipher(FF1Cipher(key, tweak, glyph_set->size()))
-    {
-        _encode_func = noop ? &GlyphFPECipher::encode_noop : &GlyphFPECipher::encode_ff1;
-        _decode_func = noop ? &GlyphFPECipher::decode_noop : &GlyphFPECipher::decode_ff1;
-    }
-
-    explicit GlyphFPECipher(not_null<const IndexedGlyphSet*> glyph_set)
         : GlyphFPECipher(
-            glyph_set,
-            std::vector<uint8_t>(16, 0x00),  // dummy 128-bit key
-            std::vector<uint8_t>(8, 0x00),   // dummy tweak size (adjust if needed)
-            true
+            glyph_set, noop ? nullptr : std::make_shared<const FPEKeyContext>(key), tweak, noop, algorithm, small_domain
         )
     {}
 
-    GlyphFPECipher(const GlyphFPECipher&) = default;
+    // Builds on a key context shared with other ciphers, so all of them use one copy of the AES round keys. A noop
+    // cipher ignores the key.
+    GlyphFPECipher(
+        not_null<const IndexedGlyphSet*> glyph_set,
+        std::shared_ptr<const FPEKeyContext> key,
+        const std::vector<uint8_t>& tweak,
+        bool noop = false,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {} // FF1 only
+    )
+        : _cipher(make_cipher(glyph_set, std::move(key), tweak, noop, algorithm, small_domain))
+    {}
+
+    // Over a code point range, e.g. a whole Unicode block, with no per-glyph storage
+    GlyphFPECipher(
+        not_null<const CodepointRangeGlyphSet*> glyph_set,
+        std::shared_ptr<const FPEKeyContext> key,
+        const std::vector<uint8_t>& tweak,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {} // FF1 only
+    )
+        : _cipher(make_cipher(glyph_set, std::move(key), tweak, false, algorithm, small_domain))
+    {}
+
+    // Noop cipher
+    explicit GlyphFPECipher(not_null<const IndexedGlyphSet*> glyph_set)
+        : _cipher(std::in_place_type<BasicGlyphFPECipher<glyph_fpe::Noop>>, glyph_set)
+    {}
+
+    template <typename Backend, typename GlyphSet>
+    GlyphFPECipher(BasicGlyphFPECipher<Backend, GlyphSet>&& cipher)
+        : _cipher(std::move(cipher))
+    {}
+
     GlyphFPECipher(GlyphFPECipher&&) noexcept = default;
-    GlyphFPECipher& operator=(const GlyphFPECipher&) = default;
     GlyphFPECipher& operator=(GlyphFPECipher&&) noexcept = default;
     ~GlyphFPECipher() = default;
 
-    const IndexedGlyphSet& glyphs() const noexcept {
-        return *_glyph_set;
+    // The glyph set of a cipher built over an IndexedGlyphSet; throws for one over a code point range
+    const IndexedGlyphSet& glyphs() const {
+        return std::visit([](const auto& cipher) -> const IndexedGlyphSet& {
+            if constexpr (std::is_same_v<std::decay_t<decltype(cipher.glyphs())>, IndexedGlyphSet>)
+                return cipher.glyphs();
+            else
+                throw std::logic_error("GlyphFPECipher: glyph set is a code point range");
+        }, _cipher);
+    }
+
+    // The code point range of a cipher built over one, else null
+    const CodepointRangeGlyphSet* codepoint_range() const noexcept {
+        return std::visit([](const auto& cipher) -> const CodepointRangeGlyphSet* {
+            if constexpr (std::is_same_v<std::decay_t<decltype(cipher.glyphs())>, CodepointRangeGlyphSet>)
+                return &cipher.glyphs();
+            else
+                return nullptr;
+        }, _cipher);
+    }
+
+    size_t glyph_size() const noexcept {
+        return std::visit([](const auto& cipher) { return cipher.glyphs().glyph_size(); }, _cipher);
+    }
+
+    size_t glyph_count() const noexcept {
+        return std::visit([](const auto& cipher) { return cipher.glyphs().size(); }, _cipher);
     }
 
     std::string encrypt(std::string_view utf8_input) const {
-        return (this->*_encode_func)(utf8_input);
+        return std::visit([&](const auto& cipher) { return cipher.encrypt(utf8_input); }, _cipher);
     }
 
     std::string decrypt(std::string_view utf8_input) const {
-        return (this->*_decode_func)(utf8_input);
+        return std::visit([&](const auto& cipher) { return cipher.decrypt(utf8_input); }, _cipher);
     }
 
-    std::string_view getGlyphSetName()const { return _glyph_set->name(); }
+    // Per-call tweak instead of the constructor's, e.g. one tweak per column or tenant
+    std::string encrypt(std::string_view utf8_input, std::span<const uint8_t> tweak) const {
+        return std::visit([&](const auto& cipher) { return cipher.encrypt(utf8_input, tweak); }, _cipher);
+    }
 
-    bool operator==(const GlyphFPECipher& other) const noexcept {
-        // TODO: Do better
-        return this == &other;
+    std::string decrypt(std::string_view utf8_input, std::span<const uint8_t> tweak) const {
+        return std::visit([&](const auto& cipher) { return cipher.decrypt(utf8_input, tweak); }, _cipher);
     }
 
-private:
-    not_null<const IndexedGlyphSet*> _glyph_set;
-    bool _noop;
-    FF1Cipher _ff1_cipher;
+    // Encrypts/decrypts many strings with one batch call on the underlying cipher
+    std::vector<std::string> encrypt_batch(const std::vector<std::string>& utf8_inputs) const {
+        return std::visit([&](const auto& cipher) { return cipher.encrypt_batch(utf8_inputs); }, _cipher);
+    }
 
-    using EncodeDecodeFunc = std::string (GlyphFPECipher::*)(std::string_view) const;
-    EncodeDecodeFunc _encode_func;
-    EncodeDecodeFunc _decode_func;
+    std::vector<std::string> decrypt_batch(const std::vector<std::string>& utf8_inputs) const {
+        return std::visit([&](const auto& cipher) { return cipher.decrypt_batch(utf8_inputs); }, _cipher);
+    }
 
-    std::string encode_noop(const std::string_view utf8_input) const {
-        return std::string(utf8_input);
+    std::vector<std::string> encrypt_batch(
+        const std::vector<std::string>& utf8_inputs, std::span<const uint8_t> tweak
+    ) const {
+        return std::visit([&](const auto& cipher) { return cipher.encrypt_batch(utf8_inputs, tweak); }, _cipher);
     }
 
-    std::string decode_noop(const std::string_view utf8_input) const {
-        return std::string(utf8_input);
+    std::vector<std::string> decrypt_batch(
+        const std::vector<std::string>& utf8_inputs, std::span<const uint8_t> tweak
+    ) const {
+        return std::visit([&](const auto& cipher) { return cipher.decrypt_batch(utf8_inputs, tweak); }, _cipher);
     }
 
-    std::string encode_ff1(const std::string_view utf8_input) const {
-        auto glyph_indexes = utf8_to_glyph_indexes(utf8_input);
-        const auto encrypted_indexes = _ff1_cipher.encrypt(std::move(glyph_indexes));
-        return glyph_indexes_to_utf8(encrypted_indexes);
+    // Encrypts/decrypts glyph indexes in place; see BasicGlyphFPECipher::encrypt_indexes
+    void encrypt_indexes(std::span<uint32_t> indexes, glyph_fpe::Tweak tweak = std::nullopt) const {
+        std::visit([&](const auto& cipher) { cipher.encrypt_indexes(indexes, tweak); }, _cipher);
     }
 
-    std::string decode_ff1(const std::string_view utf8_input) const {
-        auto glyph_indexes = utf8_to_glyph_indexes(utf8_input);
-        const auto decrypted_indexes = _ff1_cipher.decrypt(std::move(glyph_indexes));
-        return glyph_indexes_to_utf8(decrypted_indexes);
+    void decrypt_indexes(std::span<uint32_t> indexes, glyph_fpe::Tweak tweak = std::nullopt) const {
+        std::visit([&](const auto& cipher) { cipher.decrypt_indexes(indexes, tweak); }, _cipher);
     }
 
-    std::vector<unsigned int> utf8_to_glyph_indexes(std::string_view utf8_str) const {
-        std::vector<unsigned int> indexes;
-        indexes.reserve(utf8_str.size());
-        size_t glyph_len = _glyph_set->glyph_size();
+    std::vector<std::vector<uint32_t>> encrypt_indexes_batch(
+        const std::vector<std::vector<uint32_t>>& indexes, glyph_fpe::Tweak tweak = std::nullopt
+    ) const {
+        return std::visit([&](const auto& cipher) { return cipher.encrypt_indexes_batch(indexes, tweak); }, _cipher);
+    }
 
-        size_t pos = 0;
-        while (pos < utf8_str.size()) {
-            std::string_view glyph = utf8_str.substr(pos, glyph_len);
-            indexes.push_back(_glyph_set->to_index(glyph));
-            pos += glyph_len;
-        }
+    std::vector<std::vector<uint32_t>> decrypt_indexes_batch(
+        const std::vector<std::vector<uint32_t>>& indexes, glyph_fpe::Tweak tweak = std::nullopt
+    ) const {
+        return std::visit([&](const auto& cipher) { return cipher.decrypt_indexes_batch(indexes, tweak); }, _cipher);
+    }
 
-        return indexes;
+    // Runs f on the concrete BasicGlyphFPECipher, so a loop over many strings dispatches only once
+    template <typename F>
+    decltype(auto) visit(F&& f) const {
+        return std::visit(std::forward<F>(f), _cipher);
     }
 
-    std::string glyph_indexes_to_utf8(const std::vector<unsigned int>& indexes) const {
-        std::string result;
-        size_t glyph_len = _glyph_set->glyph_size();
-        result.reserve(indexes.size() * glyph_len);
+    std::string_view getGlyphSetName() const {
+        return std::visit([](const auto& cipher) { return cipher.glyphs().name(); }, _cipher);
+    }
 
-        for (unsigned int index : indexes) {
-            std::string_view glyph = _glyph_set->from_index(index);
-            result.append(glyph.data(), glyph.size());
-        }
-        return result;
+    // Noop ciphers report FF1
+    FPEAlgorithm algorithm() const noexcept {
+        return std::visit([](const auto& cipher) { return cipher.backend().algorithm; }, _cipher);
+    }
+
+    bool is_noop() const noexcept {
+        return std::holds_alternative<BasicGlyphFPECipher<glyph_fpe::Noop>>(_cipher);
+    }
+
+    // Memory held by FF1 small-domain tables (see SmallDomainTables)
+    size_t small_domain_table_bytes() const noexcept {
+        return std::visit([](const auto& cipher) { return cipher.backend().small_domain_table_bytes(); }, _cipher);
     }
 
+    bool operator==(const GlyphFPECipher& other) const noexcept {
+        // TODO: Do better
+        return this == &other;
+    }
+
+private:
+    Variant _cipher;
+
+    template <typename GlyphSet>
+    static Variant make_cipher(
+        not_null<const GlyphSet*> glyph_set,
+        std::shared_ptr<const FPEKeyContext> key,
+        const std::vector<uint8_t>& tweak,
+        bool noop,
+        FPEAlgorithm algorithm,
+        SmallDomainTables small_domain
+    ) {
+        using namespace glyph_fpe;
+        if constexpr (std::is_same_v<GlyphSet, IndexedGlyphSet>) {
+            if (noop)
+                return Variant(std::in_place_type<BasicGlyphFPECipher<Noop>>, glyph_set);
+        }
+        if (algorithm == FPEAlgorithm::FF3_1)
+            return Variant(std::in_place_type<BasicGlyphFPECipher<FF3_1, GlyphSet>>, glyph_set, std::move(key), tweak);
+        return Variant(
+            std::in_place_type<BasicGlyphFPECipher<FF1, GlyphSet>>, glyph_set, std::move(key), tweak, small_domain
+        );
+    }
 };
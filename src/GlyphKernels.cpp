@@ -0,0 +1,428 @@
+#include "GlyphKernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GLYPH_KERNELS_X86 1
+#endif
+
+namespace glyph_kernels
+{
+    constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    // Code point of one UTF-8 sequence of the given width, or NOT_FOUND when its lead or continuation bytes are wrong
+    static inline uint32_t decode(const unsigned char* s, const uint32_t width) noexcept
+    {
+        switch (width)
+        {
+        case 1:
+            return s[0];
+        case 2:
+            if ((s[0] & 0xE0) != 0xC0 || (s[1] & 0xC0) != 0x80)
+                return NOT_FOUND;
+            return ((s[0] & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+        case 3:
+            if ((s[0] & 0xF0) != 0xE0 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80)
+                return NOT_FOUND;
+            return ((s[0] & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+        default:
+            if ((s[0] & 0xF8) != 0xF0 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80)
+                return NOT_FOUND;
+            return ((s[0] & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) | ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+        }
+    }
+
+    static inline void encode(const uint32_t cp, const uint32_t width, char* out) noexcept
+    {
+        switch (width)
+        {
+        case 1:
+            out[0] = static_cast<char>(cp);
+            break;
+        case 2:
+            out[0] = static_cast<char>(0xC0 | (cp >> 6));
+            out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        case 3:
+            out[0] = static_cast<char>(0xE0 | (cp >> 12));
+            out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        default:
+            out[0] = static_cast<char>(0xF0 | (cp >> 18));
+            out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        }
+    }
+
+    size_t map_range_scalar(const CodepointRange& range, const char* in, const size_t count, uint32_t* out)
+    {
+        const auto* s = reinterpret_cast<const unsigned char*>(in);
+        for (size_t i = 0; i < count; ++i, s += range.width)
+        {
+            // Overlong forms decode below the range, which never crosses a width boundary
+            const uint32_t offset = decode(s, range.width) - range.first;
+            if (offset >= range.count)
+                return i;
+            out[i] = offset;
+        }
+        return count;
+    }
+
+    void unmap_range_scalar(const CodepointRange& range, const uint32_t* indexes, const size_t count, char* out)
+    {
+        for (size_t i = 0; i < count; ++i, out += range.width)
+            encode(range.first + indexes[i], range.width, out);
+    }
+
+    size_t map_bytes_scalar(const uint32_t* table, const char* in, const size_t count, uint32_t* out)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint32_t index = table[static_cast<unsigned char>(in[i])];
+            if (index == NOT_FOUND)
+                return i;
+            out[i] = index;
+        }
+        return count;
+    }
+
+    void unmap_bytes_scalar(const char* glyphs, const uint32_t* indexes, const size_t count, char* out)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = glyphs[indexes[i]];
+    }
+
+#ifdef GLYPH_KERNELS_X86
+
+    bool has_avx2() noexcept
+    {
+        static const bool supported = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+        }();
+        return supported;
+    }
+
+    // Lanes of a that are at most max, as all-ones
+    __attribute__((target("avx2"))) static inline __m256i within_epu8(const __m256i a, const __m256i max)
+    {
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(a, max), a);
+    }
+
+    __attribute__((target("avx2"))) static inline __m256i within_epu16(const __m256i a, const __m256i max)
+    {
+        return _mm256_cmpeq_epi16(_mm256_min_epu16(a, max), a);
+    }
+
+    __attribute__((target("avx2"))) static inline __m256i within_epu32(const __m256i a, const __m256i max)
+    {
+        return _mm256_cmpeq_epi32(_mm256_min_epu32(a, max), a);
+    }
+
+    // Zero-extends 32 byte indexes to four vectors of eight uint32
+    __attribute__((target("avx2"))) static inline void store_bytes_widened(const __m256i bytes, uint32_t* out)
+    {
+        const __m128i lo = _mm256_castsi256_si128(bytes);
+        const __m128i hi = _mm256_extracti128_si256(bytes, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi32(lo));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16), _mm256_cvtepu8_epi32(hi));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+    }
+
+    // Code points of eight glyphs of width 3 or 4, one per 32-bit lane with the lead byte lowest, or a lane of
+    // all-ones in valid where the UTF-8 structure is wrong
+    __attribute__((target("avx2")))
+    static inline __m256i decode_lanes(const __m256i lanes, const uint32_t width, __m256i& valid)
+    {
+        const __m256i six_bits = _mm256_set1_epi32(0x3F);
+        if (width == 3)
+        {
+            valid = _mm256_cmpeq_epi32(
+                _mm256_and_si256(lanes, _mm256_set1_epi32(0x00C0C0F0)), _mm256_set1_epi32(0x008080E0));
+            return _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_slli_epi32(_mm256_and_si256(lanes, _mm256_set1_epi32(0x0F)), 12),
+                    _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(lanes, 8), six_bits), 6)),
+                _mm256_and_si256(_mm256_srli_epi32(lanes, 16), six_bits));
+        }
+        valid = _mm256_cmpeq_epi32(
+            _mm256_and_si256(lanes, _mm256_set1_epi32(static_cast<int>(0xC0C0C0F8))),
+            _mm256_set1_epi32(static_cast<int>(0x808080F0)));
+        return _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_slli_epi32(_mm256_and_si256(lanes, _mm256_set1_epi32(0x07)), 18),
+                _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(lanes, 8), six_bits), 12)),
+            _mm256_or_si256(
+                _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(lanes, 16), six_bits), 6),
+                _mm256_and_si256(_mm256_srli_epi32(lanes, 24), six_bits)));
+    }
+
+    // Each iteration reads 32 bytes: 32 glyphs of one byte, 16 of two or 8 of four. Three-byte glyphs go 8 at a time
+    // from two 12-byte halves. An iteration holding a glyph outside the range hands over to the scalar loop, which
+    // finds its position.
+    __attribute__((target("avx2")))
+    size_t map_range_avx2(const CodepointRange& range, const char* in, const size_t count, uint32_t* out)
+    {
+        size_t i = 0;
+        switch (range.width)
+        {
+        case 1:
+        {
+            const __m256i first = _mm256_set1_epi8(static_cast<char>(range.first));
+            const __m256i max = _mm256_set1_epi8(static_cast<char>(range.count - 1));
+            for (; i + 32 <= count; i += 32)
+            {
+                const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+                const __m256i offsets = _mm256_sub_epi8(bytes, first);
+                if (_mm256_movemask_epi8(within_epu8(offsets, max)) != -1)
+                    break;
+                store_bytes_widened(offsets, out + i);
+            }
+            break;
+        }
+        case 2:
+        {
+            // Lead byte in the low half of each 16-bit lane
+            const __m256i first = _mm256_set1_epi16(static_cast<short>(range.first));
+            const __m256i max = _mm256_set1_epi16(static_cast<short>(range.count - 1));
+            const __m256i pattern_mask = _mm256_set1_epi16(static_cast<short>(0xC0E0));
+            const __m256i pattern = _mm256_set1_epi16(static_cast<short>(0x80C0));
+            for (; i + 16 <= count; i += 16)
+            {
+                const __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+                const __m256i codepoints = _mm256_or_si256(
+                    _mm256_slli_epi16(_mm256_and_si256(lanes, _mm256_set1_epi16(0x1F)), 6),
+                    _mm256_and_si256(_mm256_srli_epi16(lanes, 8), _mm256_set1_epi16(0x3F)));
+                const __m256i offsets = _mm256_sub_epi16(codepoints, first);
+                const __m256i valid = _mm256_and_si256(
+                    _mm256_cmpeq_epi16(_mm256_and_si256(lanes, pattern_mask), pattern), within_epu16(offsets, max));
+                if (_mm256_movemask_epi8(valid) != -1)
+                    break;
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                                    _mm256_cvtepu16_epi32(_mm256_castsi256_si128(offsets)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 8),
+                                    _mm256_cvtepu16_epi32(_mm256_extracti128_si256(offsets, 1)));
+            }
+            break;
+        }
+        default:
+        {
+            const __m256i first = _mm256_set1_epi32(static_cast<int>(range.first));
+            const __m256i max = _mm256_set1_epi32(static_cast<int>(range.count - 1));
+            // Spreads four 3-byte glyphs of each 128-bit half over four 32-bit lanes
+            const __m256i spread = _mm256_setr_epi8(
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            // The second 16-byte load of a 3-byte iteration ends four bytes past its glyphs
+            const size_t step_bytes = range.width == 3 ? 28 : 32;
+            for (; (count - i) * range.width >= step_bytes && count - i >= 8; i += 8)
+            {
+                const char* glyphs = in + i * range.width;
+                __m256i lanes;
+                if (range.width == 3)
+                {
+                    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(glyphs));
+                    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(glyphs + 12));
+                    lanes = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), spread);
+                }
+                else
+                {
+                    lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(glyphs));
+                }
+                __m256i well_formed;
+                const __m256i offsets = _mm256_sub_epi32(decode_lanes(lanes, range.width, well_formed), first);
+                const __m256i valid = _mm256_and_si256(well_formed, within_epu32(offsets, max));
+                if (_mm256_movemask_epi8(valid) != -1)
+                    break;
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), offsets);
+            }
+            break;
+        }
+        }
+        return i + map_range_scalar(range, in + i * range.width, count - i, out + i);
+    }
+
+    // Eight glyphs per iteration, built one per 32-bit lane and packed together with a byte shuffle
+    __attribute__((target("avx2")))
+    void unmap_range_avx2(const CodepointRange& range, const uint32_t* indexes, const size_t count, char* out)
+    {
+        const __m256i first = _mm256_set1_epi32(static_cast<int>(range.first));
+        const __m256i six_bits = _mm256_set1_epi32(0x3F);
+        const __m256i continuation = _mm256_set1_epi32(0x80);
+        // Collects the low width bytes of each lane at the start of its 128-bit half
+        const __m256i pack = range.width == 1
+            ? _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                               0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)
+            : range.width == 2
+            ? _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+                               0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1)
+            : _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                               0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        // Joins the packed bytes of both halves
+        const __m256i join = range.width == 1 ? _mm256_setr_epi32(0, 4, 1, 5, 2, 3, 6, 7)
+                                              : _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+
+        size_t i = 0;
+        // A 3-byte iteration stores 28 bytes for its 24; the last four are rewritten by the next glyphs
+        const size_t step_bytes = range.width == 3 ? 28 : 8 * range.width;
+        for (; i + 8 <= count && (count - i) * range.width >= step_bytes; i += 8)
+        {
+            const __m256i cp =
+                _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(indexes + i)), first);
+            char* glyphs = out + i * range.width;
+            switch (range.width)
+            {
+            case 1:
+            {
+                const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(cp, pack), join);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(glyphs), _mm256_castsi256_si128(packed));
+                break;
+            }
+            case 2:
+            {
+                const __m256i lanes = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_set1_epi32(0xC0), _mm256_srli_epi32(cp, 6)),
+                    _mm256_slli_epi32(_mm256_or_si256(continuation, _mm256_and_si256(cp, six_bits)), 8));
+                const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(lanes, pack), join);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(glyphs), _mm256_castsi256_si128(packed));
+                break;
+            }
+            case 3:
+            {
+                const __m256i lanes = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_set1_epi32(0xE0), _mm256_srli_epi32(cp, 12)),
+                    _mm256_or_si256(
+                        _mm256_slli_epi32(
+                            _mm256_or_si256(continuation, _mm256_and_si256(_mm256_srli_epi32(cp, 6), six_bits)), 8),
+                        _mm256_slli_epi32(_mm256_or_si256(continuation, _mm256_and_si256(cp, six_bits)), 16)));
+                const __m256i packed = _mm256_shuffle_epi8(lanes, pack);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(glyphs), _mm256_castsi256_si128(packed));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(glyphs + 12), _mm256_extracti128_si256(packed, 1));
+                break;
+            }
+            default:
+            {
+                const __m256i lanes = _mm256_or_si256(
+                    _mm256_or_si256(
+                        _mm256_or_si256(_mm256_set1_epi32(0xF0), _mm256_srli_epi32(cp, 18)),
+                        _mm256_slli_epi32(
+                            _mm256_or_si256(continuation, _mm256_and_si256(_mm256_srli_epi32(cp, 12), six_bits)), 8)),
+                    _mm256_or_si256(
+                        _mm256_slli_epi32(
+                            _mm256_or_si256(continuation, _mm256_and_si256(_mm256_srli_epi32(cp, 6), six_bits)), 16),
+                        _mm256_slli_epi32(_mm256_or_si256(continuation, _mm256_and_si256(cp, six_bits)), 24)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(glyphs), lanes);
+                break;
+            }
+            }
+        }
+        unmap_range_scalar(range, indexes + i, count - i, out + i * range.width);
+    }
+
+    // 32 bytes per iteration, looked up with four 8-lane gathers from the byte table
+    __attribute__((target("avx2")))
+    size_t map_bytes_avx2(const uint32_t* table, const char* in, const size_t count, uint32_t* out)
+    {
+        const auto* base = reinterpret_cast<const int*>(table);
+        const __m256i not_found = _mm256_set1_epi32(-1);
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i indexes[4];
+            __m256i missing = _mm256_setzero_si256();
+            for (int part = 0; part < 4; ++part)
+            {
+                const __m256i bytes =
+                    _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i + 8 * part)));
+                indexes[part] = _mm256_i32gather_epi32(base, bytes, 4);
+                missing = _mm256_or_si256(missing, _mm256_cmpeq_epi32(indexes[part], not_found));
+            }
+            if (!_mm256_testz_si256(missing, missing))
+                break;
+            for (int part = 0; part < 4; ++part)
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 8 * part), indexes[part]);
+        }
+        return i + map_bytes_scalar(table, in + i, count - i, out + i);
+    }
+
+    // Gathers four bytes at each glyph and keeps the first, hence the padding the glyphs need
+    __attribute__((target("avx2")))
+    void unmap_bytes_avx2(const char* glyphs, const uint32_t* indexes, const size_t count, char* out)
+    {
+        const auto* base = reinterpret_cast<const int*>(glyphs);
+        const __m256i pack = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                              0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i join = _mm256_setr_epi32(0, 4, 1, 5, 2, 3, 6, 7);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i offsets = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indexes + i));
+            const __m256i words = _mm256_i32gather_epi32(base, offsets, 1);
+            const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, pack), join);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm256_castsi256_si128(packed));
+        }
+        unmap_bytes_scalar(glyphs, indexes + i, count - i, out + i);
+    }
+
+#else
+
+    bool has_avx2() noexcept
+    {
+        return false;
+    }
+
+    size_t map_range_avx2(const CodepointRange& range, const char* in, const size_t count, uint32_t* out)
+    {
+        return map_range_scalar(range, in, count, out);
+    }
+
+    void unmap_range_avx2(const CodepointRange& range, const uint32_t* indexes, const size_t count, char* out)
+    {
+        unmap_range_scalar(range, indexes, count, out);
+    }
+
+    size_t map_bytes_avx2(const uint32_t* table, const char* in, const size_t count, uint32_t* out)
+    {
+        return map_bytes_scalar(table, in, count, out);
+    }
+
+    void unmap_bytes_avx2(const char* glyphs, const uint32_t* indexes, const size_t count, char* out)
+    {
+        unmap_bytes_scalar(glyphs, indexes, count, out);
+    }
+
+#endif
+
+    size_t map_range(const CodepointRange& range, const char* in, const size_t count, uint32_t* out)
+    {
+        static const bool use_avx2 = has_avx2();
+        return use_avx2 ? map_range_avx2(range, in, count, out) : map_range_scalar(range, in, count, out);
+    }
+
+    void unmap_range(const CodepointRange& range, const uint32_t* indexes, const size_t count, char* out)
+    {
+        static const bool use_avx2 = has_avx2();
+        if (use_avx2)
+            unmap_range_avx2(range, indexes, count, out);
+        else
+            unmap_range_scalar(range, indexes, count, out);
+    }
+
+    size_t map_bytes(const uint32_t* table, const char* in, const size_t count, uint32_t* out)
+    {
+        static const bool use_avx2 = has_avx2();
+        return use_avx2 ? map_bytes_avx2(table, in, count, out) : map_bytes_scalar(table, in, count, out);
+    }
+
+    void unmap_bytes(const char* glyphs, const uint32_t* indexes, const size_t count, char* out)
+    {
+        static const bool use_avx2 = has_avx2();
+        if (use_avx2)
+            unmap_bytes_avx2(glyphs, indexes, count, out);
+        else
+            unmap_bytes_scalar(glyphs, indexes, count, out);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk conversion between runs of fixed-width UTF-8 glyphs and glyph indexes, the first and last steps of every glyph
+// cipher call.
+//
+// Each entry point picks an implementation once, from CPUID: AVX2 kernels that handle 8 to 32 glyphs per iteration,
+// or the scalar loops otherwise. Both give identical results. Mapping stops at the first glyph outside the set and
+// returns its position, so callers can report it; unmapping trusts its indexes, which come from a cipher.
+namespace glyph_kernels
+{
+    // A set whose glyph with index i is code point first + i, every glyph width bytes long. The range must not
+    // contain surrogates.
+    struct CodepointRange
+    {
+        uint32_t first;
+        uint32_t count;
+        uint32_t width;
+    };
+
+    // Maps count glyphs (count * width bytes) to indexes. Returns count when all of them are in the range, else the
+    // position of the first that is not; out[0, position) holds the indexes before it.
+    size_t map_range(const CodepointRange& range, const char* in, size_t count, uint32_t* out);
+
+    // Writes the glyphs of count indexes, each below range.count
+    void unmap_range(const CodepointRange& range, const uint32_t* indexes, size_t count, char* out);
+
+    // 1-byte sets of any shape: table[byte] is the byte's index or UINT32_MAX, and glyphs[index] the byte of an index.
+    // glyphs must be readable for three bytes past its last glyph.
+    size_t map_bytes(const uint32_t* table, const char* in, size_t count, uint32_t* out);
+    void unmap_bytes(const char* glyphs, const uint32_t* indexes, size_t count, char* out);
+
+    // True when this CPU runs the AVX2 kernels
+    bool has_avx2() noexcept;
+
+    // Explicit variants for tests and benchmarks. Only call the _avx2 ones when has_avx2().
+    size_t map_range_scalar(const CodepointRange& range, const char* in, size_t count, uint32_t* out);
+    size_t map_range_avx2(const CodepointRange& range, const char* in, size_t count, uint32_t* out);
+    void unmap_range_scalar(const CodepointRange& range, const uint32_t* indexes, size_t count, char* out);
+    void unmap_range_avx2(const CodepointRange& range, const uint32_t* indexes, size_t count, char* out);
+    size_t map_bytes_scalar(const uint32_t* table, const char* in, size_t count, uint32_t* out);
+    size_t map_bytes_avx2(const uint32_t* table, const char* in, size_t count, uint32_t* out);
+    void unmap_bytes_scalar(const char* glyphs, const uint32_t* indexes, size_t count, char* out);
+    void unmap_bytes_avx2(const char* glyphs, const uint32_t* indexes, size_t count, char* out);
+}
@@ -0,0 +1,42 @@
+#include "GlyphPerfectHash.hpp"
+#include <vector>
+#include <BooPHF.h>
+
+namespace {
+    using Hasher = boomphf::SingleHashFunctor<uint64_t>;
+    using Mphf = boomphf::mphf<uint64_t, Hasher>;
+
+    // BBHash's default: bit arrays twice the size of each level's keys, trading some memory for faster builds and
+    // lookups that mostly stop at the first level
+    constexpr double GAMMA = 2.0;
+}
+
+struct GlyphPerfectHash::Impl
+{
+    explicit Impl(const std::vector<uint64_t>& keys)
+        : mphf(keys.size(), keys, 1, GAMMA, false, false)
+    {
+    }
+
+    Mphf mphf;
+};
+
+GlyphPerfectHash::GlyphPerfectHash(const std::span<const uint64_t> keys)
+    : _size(keys.size())
+{
+    _impl = std::make_unique<Impl>(std::vector<uint64_t>(keys.begin(), keys.end()));
+}
+
+GlyphPerfectHash::~GlyphPerfectHash() = default;
+
+uint64_t GlyphPerfectHash::lookup(const uint64_t key) const noexcept
+{
+    // BBHash's lookup is not const-qualified but does not modify the function
+    const uint64_t slot = _impl->mphf.lookup(key);
+    return slot < _size ? slot : NOT_FOUND;
+}
+
+uint64_t GlyphPerfectHash::bit_size() const noexcept
+{
+    return _impl->mphf.totalBitSize();
+}
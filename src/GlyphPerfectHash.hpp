@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+// Minimal perfect hash (BBHash) over distinct 64-bit keys: every key of the build set maps to its own slot in
+// [0, size()). Keys outside the set land on an arbitrary slot or on NOT_FOUND, so callers confirm hits against their
+// own copy of the key. Immutable once built and safe to share across threads.
+class GlyphPerfectHash
+{
+  public:
+    static constexpr uint64_t NOT_FOUND = UINT64_MAX;
+
+    explicit GlyphPerfectHash(std::span<const uint64_t> keys);
+    ~GlyphPerfectHash();
+
+    GlyphPerfectHash(const GlyphPerfectHash&) = delete;
+    GlyphPerfectHash& operator=(const GlyphPerfectHash&) = delete;
+
+    uint64_t lookup(uint64_t key) const noexcept;
+    size_t size() const noexcept { return _size; }
+
+    // Bits held by the hash function itself, excluding whatever the caller stores per slot
+    uint64_t bit_size() const noexcept;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+    size_t _size = 0;
+};
@@ -1,4 +1,13 @@
 #pragma once
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <unordered_map>
 #include <string>
@@ -7,8 +16,85 @@
 #include <iostream>
 #include <stdexcept>
 #include <immintrin.h>  // For AVX2 SIMD
+#include "GlyphKernels.hpp"
+#include "GlyphPerfectHash.hpp"
+
+// How IndexedGlyphSet finds the index of a glyph, chosen at construction from the shape of the set
+enum class GlyphIndexStrategy {
+    ByteTable,       // 1-byte glyphs: a 256-entry table indexed by the byte
+    CodepointOffset, // dense code point range: a table indexed by code point minus the lowest one
+    PerfectHash,     // large sparse sets: BBHash minimal perfect hash over the glyph bytes
+    Hash             // anything else: hash map over the glyph bytes
+};
+
+// Read-only view over glyphs laid out back to back with a fixed stride; element i is the glyph with index i
+class GlyphView
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::string_view;
+        using pointer = void;
+
+        iterator() = default;
+        iterator(const char* glyph, const size_t stride) : _glyph(glyph), _stride(stride) {}
+
+        std::string_view operator*() const noexcept { return {_glyph, _stride}; }
+        std::string_view operator[](const difference_type n) const noexcept { return *(*this + n); }
+
+        iterator& operator++() noexcept { _glyph += _stride; return *this; }
+        iterator operator++(int) noexcept { iterator old = *this; ++*this; return old; }
+        iterator& operator--() noexcept { _glyph -= _stride; return *this; }
+        iterator operator--(int) noexcept { iterator old = *this; --*this; return old; }
+        iterator& operator+=(const difference_type n) noexcept
+        {
+            _glyph += n * static_cast<difference_type>(_stride);
+            return *this;
+        }
+        iterator& operator-=(const difference_type n) noexcept { return *this += -n; }
+
+        friend iterator operator+(iterator it, const difference_type n) noexcept { return it += n; }
+        friend iterator operator+(const difference_type n, iterator it) noexcept { return it += n; }
+        friend iterator operator-(iterator it, const difference_type n) noexcept { return it -= n; }
+        friend difference_type operator-(const iterator& a, const iterator& b) noexcept
+        {
+            return a._stride == 0 ? 0 : (a._glyph - b._glyph) / static_cast<difference_type>(a._stride);
+        }
+
+        friend bool operator==(const iterator& a, const iterator& b) noexcept { return a._glyph == b._glyph; }
+        friend std::strong_ordering operator<=>(const iterator& a, const iterator& b) noexcept
+        {
+            return std::compare_three_way{}(a._glyph, b._glyph);
+        }
+
+    private:
+        const char* _glyph = nullptr;
+        size_t _stride = 0;
+    };
+
+    GlyphView(const char* data, const size_t stride, const size_t count) noexcept
+        : _data(data), _stride(stride), _count(count)
+    {}
+
+    size_t size() const noexcept { return _count; }
+    bool empty() const noexcept { return _count == 0; }
+    std::string_view operator[](const size_t index) const noexcept { return {_data + index * _stride, _stride}; }
+
+    iterator begin() const noexcept { return {_data, _stride}; }
+    iterator end() const noexcept { return {_data + _count * _stride, _stride}; }
+
+private:
+    const char* _data;
+    size_t _stride;
+    size_t _count;
+};
 
-// TODO: performance can be better.
+// Sorted, fixed-width set of UTF-8 glyphs, numbered by position. Lookups never allocate; find_index() returns
+// NOT_FOUND instead of throwing, for hot loops that validate on their own.
 class IndexedGlyphSet
 {
     static int utf8CharLen(unsigned char c) {
@@ -19,12 +105,17 @@ class IndexedGlyphSet
         throw std::runtime_error("Invalid UTF-8 encoding");
     }
 
+    // Throws unless utf8str is well-formed UTF-8 with every character the same width: no stray or missing
+    // continuation bytes, overlong forms, surrogates or code points past U+10FFFF. Sorted, such glyphs are in code
+    // point order, which _build_index relies on.
     static void verifyUniformUtf8CharWidth(const std::string& utf8str)
     {
+        static constexpr uint32_t min_codepoint[] = {0, 0, 0x80, 0x800, 0x10000};
         int expectedLen = -1;
         for (size_t i = 0; i < utf8str.size();)
         {
-            int charLen = utf8CharLen(static_cast<unsigned char>(utf8str[i]));
+            const auto lead = static_cast<unsigned char>(utf8str[i]);
+            int charLen = utf8CharLen(lead);
 
             if (expectedLen == -1)
                 expectedLen = charLen;
@@ -32,6 +123,20 @@ class IndexedGlyphSet
             if (charLen != expectedLen)
                 throw std::runtime_error("Inconsistent UTF-8 character widths");
 
+            if (utf8str.size() - i < static_cast<size_t>(charLen))
+                throw std::runtime_error("Truncated UTF-8 character");
+
+            uint32_t cp = charLen == 1 ? lead : lead & (0x7Fu >> charLen);
+            for (int k = 1; k < charLen; ++k)
+            {
+                const auto c = static_cast<unsigned char>(utf8str[i + k]);
+                if ((c & 0xC0) != 0x80)
+                    throw std::runtime_error("Invalid UTF-8 continuation byte");
+                cp = (cp << 6) | (c & 0x3Fu);
+            }
+            if (cp < min_codepoint[charLen] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+                throw std::runtime_error("Invalid UTF-8 encoding");
+
             i += charLen;
         }
     }
@@ -39,10 +144,11 @@ class IndexedGlyphSet
     void _check_for_duplicates() const
     {
         // Check duplicates by comparing adjacent after sort
-        for (size_t i = 1; i < _glyphs.size(); ++i) {
-            if (_glyphs[i] == _glyphs[i - 1]) {
+        const GlyphView all = glyphs();
+        for (size_t i = 1; i < all.size(); ++i) {
+            if (all[i] == all[i - 1]) {
                 // Format glyph bytes as hex string for clarity
-                const auto& dup = _glyphs[i];
+                const std::string_view dup = all[i];
                 std::string hex_bytes;
                 for (unsigned char c : dup)
                 {
@@ -69,8 +175,13 @@ class IndexedGlyphSet
 
 public:
     // Construct from a flat UTF-8 string of concatenated glyphs,
-    // all glyphs must be the same byte length (inferred from first glyph)
-    explicit IndexedGlyphSet(std::string&& name, const std::string& flat_glyphs)
+    // all glyphs must be the same byte length (inferred from first glyph).
+    // The lookup strategy is picked from the set unless one is forced, e.g. to compare them.
+    explicit IndexedGlyphSet(
+        std::string&& name,
+        const std::string& flat_glyphs,
+        std::optional<GlyphIndexStrategy> strategy = std::nullopt
+    )
         : _glyph_size(get_glyph_size(flat_glyphs))
         , _name(std::move(name))
     {
@@ -85,20 +196,20 @@ public:
 
         verifyUniformUtf8CharWidth(flat_glyphs);
 
-        const size_t num_glyphs = flat_glyphs.size() / _glyph_size;
-        _glyphs.reserve(num_glyphs);
-
-        for (size_t i = 0; i < num_glyphs; ++i)
-            _glyphs.emplace_back(&flat_glyphs[i * _glyph_size], _glyph_size);
-
-        std::ranges::sort(_glyphs);
+        _count = flat_glyphs.size() / _glyph_size;
+        std::vector<std::string_view> sorted;
+        sorted.reserve(_count);
+        for (size_t i = 0; i < _count; ++i)
+            sorted.emplace_back(&flat_glyphs[i * _glyph_size], _glyph_size);
+        std::ranges::sort(sorted);
 
-        glyph_to_index_.clear();
-        for (unsigned i = 0; i < _glyphs.size(); ++i) {
-            glyph_to_index_[_glyphs[i]] = i;
-        }
+        _data.reserve(flat_glyphs.size() + GATHER_PADDING);
+        for (const auto glyph : sorted)
+            _data.insert(_data.end(), glyph.begin(), glyph.end());
+        _data.resize(_data.size() + GATHER_PADDING);
 
         _check_for_duplicates();
+        _build_index(strategy);
     }
 
     ~IndexedGlyphSet() = default;
@@ -109,41 +220,120 @@ public:
     IndexedGlyphSet(IndexedGlyphSet&& other) noexcept = default;
     IndexedGlyphSet& operator=(IndexedGlyphSet&& other) noexcept = delete;
 
-    std::vector<std::string> glyphs() const noexcept { return _glyphs; }
-    //const char* data() const noexcept { return _glyphs.c_str(); }
+    GlyphView glyphs() const noexcept { return {_data.data(), _glyph_size, _count}; }
+    // All glyphs back to back in index order, glyph_size() bytes each
+    const char* data() const noexcept { return _data.data(); }
     size_t glyph_size() const noexcept { return _glyph_size; }
-    size_t size() const noexcept { return _glyphs.size(); }
+    size_t size() const noexcept { return _count; }
     std::string_view name() const noexcept { return _name; }
 
-    unsigned to_index(const std::string_view glyph) const
+    static constexpr unsigned NOT_FOUND = std::numeric_limits<unsigned>::max();
+
+    // Index of glyph, or NOT_FOUND when it is not in the set (including glyphs of the wrong width)
+    unsigned find_index(const std::string_view glyph) const noexcept
     {
+        if (glyph.size() != _glyph_size)
+            return NOT_FOUND;
+
+        switch (_strategy)
+        {
+        case GlyphIndexStrategy::ByteTable:
+            return _dense_index[static_cast<unsigned char>(glyph[0])];
+        case GlyphIndexStrategy::CodepointOffset:
+        {
+            // Malformed bytes can decode to a code point in range, so the hit is confirmed against the glyph itself
+            const uint32_t offset = decode_fixed_width(glyph) - _first_codepoint;
+            if (offset >= _dense_index.size())
+                return NOT_FOUND;
+            const unsigned index = _dense_index[offset];
+            if (index == NOT_FOUND || std::memcmp(_data.data() + index * _glyph_size, glyph.data(), _glyph_size) != 0)
+                return NOT_FOUND;
+            return index;
+        }
+        case GlyphIndexStrategy::PerfectHash:
+        {
+            const uint64_t slot = _perfect_hash->lookup(pack(glyph));
+            if (slot == GlyphPerfectHash::NOT_FOUND)
+                return NOT_FOUND;
+            const unsigned index = _dense_index[slot];
+            if (std::memcmp(_data.data() + index * _glyph_size, glyph.data(), _glyph_size) != 0)
+                return NOT_FOUND;
+            return index;
+        }
+        case GlyphIndexStrategy::Hash:
+            break;
+        }
         const auto it = glyph_to_index_.find(glyph);
-        if (it == glyph_to_index_.end())
+        return it == glyph_to_index_.end() ? NOT_FOUND : it->second;
+    }
+
+    unsigned to_index(const std::string_view glyph) const
+    {
+        const unsigned index = find_index(glyph);
+        if (index == NOT_FOUND)
             throw std::out_of_range("IndexedGlyphSet: glyph not found");
-        return it->second;
+        return index;
     }
 
     std::string_view from_index(const unsigned index) const
     {
-        if (index >= _glyphs.size())
+        if (index >= _count)
             throw std::out_of_range("IndexedGlyphSet: index out of range");
-        return _glyphs[index];
+        return {_data.data() + size_t{index} * _glyph_size, _glyph_size};
+    }
+
+    // Writes the glyph_size() bytes of an index below size() to out
+    void copy_glyph(const unsigned index, char* out) const noexcept
+    {
+        std::memcpy(out, _data.data() + size_t{index} * _glyph_size, _glyph_size);
     }
 
     bool contains(const std::string_view glyph) const
     {
-        return glyph_to_index_.contains(glyph);
+        return find_index(glyph) != NOT_FOUND;
+    }
+
+    // Maps count glyphs read back to back from in, returning count or the position of the first glyph not in the
+    // set. Contiguous code point ranges and 1-byte sets run the vector kernels of glyph_kernels.
+    size_t map_glyphs(const char* in, const size_t count, uint32_t* out) const noexcept
+    {
+        if (_range)
+            return glyph_kernels::map_range(*_range, in, count, out);
+        if (_strategy == GlyphIndexStrategy::ByteTable)
+            return glyph_kernels::map_bytes(_dense_index.data(), in, count, out);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const unsigned index = find_index({in + i * _glyph_size, _glyph_size});
+            if (index == NOT_FOUND)
+                return i;
+            out[i] = index;
+        }
+        return count;
+    }
+
+    // Writes the glyphs of count indexes, each below size(), back to back to out
+    void unmap_glyphs(const uint32_t* indexes, const size_t count, char* out) const noexcept
+    {
+        if (_range)
+            glyph_kernels::unmap_range(*_range, indexes, count, out);
+        else if (_glyph_size == 1)
+            glyph_kernels::unmap_bytes(_data.data(), indexes, count, out);
+        else
+            for (size_t i = 0; i < count; ++i)
+                copy_glyph(indexes[i], out + i * _glyph_size);
     }
 
-    auto begin() const { return _glyphs.begin(); }
-    auto end() const { return _glyphs.end(); }
+    GlyphIndexStrategy index_strategy() const noexcept { return _strategy; }
+
+    auto begin() const { return glyphs().begin(); }
+    auto end() const { return glyphs().end(); }
 
     // --- Added SIMD glyph index validation method ---
     bool validateGlyphIndexesSIMD(const unsigned* indexes, size_t count) const
     {
-        if (_glyphs.empty()) return count == 0;
+        if (_count == 0) return count == 0;
 
-        const auto maxValid = static_cast<unsigned>(_glyphs.size() - 1);
+        const auto maxValid = static_cast<unsigned>(_count - 1);
 
 #ifdef __AVX2__
         size_t i = 0;
@@ -171,11 +361,122 @@ public:
 
 private:
     const size_t _glyph_size;
-    //const std::string _glyphs;  // owns all glyph data
     const std::string _name;
 
-    std::vector<std::string> _glyphs;  // index → glyph (view into backing_)
-    std::unordered_map<std::string_view, unsigned> glyph_to_index_;  // glyph → index
+    // Every glyph back to back in sorted order, _glyph_size bytes each, then GATHER_PADDING zero bytes. A vector
+    // rather than a string so that moving the set never moves the bytes the hash map's keys point at.
+    std::vector<char> _data;
+    size_t _count = 0;
+
+    GlyphIndexStrategy _strategy = GlyphIndexStrategy::Hash;
+    std::vector<unsigned> _dense_index;  // ByteTable, CodepointOffset, PerfectHash: slot → index or NOT_FOUND
+    uint32_t _first_codepoint = 0;       // CodepointOffset: code point of slot 0
+    std::unique_ptr<const GlyphPerfectHash> _perfect_hash;          // PerfectHash: glyph → slot
+    std::unordered_map<std::string_view, unsigned> glyph_to_index_; // Hash: glyph → index
+    std::optional<glyph_kernels::CodepointRange> _range; // set when index i is code point _first_codepoint + i
+
+    // The byte kernels gather four bytes at a glyph to load one
+    static constexpr size_t GATHER_PADDING = 3;
+
+    // A code point table may hold up to this many slots per glyph before a hash is the better deal
+    static constexpr size_t MAX_SLOTS_PER_GLYPH = 4;
+
+    // Sparse sets of at least this many glyphs use the perfect hash; below it the hash map's buckets are all cached
+    static constexpr size_t MIN_PERFECT_HASH_GLYPHS = 256;
+
+    // Glyph bytes as an integer key, one byte per lane; glyphs are at most four bytes
+    static uint64_t pack(const std::string_view glyph) noexcept
+    {
+        uint32_t key = 0;
+        std::memcpy(&key, glyph.data(), glyph.size());
+        return key;
+    }
+
+    // Code point of a well-formed glyph of the set's width. Bits of malformed input end up somewhere in the result,
+    // which callers rule out by comparing bytes.
+    uint32_t decode_fixed_width(const std::string_view glyph) const noexcept
+    {
+        const auto* s = reinterpret_cast<const unsigned char*>(glyph.data());
+        switch (_glyph_size)
+        {
+        case 1: return s[0];
+        case 2: return ((s[0] & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+        case 3: return ((s[0] & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+        default: return ((s[0] & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) | ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+        }
+    }
+
+    void _build_index(const std::optional<GlyphIndexStrategy> forced)
+    {
+        if (_glyph_size == 1 && (!forced || forced == GlyphIndexStrategy::ByteTable))
+        {
+            _strategy = GlyphIndexStrategy::ByteTable;
+            _dense_index.assign(256, NOT_FOUND);
+            for (unsigned i = 0; i < _count; ++i)
+                _dense_index[static_cast<unsigned char>(_data[i])] = i;
+            const auto first = static_cast<unsigned char>(_data[0]);
+            if (static_cast<unsigned char>(_data[_count - 1]) - first + 1u == _count)
+                _range = glyph_kernels::CodepointRange{first, static_cast<uint32_t>(_count), 1};
+            return;
+        }
+        if (forced == GlyphIndexStrategy::ByteTable)
+            throw std::invalid_argument("IndexedGlyphSet: byte table needs 1-byte glyphs");
+
+        // Sorted UTF-8 of one width is sorted by code point, so the range runs from the first glyph to the last
+        const GlyphView all = glyphs();
+        const uint32_t first = decode_fixed_width(all[0]);
+        const uint32_t last = std::max(decode_fixed_width(all[_count - 1]), first);
+        const size_t span = size_t{last} - first + 1;
+        if ((!forced && span <= MAX_SLOTS_PER_GLYPH * _count) || forced == GlyphIndexStrategy::CodepointOffset)
+        {
+            _dense_index.assign(span, NOT_FOUND);
+            bool distinct = true;
+            for (unsigned i = 0; i < _count && distinct; ++i)
+            {
+                // The constructor only lets well-formed glyphs in, but should one slip past, a code point outside the
+                // span or shared with another glyph sends the set to a hash rather than out of bounds
+                const uint32_t offset = decode_fixed_width(all[i]) - first;
+                distinct = offset < span && _dense_index[offset] == NOT_FOUND;
+                if (distinct)
+                    _dense_index[offset] = i;
+            }
+            if (distinct)
+            {
+                _strategy = GlyphIndexStrategy::CodepointOffset;
+                _first_codepoint = first;
+                if (span == _count)
+                {
+                    // The kernels only accept well-formed UTF-8, so the set must map onto itself
+                    const glyph_kernels::CodepointRange range{
+                        first, static_cast<uint32_t>(_count), static_cast<uint32_t>(_glyph_size)};
+                    std::vector<uint32_t> indexes(_count);
+                    if (glyph_kernels::map_range_scalar(range, _data.data(), _count, indexes.data()) == _count)
+                        _range = range;
+                }
+                return;
+            }
+            _dense_index.clear();
+            if (forced)
+                throw std::invalid_argument("IndexedGlyphSet: code point table needs well-formed glyphs");
+        }
+
+        if ((!forced && _count >= MIN_PERFECT_HASH_GLYPHS) || forced == GlyphIndexStrategy::PerfectHash)
+        {
+            std::vector<uint64_t> keys(_count);
+            for (unsigned i = 0; i < _count; ++i)
+                keys[i] = pack(all[i]);
+            _perfect_hash = std::make_unique<const GlyphPerfectHash>(keys);
+            _dense_index.assign(_count, NOT_FOUND);
+            for (unsigned i = 0; i < _count; ++i)
+                _dense_index[_perfect_hash->lookup(keys[i])] = i;
+            _strategy = GlyphIndexStrategy::PerfectHash;
+            return;
+        }
+
+        _strategy = GlyphIndexStrategy::Hash;
+        for (unsigned i = 0; i < _count; ++i)
+            glyph_to_index_[all[i]] = i;
+    }
 
     static size_t get_glyph_size(const std::string& s)
     {
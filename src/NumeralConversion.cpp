@@ -0,0 +1,96 @@
+#include "NumeralConversion.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NUMERAL_CONVERSION_X86 1
+#endif
+
+namespace numeral_conversion
+{
+    // Below two groups of four the scalar loop is as fast as the AVX2 kernel
+    constexpr size_t AVX2_MIN_COUNT = 8;
+
+    void str_radix_scalar(uint64_t value, uint32_t* digits, size_t count, const uint32_t radix)
+    {
+        while (count-- > 0)
+        {
+            digits[count] = static_cast<uint32_t>(value % radix);
+            value /= radix;
+        }
+    }
+
+#ifdef NUMERAL_CONVERSION_X86
+
+    bool has_avx2() noexcept
+    {
+        static const bool supported = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+        }();
+        return supported;
+    }
+
+    // floor(numerator / denominator) for exact integers below 2^52. The rounded quotient is at most one too large.
+    __attribute__((target("avx2"))) static inline __m256d floor_div(const __m256d numerator, const __m256d denominator)
+    {
+        const __m256d q = _mm256_floor_pd(_mm256_div_pd(numerator, denominator));
+        const __m256d overshoot = _mm256_cmp_pd(_mm256_mul_pd(q, denominator), numerator, _CMP_GT_OQ);
+        return _mm256_sub_pd(q, _mm256_and_pd(overshoot, _mm256_set1_pd(1.0)));
+    }
+
+    // Peels four numerals at a time: one scalar division by radix^4, then the four numerals of the remainder in
+    // parallel as floor(part / [radix^3, radix^2, radix, 1]) mod radix, in double precision. That is exact while
+    // radix^4 <= 2^52; larger radices take the scalar path.
+    __attribute__((target("avx2")))
+    void str_radix_avx2(uint64_t value, uint32_t* digits, size_t count, const uint32_t radix)
+    {
+        const uint64_t r2 = uint64_t{radix} * radix;
+        const uint64_t r3 = r2 * radix;
+        if (r3 > (uint64_t{1} << 52) / radix)
+        {
+            str_radix_scalar(value, digits, count, radix);
+            return;
+        }
+        const uint64_t r4 = r3 * radix;
+
+        const __m256d weights =
+            _mm256_set_pd(1.0, static_cast<double>(radix), static_cast<double>(r2), static_cast<double>(r3));
+        const __m256d radix_d = _mm256_set1_pd(static_cast<double>(radix));
+
+        while (count >= 4)
+        {
+            const uint64_t part = value % r4;
+            value /= r4;
+            count -= 4;
+
+            const __m256d part_d = _mm256_set1_pd(static_cast<double>(part));
+            const __m256d quotients = floor_div(part_d, weights);
+            const __m256d numerals = _mm256_sub_pd(quotients, _mm256_mul_pd(floor_div(quotients, radix_d), radix_d));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(digits + count), _mm256_cvtpd_epi32(numerals));
+        }
+        str_radix_scalar(value, digits, count, radix);
+    }
+
+#else
+
+    bool has_avx2() noexcept
+    {
+        return false;
+    }
+
+    void str_radix_avx2(const uint64_t value, uint32_t* digits, const size_t count, const uint32_t radix)
+    {
+        str_radix_scalar(value, digits, count, radix);
+    }
+
+#endif
+
+    void str_radix(const uint64_t value, uint32_t* digits, const size_t count, const uint32_t radix)
+    {
+        static const bool use_avx2 = has_avx2();
+        if (use_avx2 && count >= AVX2_MIN_COUNT)
+            str_radix_avx2(value, digits, count, radix);
+        else
+            str_radix_scalar(value, digits, count, radix);
+    }
+}
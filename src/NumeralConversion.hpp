@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// STR_radix (NIST SP 800-38G, section 4.5) for numeral strings whose value fits in 64 bits.
+//
+// str_radix picks an implementation once, from CPUID: an AVX2 kernel that peels four numerals per division, or the
+// scalar loop otherwise. Both give identical results. NUM_radix has no counterpart here: its single multiply-add chain
+// is already shorter than any vector reduction at these lengths.
+namespace numeral_conversion
+{
+    // Writes the count-numeral representation of value, most significant numeral first. Requires value < radix^count.
+    void str_radix(uint64_t value, uint32_t* digits, size_t count, uint32_t radix);
+
+    // True when this CPU runs the AVX2 kernel
+    bool has_avx2() noexcept;
+
+    // Explicit variants for tests and benchmarks. Only call str_radix_avx2 when has_avx2().
+    void str_radix_scalar(uint64_t value, uint32_t* digits, size_t count, uint32_t radix);
+    void str_radix_avx2(uint64_t value, uint32_t* digits, size_t count, uint32_t radix);
+}
@@ -1,58 +1,22 @@
 #pragma once
 
 #include "IndexedGlyphSet.hpp"
+#include "CodepointRangeGlyphSet.hpp"
 
 #include "GlyphFPECipher.hpp"
 #include "UnicodeBlockList.hpp"
+#include "UnicodeBlockTables.hpp"
 
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <iostream>
 #include <algorithm>
+#include <memory>
 
 struct PreconfiguredIndexedGlyphSet
 {
 
-    template <typename BlockType, size_t N>
-    static void check_unicode_blocks(const BlockType (&unicode_blocks)[N]) {
-        // Copy blocks to a vector for sorting
-        std::vector<BlockType> blocks(std::begin(unicode_blocks), std::end(unicode_blocks));
-
-        // Sort blocks by start codepoint
-        std::sort(blocks.begin(), blocks.end(),
-            [](const BlockType& a, const BlockType& b) { return a.start < b.start; });
-
-        // Check for overlaps between blocks
-        for (size_t i = 1; i < blocks.size(); ++i) {
-            const auto& prev = blocks[i - 1];
-            const auto& curr = blocks[i];
-            if (curr.start <= prev.end) {
-                std::cout << "Overlap detected between blocks:\n"
-                          << "  " << prev.name << " (" << std::hex << prev.start << "-" << prev.end << ")\n"
-                          << "  " << curr.name << " (" << curr.start << "-" << curr.end << ")\n";
-            }
-        }
-
-        // Check for duplicate codepoints across blocks
-        // Unicode max codepoint is 0x10FFFF
-        const uint32_t max_cp = 0x10FFFF;
-        std::vector<bool> coverage(max_cp + 1, false);
-
-        for (const auto& block : blocks) {
-            for (uint32_t cp = block.start; cp <= block.end; ++cp) {
-                if (coverage[cp]) {
-                    std::cout << "Duplicate codepoint U+"
-                              << std::hex << cp
-                              << " in block " << block.name << "\n";
-                }
-                coverage[cp] = true;
-            }
-        }
-    }
-
-    static std::unordered_map<std::string, IndexedGlyphSet> unicode_blocks_glyph_set;
-
     static void encode_utf8(const uint32_t codepoint, std::string& out) {
         if (codepoint <= 0x7F) {
             // 1-byte ASCII
@@ -77,6 +41,8 @@ struct PreconfiguredIndexedGlyphSet
         }
     }
 
+    // Every block of UnicodeBlockList.hpp with its glyphs materialized, for callers that need IndexedGlyphSet.
+    // unicode_block_tables::glyph_sets holds the same blocks as code point ranges.
     static std::unordered_map<std::string, IndexedGlyphSet> buildIndexedGlyphSetsFromBlocks() {
         std::unordered_map<std::string, IndexedGlyphSet> glyph_sets;
 
@@ -143,32 +109,42 @@ struct PreconfiguredIndexedGlyphSet
 
     static std::vector<GlyphFPECipher> buildAsciiGlyphCiphers(
         const std::vector<uint8_t>& key,
-        const std::vector<uint8_t>& tweak
+        const std::vector<uint8_t>& tweak,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {}
     )
     {
         std::vector<GlyphFPECipher> result;
         result.reserve(5); // known count
 
-        result.emplace_back(&control(), key, tweak, false);
-        result.emplace_back(&whitespace(), key, tweak, false);
-        result.emplace_back(&digits(), key, tweak, false);
-        result.emplace_back(&letters(), key, tweak, false);
-        result.emplace_back(&symbols(), key, tweak, false);
+        const auto shared_key = std::make_shared<const FPEKeyContext>(key);
+
+        result.emplace_back(&control(), shared_key, tweak, false, algorithm, small_domain);
+        result.emplace_back(&whitespace(), shared_key, tweak, false, algorithm, small_domain);
+        result.emplace_back(&digits(), shared_key, tweak, false, algorithm, small_domain);
+        result.emplace_back(&letters(), shared_key, tweak, false, algorithm, small_domain);
+        result.emplace_back(&symbols(), shared_key, tweak, false, algorithm, small_domain);
 
         return result;
     }
 
     static std::vector<GlyphFPECipher> buildUnicodeGlyphCiphers(
         const std::vector<uint8_t>& key,
-        const std::vector<uint8_t>& tweak
+        const std::vector<uint8_t>& tweak,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {}
     )
     {
         std::vector<GlyphFPECipher> glyph_fpe_ciphers;// = buildAsciiGlyphCiphers(key, tweak);
-        glyph_fpe_ciphers.reserve(unicode_blocks_glyph_set.size());
+        glyph_fpe_ciphers.reserve(unicode_block_tables::glyph_sets.size());
+
+        // One AES key schedule for every block instead of one per block
+        const auto shared_key = std::make_shared<const FPEKeyContext>(key);
 
-        for (const auto& [block_name, indexed_glyph_set] : unicode_blocks_glyph_set)
+        // In block id order, which lets UnicodeGlyphCipherIndex use the compile-time code point table
+        for (const auto& block_glyph_set : unicode_block_tables::glyph_sets)
         {
-            glyph_fpe_ciphers.push_back(GlyphFPECipher(indexed_glyph_set, key, tweak));
+            glyph_fpe_ciphers.emplace_back(&block_glyph_set, shared_key, tweak, algorithm, small_domain);
         }
 
         return glyph_fpe_ciphers;
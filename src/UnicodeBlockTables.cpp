@@ -0,0 +1,146 @@
+#include "UnicodeBlockTables.hpp"
+
+#include <string_view>
+#include <utility>
+
+namespace unicode_block_tables
+{
+    namespace
+    {
+        constexpr size_t BLOCK_COUNT = std::size(unicode_blocks);
+
+        constexpr bool blocks_disjoint()
+        {
+            std::array<UnicodeBlock, BLOCK_COUNT> sorted{};
+            std::copy(std::begin(unicode_blocks), std::end(unicode_blocks), sorted.begin());
+            std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.start < b.start; });
+            for (size_t i = 0; i < BLOCK_COUNT; ++i)
+            {
+                if (sorted[i].start > sorted[i].end || sorted[i].end > CodepointCipherTable::MAX_CODEPOINT)
+                    return false;
+                if (i > 0 && sorted[i].start <= sorted[i - 1].end)
+                    return false;
+            }
+            return true;
+        }
+
+        constexpr bool block_names_unique()
+        {
+            std::array<std::string_view, BLOCK_COUNT> names{};
+            std::transform(std::begin(unicode_blocks), std::end(unicode_blocks), names.begin(),
+                           [](const auto& block) { return std::string_view(block.name); });
+            std::sort(names.begin(), names.end());
+            return std::adjacent_find(names.begin(), names.end()) == names.end();
+        }
+
+        static_assert(blocks_disjoint(), "UnicodeBlockList.hpp: blocks overlap or have invalid ranges");
+        static_assert(block_names_unique(), "UnicodeBlockList.hpp: duplicate block names");
+        static_assert(GLYPH_BLOCK_COUNT < CodepointCipherTable::NO_CIPHER, "block ids must fit in 16 bits");
+
+        constexpr std::array<size_t, GLYPH_BLOCK_COUNT> glyph_block_positions = [] {
+            std::array<size_t, GLYPH_BLOCK_COUNT> positions{};
+            size_t count = 0;
+            for (size_t i = 0; i < BLOCK_COUNT; ++i)
+                if (has_glyphs(unicode_blocks[i]))
+                    positions[count++] = i;
+            return positions;
+        }();
+
+        // CodepointRangeGlyphSet throws for ranges it cannot hold, which fails constant evaluation
+        template <size_t... I>
+        constexpr std::array<CodepointRangeGlyphSet, sizeof...(I)> make_glyph_sets(std::index_sequence<I...>)
+        {
+            return {CodepointRangeGlyphSet(unicode_blocks[glyph_block_positions[I]].name,
+                                           unicode_blocks[glyph_block_positions[I]].start,
+                                           unicode_blocks[glyph_block_positions[I]].end)...};
+        }
+
+        constexpr uint32_t PAGE_SIZE = CodepointCipherTable::PAGE_SIZE;
+        constexpr uint32_t PAGE_BITS = CodepointCipherTable::PAGE_BITS;
+        constexpr uint32_t PAGE_COUNT = CodepointCipherTable::PAGE_COUNT;
+
+        // Calls f(lo, hi) for the runs of a set's code points on either side of the surrogates
+        template <typename F>
+        constexpr void for_each_run(const CodepointRangeGlyphSet& set, F&& f)
+        {
+            const uint32_t first = set.first_codepoint();
+            const uint32_t last = set.last_codepoint();
+            if (first < 0xD800)
+                f(first, std::min<uint32_t>(last, 0xD7FF));
+            if (last > 0xDFFF)
+                f(std::max<uint32_t>(first, 0xE000), last);
+        }
+
+        struct PageLayout
+        {
+            std::array<uint16_t, PAGE_COUNT> directory{};
+            size_t page_count = 1;
+        };
+
+        // Page 0 is unmapped; an entry wholly inside one block shares that block's page; any other mapped entry
+        // gets a page of its own
+        constexpr PageLayout layout_pages(const std::array<CodepointRangeGlyphSet, GLYPH_BLOCK_COUNT>& sets)
+        {
+            constexpr int32_t unmapped = -1;
+            constexpr int32_t mixed = -2;
+            std::array<int32_t, PAGE_COUNT> kind{};
+            kind.fill(unmapped);
+            for (size_t id = 0; id < sets.size(); ++id)
+            {
+                for_each_run(sets[id], [&](const uint32_t lo, const uint32_t hi) {
+                    for (uint32_t page = lo >> PAGE_BITS; page <= hi >> PAGE_BITS; ++page)
+                    {
+                        const bool whole = lo <= page << PAGE_BITS && hi >= ((page << PAGE_BITS) | (PAGE_SIZE - 1));
+                        kind[page] = whole && kind[page] == unmapped ? static_cast<int32_t>(id) : mixed;
+                    }
+                });
+            }
+
+            PageLayout layout;
+            std::array<uint16_t, GLYPH_BLOCK_COUNT> shared{};
+            for (uint32_t page = 0; page < PAGE_COUNT; ++page)
+            {
+                if (kind[page] == unmapped)
+                    continue;
+                if (kind[page] == mixed)
+                {
+                    layout.directory[page] = static_cast<uint16_t>(layout.page_count++);
+                    continue;
+                }
+                uint16_t& page_of_block = shared[static_cast<size_t>(kind[page])];
+                if (page_of_block == 0)
+                    page_of_block = static_cast<uint16_t>(layout.page_count++);
+                layout.directory[page] = page_of_block;
+            }
+            return layout;
+        }
+
+        template <size_t Pages>
+        constexpr std::array<uint16_t, Pages * PAGE_SIZE> fill_pages(
+            const std::array<CodepointRangeGlyphSet, GLYPH_BLOCK_COUNT>& sets, const PageLayout& layout)
+        {
+            std::array<uint16_t, Pages * PAGE_SIZE> ids{};
+            ids.fill(CodepointCipherTable::NO_CIPHER);
+            for (size_t id = 0; id < sets.size(); ++id)
+            {
+                for_each_run(sets[id], [&](const uint32_t lo, const uint32_t hi) {
+                    for (uint32_t cp = lo; cp <= hi; ++cp)
+                        ids[size_t{layout.directory[cp >> PAGE_BITS]} * PAGE_SIZE + (cp & (PAGE_SIZE - 1))] =
+                            static_cast<uint16_t>(id);
+                });
+            }
+            return ids;
+        }
+
+        constexpr std::array<CodepointRangeGlyphSet, GLYPH_BLOCK_COUNT> sets =
+            make_glyph_sets(std::make_index_sequence<GLYPH_BLOCK_COUNT>{});
+        constexpr PageLayout layout = layout_pages(sets);
+        constexpr auto page_ids = fill_pages<layout.page_count>(sets, layout);
+
+        static_assert(layout.page_count <= UINT16_MAX, "page numbers must fit in 16 bits");
+    }
+
+    constexpr std::array<CodepointRangeGlyphSet, GLYPH_BLOCK_COUNT> glyph_sets = sets;
+    constexpr std::array<uint16_t, CodepointCipherTable::PAGE_COUNT> directory = layout.directory;
+    constexpr std::span<const uint16_t> pages = page_ids;
+}
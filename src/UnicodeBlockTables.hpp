@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+
+#include "CodepointCipherTable.hpp"
+#include "CodepointRangeGlyphSet.hpp"
+#include "UnicodeBlockList.hpp"
+
+// Dispatch tables for the blocks of UnicodeBlockList.hpp. They are evaluated at compile time in UnicodeBlockTables.cpp,
+// which also rejects overlapping blocks, duplicate names and ranges that cannot form a glyph set with static_asserts,
+// so they sit in .rodata and cost nothing at process start.
+namespace unicode_block_tables
+{
+    // Blocks made up only of surrogates have no glyphs and are left out
+    constexpr bool has_glyphs(const UnicodeBlock& block) noexcept
+    {
+        return !(block.start >= 0xD800 && block.end <= 0xDFFF);
+    }
+
+    inline constexpr size_t GLYPH_BLOCK_COUNT =
+        static_cast<size_t>(std::count_if(std::begin(unicode_blocks), std::end(unicode_blocks), has_glyphs));
+
+    // One set per block with glyphs, in list order; a set's position is its block id
+    extern const std::array<CodepointRangeGlyphSet, GLYPH_BLOCK_COUNT> glyph_sets;
+
+    // Code point → block id, laid out for CodepointCipherTable::over()
+    extern const std::array<uint16_t, CodepointCipherTable::PAGE_COUNT> directory;
+    extern const std::span<const uint16_t> pages;
+}
@@ -1,5 +1,7 @@
 #include "UnicodeFPECipher.hpp"
-#include <numeric>  // for std::accumulate
+#include "Utf8Scan.hpp"
+#include <algorithm>
+#include <numeric>  // for std::iota
 #include <stdexcept>
 
 #include <string_view>
@@ -7,174 +9,351 @@
 #include <cstring>
 #include <utility>
 
-std::pair<uint32_t, size_t> decode_utf8_glyph(std::string_view str, size_t pos)
+UnicodeFPECipher::UnicodeFPECipher(UnicodeGlyphCipherIndex&& index)
+    : cipher_index(std::move(index))
+    , glyph_table(cipher_index.glyph_table())
+{
+    build_ascii_table();
+}
+
+void UnicodeFPECipher::build_ascii_table()
+{
+    for (uint32_t cp = 0; cp < ascii_glyphs.size(); ++cp)
+    {
+        ascii_glyphs[cp] = {ASCII_PASSTHROUGH, 0};
+        const CodepointGlyphTable::Glyph glyph = glyph_table[cp];
+        if (glyph.cipher == CodepointGlyphTable::NO_CIPHER)
+            continue;
+
+        auto slot = std::find_if(ascii_ciphers.begin(), ascii_ciphers.end(), [&](const AsciiCipher& c) {
+            return c.id == glyph.cipher;
+        });
+        if (slot == ascii_ciphers.end())
+        {
+            // A glyph set holding a 1-byte glyph holds nothing but ASCII, so all of it fits in 128 entries
+            const GlyphFPECipher& cipher = cipher_index.cipher(glyph.cipher);
+            AsciiCipher entry{glyph.cipher, &cipher, {}};
+            std::vector<uint32_t> indexes(cipher.glyph_count());
+            std::iota(indexes.begin(), indexes.end(), 0u);
+            cipher.visit([&](const auto& c) {
+                c.glyphs().unmap_glyphs(indexes.data(), indexes.size(), entry.glyphs.data());
+            });
+            ascii_ciphers.push_back(entry);
+            slot = ascii_ciphers.end() - 1;
+        }
+        ascii_glyphs[cp] = {static_cast<uint8_t>(slot - ascii_ciphers.begin()), static_cast<uint8_t>(glyph.index)};
+    }
+}
+
+std::string UnicodeFPECipher::encrypt(std::string_view input) const
+{
+    return transform(input, std::nullopt, true);
+}
+
+std::string UnicodeFPECipher::decrypt(std::string_view input) const
+{
+    return transform(input, std::nullopt, false);
+}
+
+std::string UnicodeFPECipher::encrypt(std::string_view input, std::span<const uint8_t> tweak) const
 {
-    if (pos >= str.size())
-        throw std::out_of_range("Position out of range in decode_utf8_glyph");
+    return transform(input, tweak, true);
+}
 
-    unsigned char lead = static_cast<unsigned char>(str[pos]);
+std::string UnicodeFPECipher::decrypt(std::string_view input, std::span<const uint8_t> tweak) const
+{
+    return transform(input, tweak, false);
+}
+
+size_t UnicodeFPECipher::encrypt_into(std::string_view input, std::span<char> out, TokenizeContext& ctx) const
+{
+    return transform_into(input, out, ctx, std::nullopt, true);
+}
+
+size_t UnicodeFPECipher::decrypt_into(std::string_view input, std::span<char> out, TokenizeContext& ctx) const
+{
+    return transform_into(input, out, ctx, std::nullopt, false);
+}
+
+size_t UnicodeFPECipher::encrypt_into(
+    std::string_view input, std::span<char> out, TokenizeContext& ctx, std::span<const uint8_t> tweak
+) const
+{
+    return transform_into(input, out, ctx, tweak, true);
+}
+
+size_t UnicodeFPECipher::decrypt_into(
+    std::string_view input, std::span<char> out, TokenizeContext& ctx, std::span<const uint8_t> tweak
+) const
+{
+    return transform_into(input, out, ctx, tweak, false);
+}
+
+TokenizeContext& UnicodeFPECipher::thread_context()
+{
+    thread_local TokenizeContext context;
+    return context;
+}
+
+std::string UnicodeFPECipher::transform(std::string_view input, glyph_fpe::Tweak tweak, bool encrypt) const
+{
+    std::string output(input.size(), '\0');
+    transform_into(input, output, thread_context(), tweak, encrypt);
+    return output;
+}
 
-    if (lead < 0x80)
+size_t UnicodeFPECipher::transform_into(
+    std::string_view input, std::span<char> out, TokenizeContext& ctx, glyph_fpe::Tweak tweak, bool encrypt
+) const
+{
+    if (out.size() < input.size())
+        throw std::invalid_argument(
+            "UnicodeFPECipher: output needs " + std::to_string(input.size()) + " bytes, has " +
+            std::to_string(out.size())
+        );
+    if (utf8_scan::is_ascii(input))
     {
-        // 1-byte ASCII
-        return {lead, 1};
+        transform_ascii(input, tweak, encrypt, ctx, out);
+        return input.size();
     }
-    else if ((lead >> 5) == 0x6)
+    parse_and_dispatch(input, ctx);
+    transform_glyph_indexes(ctx, tweak, encrypt);
+    reassemble_output(
+        input, std::span(ctx.glyph_cipher_indices.data(), ctx.glyph_count), ctx.runs, ctx.glyph_indexes, ctx, out
+    );
+    return input.size();
+}
+
+// Every ASCII cipher gets its glyph indexes of the whole input in one array, straight from the byte table
+void UnicodeFPECipher::transform_ascii(
+    std::string_view input, glyph_fpe::Tweak tweak, bool encrypt, TokenizeContext& ctx, std::span<char> out
+) const
+{
+    const auto* bytes = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t slot_count = ascii_ciphers.size();
+
+    // Indexes of each cipher back to back: count them, then lay them out from each cipher's start
+    std::array<size_t, 256> starts{};
+    std::array<size_t, 256> cursors{};
+    for (size_t i = 0; i < input.size(); ++i)
+        ++cursors[ascii_glyphs[bytes[i]].cipher_slot];
+    size_t total = 0;
+    for (size_t slot = 0; slot < slot_count; ++slot)
     {
-        // 2-byte sequence
-        if (pos + 1 >= str.size())
-            throw std::runtime_error("Truncated UTF-8 sequence");
-        uint32_t cp = ((lead & 0x1F) << 6) | (static_cast<unsigned char>(str[pos + 1]) & 0x3F);
-        return {cp, 2};
+        starts[slot] = total;
+        total += cursors[slot];
+        cursors[slot] = starts[slot];
     }
-    else if ((lead >> 4) == 0xE)
+
+    std::vector<uint32_t>& indexes = ctx.glyph_indexes;
+    indexes.resize(total);
+    for (size_t i = 0; i < input.size(); ++i)
     {
-        // 3-byte sequence
-        if (pos + 2 >= str.size())
-            throw std::runtime_error("Truncated UTF-8 sequence");
-        uint32_t cp = ((lead & 0x0F) << 12) |
-                      ((static_cast<unsigned char>(str[pos + 1]) & 0x3F) << 6) |
-                      (static_cast<unsigned char>(str[pos + 2]) & 0x3F);
-        return {cp, 3};
+        const AsciiGlyph glyph = ascii_glyphs[bytes[i]];
+        if (glyph.cipher_slot != ASCII_PASSTHROUGH)
+            indexes[cursors[glyph.cipher_slot]++] = glyph.index;
     }
-    else if ((lead >> 3) == 0x1E)
+
+    for (size_t slot = 0; slot < slot_count; ++slot)
     {
-        // 4-byte sequence
-        if (pos + 3 >= str.size())
-            throw std::runtime_error("Truncated UTF-8 sequence");
-        uint32_t cp = ((lead & 0x07) << 18) |
-                      ((static_cast<unsigned char>(str[pos + 1]) & 0x3F) << 12) |
-                      ((static_cast<unsigned char>(str[pos + 2]) & 0x3F) << 6) |
-                      (static_cast<unsigned char>(str[pos + 3]) & 0x3F);
-        return {cp, 4};
+        const std::span<uint32_t> slot_indexes(indexes.data() + starts[slot], cursors[slot] - starts[slot]);
+        if (slot_indexes.empty())
+            continue;
+        if (encrypt)
+            ascii_ciphers[slot].cipher->encrypt_indexes(slot_indexes, tweak);
+        else
+            ascii_ciphers[slot].cipher->decrypt_indexes(slot_indexes, tweak);
     }
-    else
+
+    // Each byte is read before its own position in out is written, so out may be input
+    std::copy(starts.begin(), starts.begin() + slot_count, cursors.begin());
+    for (size_t i = 0; i < input.size(); ++i)
     {
-        throw std::runtime_error("Invalid UTF-8 lead byte");
+        const AsciiGlyph glyph = ascii_glyphs[bytes[i]];
+        out[i] = glyph.cipher_slot == ASCII_PASSTHROUGH
+            ? input[i]
+            : ascii_ciphers[glyph.cipher_slot].glyphs[indexes[cursors[glyph.cipher_slot]++]];
     }
 }
 
-
-UnicodeFPECipher::UnicodeFPECipher(UnicodeGlyphCipherIndex&& index)
-    : cipher_index(std::move(index))
-{}
-
-std::string UnicodeFPECipher::encrypt(std::string_view input)
+std::vector<std::string> UnicodeFPECipher::encrypt_batch(const std::vector<std::string>& inputs) const
 {
-    std::vector<std::string> cipher_buffers;
-    auto glyph_cipher_indices = parse_and_dispatch(input, cipher_buffers);
-    encrypt_cipher_buffers(cipher_buffers);
-    return reassemble_output(glyph_cipher_indices, cipher_buffers);
+    return transform_batch(inputs, true);
 }
 
-std::string UnicodeFPECipher::decrypt(std::string_view input)
+std::vector<std::string> UnicodeFPECipher::decrypt_batch(const std::vector<std::string>& inputs) const
 {
-    std::vector<std::string> cipher_buffers;
-    auto glyph_cipher_indices = parse_and_dispatch(input, cipher_buffers);
-    decrypt_cipher_buffers(cipher_buffers);
-    return reassemble_output(glyph_cipher_indices, cipher_buffers);
+    return transform_batch(inputs, false);
 }
 
-std::vector<uint32_t> UnicodeFPECipher::parse_and_dispatch(std::string_view input, std::vector<std::string>& cipher_buffers)
+// Inputs are scanned one after another through the calling thread's context, each keeping only its glyphs' ciphers,
+// gathered indexes and runs. All-ASCII inputs take the general path too, so their glyphs join the batches.
+std::vector<std::string> UnicodeFPECipher::transform_batch(const std::vector<std::string>& inputs, bool encrypt) const
 {
-    size_t pos = 0;
-    size_t cipher_count = cipher_index.glyph_ciphers.size() + 1; // +1 for noop cipher
+    // Which input and run each (cipher, input) pair is, ordered by cipher
+    struct RunRef
+    {
+        uint16_t cidx;
+        size_t input;
+        size_t run;
+    };
 
-    // --- First pass: count total bytes per cipher ---
-    std::vector<size_t> cipher_byte_counts(cipher_count, 0);
-    size_t glyph_count = 0;
+    TokenizeContext& ctx = thread_context();
+    std::vector<ParsedInput> parsed(inputs.size());
+    std::vector<RunRef> refs;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        parse_and_dispatch(inputs[i], ctx);
+        parsed[i].glyph_cipher_indices.assign(
+            ctx.glyph_cipher_indices.begin(), ctx.glyph_cipher_indices.begin() + ctx.glyph_count
+        );
+        parsed[i].glyph_indexes = ctx.glyph_indexes;
+        parsed[i].runs = ctx.runs;
+        for (size_t r = 0; r < ctx.runs.size(); ++r)
+            refs.push_back({ctx.runs[r].cidx, i, r});
+    }
+    std::ranges::stable_sort(refs, {}, &RunRef::cidx);
 
-    size_t temp_pos = 0;
-    while (temp_pos < input.size())
+    // Unmapped glyphs pass through unchanged, so only real ciphers are batched
+    std::vector<std::vector<uint32_t>> batch;
+    for (auto first = refs.begin(); first != refs.end();)
     {
-        auto [cp, glyph_len] = decode_utf8_glyph(input, temp_pos);
-        uint32_t cidx = cipher_index[cp] == cipher_index.noop_cipher
-                            ? static_cast<uint32_t>(cipher_count - 1)
-                            : static_cast<uint32_t>(&cipher_index[cp] - &cipher_index.glyph_ciphers[0]);
+        const uint16_t cidx = first->cidx;
+        const auto last = std::find_if(first, refs.end(), [&](const RunRef& ref) { return ref.cidx != cidx; });
+        auto run_indexes = [&](const RunRef& ref) {
+            const TokenizeContext::CipherRun& run = parsed[ref.input].runs[ref.run];
+            return std::span<uint32_t>(parsed[ref.input].glyph_indexes).subspan(run.start, run.count);
+        };
 
-        cipher_byte_counts[cidx] += glyph_len;
-        temp_pos += glyph_len;
-        ++glyph_count;
+        batch.clear();
+        for (auto ref = first; ref != last; ++ref)
+        {
+            const std::span<uint32_t> indexes = run_indexes(*ref);
+            batch.emplace_back(indexes.begin(), indexes.end());
+        }
+        const GlyphFPECipher& cipher = cipher_index.cipher(cidx);
+        const auto transformed = encrypt ? cipher.encrypt_indexes_batch(batch) : cipher.decrypt_indexes_batch(batch);
+        for (size_t k = 0; first + k != last; ++k)
+            std::ranges::copy(transformed[k], run_indexes(first[k]).begin());
+        first = last;
     }
 
-    // --- Prepare cipher_buffers with preallocated capacity ---
-    cipher_buffers.resize(cipher_count);
-    for (size_t i = 0; i < cipher_count; ++i)
+    std::vector<std::string> outputs;
+    outputs.reserve(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
     {
-        cipher_buffers[i].reserve(cipher_byte_counts[i]);
+        std::string& output = outputs.emplace_back(inputs[i].size(), '\0');
+        const ParsedInput& input = parsed[i];
+        reassemble_output(inputs[i], input.glyph_cipher_indices, input.runs, input.glyph_indexes, ctx, output);
     }
+    return outputs;
+}
 
-    // --- Prepare glyph_cipher_indices with exact capacity ---
-    std::vector<uint32_t> glyph_cipher_indices;
-    glyph_cipher_indices.reserve(glyph_count);
+void UnicodeFPECipher::parse_and_dispatch(std::string_view input, TokenizeContext& ctx) const
+{
+    const auto noop_cidx = static_cast<uint16_t>(cipher_index.cipher_count());
 
-    // --- Second pass: append glyphs to cipher buffers and record indices ---
-    pos = 0;
-    while (pos < input.size())
+    // Buffers only grow; glyph_counts is all zero between calls, whatever cipher the previous call came from
+    ctx.glyph_cipher_indices.resize(std::max(ctx.glyph_cipher_indices.size(), input.size()));
+    ctx.scanned_indexes.resize(std::max(ctx.scanned_indexes.size(), input.size()));
+    if (ctx.glyph_counts.size() <= noop_cidx)
     {
-        auto [cp, glyph_len] = decode_utf8_glyph(input, pos);
-        uint32_t cidx = cipher_index[cp] == cipher_index.noop_cipher
-                            ? static_cast<uint32_t>(cipher_count - 1)
-                            : static_cast<uint32_t>(&cipher_index[cp] - &cipher_index.glyph_ciphers[0]);
+        ctx.glyph_counts.resize(noop_cidx + 1, 0);
+        ctx.cursors.resize(noop_cidx);
+    }
+    ctx.runs.clear();
 
-        cipher_buffers[cidx].append(input.data() + pos, glyph_len);
-        glyph_cipher_indices.push_back(cidx);
-        pos += glyph_len;
+    // --- One pass validates, decodes and finds each glyph's cipher and glyph index ---
+    ctx.glyph_count = utf8_scan::scan(
+        input, glyph_table, noop_cidx, ctx.glyph_cipher_indices.data(), ctx.scanned_indexes.data(),
+        ctx.glyph_counts.data()
+    );
+    if (ctx.glyph_count == utf8_scan::INVALID)
+    {
+        std::fill(ctx.glyph_counts.begin(), ctx.glyph_counts.end(), 0);
+        throw std::runtime_error(
+            "UnicodeFPECipher: invalid UTF-8 at byte " + std::to_string(utf8_scan::first_invalid(input))
+        );
     }
 
-    return glyph_cipher_indices;
-}
-void UnicodeFPECipher::encrypt_cipher_buffers(std::vector<std::string>& cipher_buffers)
-{
-    size_t cipher_count = cipher_buffers.size();
-    for (size_t i = 0; i < cipher_count; ++i)
+    // --- Each cipher present gets a run, in order of first use; its count goes back to zero as it is taken ---
+    size_t total = 0;
+    for (size_t i = 0; i < ctx.glyph_count; ++i)
+    {
+        const uint16_t cidx = ctx.glyph_cipher_indices[i];
+        if (cidx == noop_cidx || ctx.glyph_counts[cidx] == 0)
+            continue;
+        ctx.runs.push_back({cidx, total, ctx.glyph_counts[cidx]});
+        ctx.cursors[cidx] = total;
+        total += ctx.glyph_counts[cidx];
+        ctx.glyph_counts[cidx] = 0;
+    }
+    ctx.glyph_counts[noop_cidx] = 0;
+
+    // --- Gather each cipher's indexes into its run, in input order ---
+    ctx.glyph_indexes.resize(total);
+    for (size_t i = 0; i < ctx.glyph_count; ++i)
     {
-        GlyphFPECipher& cipher = (i == cipher_count - 1) ? cipher_index.noop_cipher : cipher_index.glyph_ciphers[i];
-        cipher_buffers[i] = cipher.encrypt(cipher_buffers[i]);
+        const uint16_t cidx = ctx.glyph_cipher_indices[i];
+        if (cidx != noop_cidx)
+            ctx.glyph_indexes[ctx.cursors[cidx]++] = ctx.scanned_indexes[i];
     }
 }
 
-void UnicodeFPECipher::decrypt_cipher_buffers(std::vector<std::string>& cipher_buffers)
+void UnicodeFPECipher::transform_glyph_indexes(TokenizeContext& ctx, glyph_fpe::Tweak tweak, bool encrypt) const
 {
-    size_t cipher_count = cipher_buffers.size();
-    for (size_t i = 0; i < cipher_count; ++i)
+    // Ciphers without glyphs in this input have no run, so are left alone and never created
+    for (const auto& run : ctx.runs)
     {
-        GlyphFPECipher& cipher = (i == cipher_count - 1) ? cipher_index.noop_cipher : cipher_index.glyph_ciphers[i];
-        cipher_buffers[i] = cipher.decrypt(cipher_buffers[i]);
+        const GlyphFPECipher& cipher = cipher_index.cipher(run.cidx);
+        if (encrypt)
+            cipher.encrypt_indexes(ctx.run_indexes(run), tweak);
+        else
+            cipher.decrypt_indexes(ctx.run_indexes(run), tweak);
     }
 }
 
-std::string UnicodeFPECipher::reassemble_output(
-    const std::vector<uint32_t>& glyph_cipher_indices, const std::vector<std::string>& cipher_buffers
-)
+// The only conversion back to UTF-8: each cipher's glyphs in one call of its glyph set's kernels, then into place.
+// Only ctx's cursors and cipher_glyphs are used, so the glyphs and runs may come from elsewhere.
+void UnicodeFPECipher::reassemble_output(
+    std::string_view input, std::span<const uint16_t> glyph_cipher_indices,
+    std::span<const TokenizeContext::CipherRun> runs, std::span<const uint32_t> glyph_indexes, TokenizeContext& ctx,
+    std::span<char> out
+) const
 {
-    size_t cipher_count = cipher_buffers.size();
-    std::vector<size_t> cipher_offsets(cipher_count, 0);
-
-    // Pre-calculate total output size
     size_t total_size = 0;
-    for (const auto& s : cipher_buffers)
-        total_size += s.size();
-
-    std::string output;
-    output.resize(total_size);  // Pre-allocate output size exactly
-
-    size_t output_pos = 0;
-    for (uint32_t cidx : glyph_cipher_indices)
+    for (const auto& run : runs)
     {
-        const GlyphFPECipher& cipher = (cidx == cipher_count - 1)
-            ? cipher_index.noop_cipher
-            : cipher_index.glyph_ciphers[cidx];
-
-        size_t glyph_len = cipher.glyphs().glyph_size();
-
-        size_t offset = cipher_offsets[cidx];
-        // Copy glyph_len bytes from cipher_buffers[cidx] + offset to output + output_pos
-        std::memcpy(&output[output_pos], cipher_buffers[cidx].data() + offset, glyph_len);
+        ctx.cursors[run.cidx] = total_size;
+        total_size += run.count * cipher_index.cipher(run.cidx).glyph_size();
+    }
 
-        cipher_offsets[cidx] += glyph_len;
-        output_pos += glyph_len;
+    ctx.cipher_glyphs.resize(std::max(ctx.cipher_glyphs.size(), total_size));
+    for (const auto& run : runs)
+    {
+        const std::span<const uint32_t> indexes = glyph_indexes.subspan(run.start, run.count);
+        char* glyphs = ctx.cipher_glyphs.data() + ctx.cursors[run.cidx];
+        cipher_index.cipher(run.cidx).visit([&](const auto& cipher) {
+            cipher.glyphs().unmap_glyphs(indexes.data(), indexes.size(), glyphs);
+        });
     }
 
-    return output;
-}
\ No newline at end of file
+    // Ciphers keep glyph widths, so every glyph takes the width of its lead byte in the input, and unmapped glyphs
+    // are copied from there. A glyph is read before its own bytes of out are written, so out may be input.
+    const size_t cipher_count = cipher_index.cipher_count();
+    size_t pos = 0;
+    for (const uint16_t cidx : glyph_cipher_indices)
+    {
+        const size_t glyph_len = utf8_scan::width(static_cast<unsigned char>(input[pos]));
+        if (cidx != cipher_count)
+        {
+            std::memcpy(out.data() + pos, ctx.cipher_glyphs.data() + ctx.cursors[cidx], glyph_len);
+            ctx.cursors[cidx] += glyph_len;
+        }
+        else if (out.data() != input.data())
+        {
+            std::memcpy(out.data() + pos, input.data() + pos, glyph_len);
+        }
+        pos += glyph_len;
+    }
+}
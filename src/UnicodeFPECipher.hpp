@@ -1,24 +1,128 @@
 #pragma once
 
+#include <array>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
+#include "CodepointGlyphTable.hpp"
 #include "UnicodeGlyphCipherIndex.hpp"
 #include "GlyphFPECipher.hpp"
 
+// Scratch space of UnicodeFPECipher::encrypt_into/decrypt_into. Its buffers only grow, so once they fit the largest
+// input they have seen, calls make no heap allocation. One context serves any number of UnicodeFPECipher objects, but
+// only one call at a time; UnicodeFPECipher::thread_context() keeps one per thread.
+class TokenizeContext
+{
+public:
+    TokenizeContext() = default;
+
+private:
+    friend class UnicodeFPECipher;
+
+    // The glyph indexes of one cipher present in the input, at glyph_indexes[start, start + count)
+    struct CipherRun
+    {
+        uint16_t cidx;
+        size_t start;
+        size_t count;
+    };
+
+    std::vector<uint16_t> glyph_cipher_indices; // each glyph's cipher, cipher_count() when unmapped
+    std::vector<uint32_t> scanned_indexes;      // each glyph's index, in input order
+    std::vector<uint32_t> glyph_indexes;        // each run's indexes back to back
+    std::vector<size_t> glyph_counts;           // per cipher id; all zero between calls
+    std::vector<size_t> cursors;                // per cipher id, only meaningful for ids in runs
+    std::vector<CipherRun> runs;                // ciphers present in the input, in order of first use
+    std::string cipher_glyphs;                  // each run's glyphs back to back, once mapped back to UTF-8
+    size_t glyph_count = 0;
+
+    std::span<uint32_t> run_indexes(const CipherRun& run)
+    {
+        return {glyph_indexes.data() + run.start, run.count};
+    }
+};
+
 class UnicodeFPECipher
 {
 public:
     explicit UnicodeFPECipher(UnicodeGlyphCipherIndex&& index);
 
-    std::string encrypt(std::string_view input);
-    std::string decrypt(std::string_view input);
+    std::string encrypt(std::string_view input) const;
+    std::string decrypt(std::string_view input) const;
+
+    // Same, with every glyph cipher using the given tweak instead of its own
+    std::string encrypt(std::string_view input, std::span<const uint8_t> tweak) const;
+    std::string decrypt(std::string_view input, std::span<const uint8_t> tweak) const;
+
+    // Encrypts/decrypts input into out, which needs input.size() bytes and may be input itself but must not
+    // otherwise overlap it, and returns the bytes written: always input.size(), as glyphs keep their widths. Only
+    // ciphers with glyphs in input are touched, and with a warmed-up ctx no heap allocation is made.
+    size_t encrypt_into(std::string_view input, std::span<char> out, TokenizeContext& ctx) const;
+    size_t decrypt_into(std::string_view input, std::span<char> out, TokenizeContext& ctx) const;
+    size_t encrypt_into(
+        std::string_view input, std::span<char> out, TokenizeContext& ctx, std::span<const uint8_t> tweak
+    ) const;
+    size_t decrypt_into(
+        std::string_view input, std::span<char> out, TokenizeContext& ctx, std::span<const uint8_t> tweak
+    ) const;
+
+    // The calling thread's context, which encrypt() and decrypt() use too
+    static TokenizeContext& thread_context();
+
+    // Encrypts/decrypts many inputs, handing each glyph cipher all of its pieces in a single batch
+    std::vector<std::string> encrypt_batch(const std::vector<std::string>& inputs) const;
+    std::vector<std::string> decrypt_batch(const std::vector<std::string>& inputs) const;
 
 private:
     UnicodeGlyphCipherIndex cipher_index;
+    CodepointGlyphTable glyph_table; // of cipher_index, with noop ciphers left unmapped
+
+    // All-ASCII input skips UTF-8 handling: each byte maps straight to one of ascii_ciphers and its glyph index there.
+    // Bytes without a cipher, or with a noop one, pass through.
+    static constexpr uint8_t ASCII_PASSTHROUGH = UINT8_MAX;
+    struct AsciiGlyph
+    {
+        uint8_t cipher_slot;
+        uint8_t index;
+    };
+    struct AsciiCipher
+    {
+        uint16_t id;
+        const GlyphFPECipher* cipher;
+        std::array<char, 128> glyphs; // by index; ASCII glyph sets have at most 128
+    };
+    std::array<AsciiGlyph, 128> ascii_glyphs;
+    std::vector<AsciiCipher> ascii_ciphers;
+
+    void build_ascii_table();
+    void transform_ascii(
+        std::string_view input, glyph_fpe::Tweak tweak, bool encrypt, TokenizeContext& ctx, std::span<char> out
+    ) const;
+
+    // One input on its way through the ciphers, all in ctx: scanned and each present cipher's glyph indexes gathered
+    // into a run, those transformed, then mapped back to UTF-8 and put in place in out
+    std::string transform(std::string_view input, glyph_fpe::Tweak tweak, bool encrypt) const;
+    size_t transform_into(
+        std::string_view input, std::span<char> out, TokenizeContext& ctx, glyph_fpe::Tweak tweak, bool encrypt
+    ) const;
+    void parse_and_dispatch(std::string_view input, TokenizeContext& ctx) const;
+    void transform_glyph_indexes(TokenizeContext& ctx, glyph_fpe::Tweak tweak, bool encrypt) const;
+    std::vector<std::string> transform_batch(const std::vector<std::string>& inputs, bool encrypt) const;
+
+    // What a batch keeps of each input between scanning and reassembly, the per-cipher scratch staying in the one
+    // context all inputs are scanned with
+    struct ParsedInput
+    {
+        std::vector<uint16_t> glyph_cipher_indices;
+        std::vector<uint32_t> glyph_indexes;
+        std::vector<TokenizeContext::CipherRun> runs;
+    };
 
-    std::vector<uint32_t> parse_and_dispatch(std::string_view input, std::vector<std::string>& cipher_buffers);
-    void encrypt_cipher_buffers(std::vector<std::string>& cipher_buffers);
-    void decrypt_cipher_buffers(std::vector<std::string>& cipher_buffers);
-    std::string reassemble_output(const std::vector<uint32_t>& glyph_cipher_indices, const std::vector<std::string>& cipher_buffers);
+    void reassemble_output(
+        std::string_view input, std::span<const uint16_t> glyph_cipher_indices,
+        std::span<const TokenizeContext::CipherRun> runs, std::span<const uint32_t> glyph_indexes,
+        TokenizeContext& ctx, std::span<char> out
+    ) const;
 };
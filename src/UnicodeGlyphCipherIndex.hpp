@@ -1,11 +1,21 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <algorithm>
 #include <stdexcept>
+#include "CipherIndexSnapshot.hpp"
+#include "CodepointCipherTable.hpp"
+#include "CodepointGlyphTable.hpp"
 #include "GlyphFPECipher.hpp"
+#include "UnicodeBlockTables.hpp"
 
 inline uint32_t decode_utf8(std::string_view glyph)
 {
@@ -19,6 +29,9 @@ inline uint32_t decode_utf8(std::string_view glyph)
     throw std::runtime_error("Invalid UTF-8 glyph for code point extraction");
 }
 
+// Maps code points to the glyph cipher of their block. Ciphers are either handed over built, or created on first
+// use from the Unicode block list or a CipherIndexSnapshot: a short-lived worker then pays only for the blocks its
+// data touches. A created cipher is published with one atomic store, so lookups never take a lock once it exists.
 class UnicodeGlyphCipherIndex {
 public:
     UnicodeGlyphCipherIndex(
@@ -26,69 +39,236 @@ public:
         const std::vector<uint8_t>& key,
         const std::vector<uint8_t>& tweak
     )
-        : glyph_ciphers(std::move(ciphers)),
-          noop_cipher(new IndexedGlyphSet("noop", " \n\r"))
+        : noop_cipher(new IndexedGlyphSet("noop", " \n\r")),
+          _cipher_count(ciphers.size())
     {
-        if (glyph_ciphers.empty())
+        if (ciphers.empty())
             throw std::invalid_argument("ciphers vector must not be empty");
+        if (ciphers.size() >= CodepointCipherTable::NO_CIPHER)
+            throw std::invalid_argument("too many glyph ciphers for 16-bit cipher ids");
 
-        _codepoint_to_glyph_cipher = new uint32_t[0x110000];
-        std::fill_n(_codepoint_to_glyph_cipher, 0x110000, UINT32_MAX);
+        // Ciphers over the Unicode blocks in block id order read the table generated at compile time
+        const bool over_blocks = over_unicode_blocks(ciphers);
+        _slots = std::make_unique<Slot[]>(_cipher_count);
+        for (uint32_t idx = 0; idx < _cipher_count; ++idx)
+            _slots[idx].publish(std::move(ciphers[idx]));
 
-        for (uint32_t idx = 0; idx < glyph_ciphers.size(); ++idx)
+        if (over_blocks)
         {
-            const auto& codebook = glyph_ciphers[idx].glyphs();
-            for (size_t i = 0; i < codebook.size(); ++i)
-            {
-                auto glyph = codebook.from_index(i);
-                uint32_t cp = decode_utf8(glyph);
-
-                if (_codepoint_to_glyph_cipher[cp] != UINT32_MAX)
-                    throw std::invalid_argument("Code point assigned to multiple glyph sets: " + std::to_string(cp));
-                _codepoint_to_glyph_cipher[cp] = idx;
-            }
+            _codepoint_to_glyph_cipher =
+                CodepointCipherTable::over(unicode_block_tables::directory, unicode_block_tables::pages);
+            return;
+        }
+
+        for (uint32_t idx = 0; idx < _cipher_count; ++idx)
+        {
+            _slots[idx].cipher->visit([&](const auto& cipher) {
+                assign_codepoints(cipher.glyphs(), static_cast<uint16_t>(idx));
+            });
         }
     }
 
-    UnicodeGlyphCipherIndex(const UnicodeGlyphCipherIndex&) = delete;
-    UnicodeGlyphCipherIndex& operator=(const UnicodeGlyphCipherIndex&) = delete;
-    UnicodeGlyphCipherIndex(UnicodeGlyphCipherIndex&& other) noexcept
-        : glyph_ciphers(std::move(other.glyph_ciphers)),
-          noop_cipher(std::move(other.noop_cipher)),
-          _codepoint_to_glyph_cipher(other._codepoint_to_glyph_cipher)
+    // One cipher per block of unicode_block_tables, each created on first use. The AES key schedule is built here,
+    // once for all blocks, so a bad key fails now rather than on some later lookup.
+    UnicodeGlyphCipherIndex(
+        const std::vector<uint8_t>& key,
+        const std::vector<uint8_t>& tweak,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {}
+    )
+        : noop_cipher(new IndexedGlyphSet("noop", " \n\r")),
+          _codepoint_to_glyph_cipher(
+              CodepointCipherTable::over(unicode_block_tables::directory, unicode_block_tables::pages)),
+          _cipher_count(unicode_block_tables::glyph_sets.size()),
+          _slots(std::make_unique<Slot[]>(_cipher_count)),
+          _create_mutex(std::make_unique<std::mutex>())
     {
-        other._codepoint_to_glyph_cipher = nullptr;
-    }
-    UnicodeGlyphCipherIndex& operator=(UnicodeGlyphCipherIndex&& other) noexcept {
-        if (this != &other) {
-            delete[] _codepoint_to_glyph_cipher;
-            glyph_ciphers = std::move(other.glyph_ciphers);
-            noop_cipher = std::move(other.noop_cipher);
-            _codepoint_to_glyph_cipher = other._codepoint_to_glyph_cipher;
-            other._codepoint_to_glyph_cipher = nullptr;
-        }
-        return *this;
+        _create_cipher = [shared_key = std::make_shared<const FPEKeyContext>(key), tweak, algorithm,
+                          small_domain](const uint16_t id) {
+            return GlyphFPECipher(&unicode_block_tables::glyph_sets[id], shared_key, tweak, algorithm, small_domain);
+        };
+        _glyph_set_name = [](const uint16_t id) { return unicode_block_tables::glyph_sets[id].name(); };
+        _glyph_source = [](const uint16_t id) {
+            return CodepointGlyphTable::GlyphSource{&unicode_block_tables::glyph_sets[id], nullptr};
+        };
     }
-    ~UnicodeGlyphCipherIndex() {
-        delete[] _codepoint_to_glyph_cipher;
+
+    // One cipher per glyph set of a snapshot, each created on first use. The table is read from the mapped file,
+    // which the index keeps open.
+    UnicodeGlyphCipherIndex(
+        std::shared_ptr<const CipherIndexSnapshot> snapshot,
+        const std::vector<uint8_t>& key,
+        const std::vector<uint8_t>& tweak,
+        FPEAlgorithm algorithm = FPEAlgorithm::FF1,
+        SmallDomainTables small_domain = {}
+    )
+        : noop_cipher(new IndexedGlyphSet("noop", " \n\r")),
+          _codepoint_to_glyph_cipher(snapshot->table()),
+          _cipher_count(snapshot->glyph_set_count()),
+          _slots(std::make_unique<Slot[]>(_cipher_count)),
+          _create_mutex(std::make_unique<std::mutex>())
+    {
+        _create_cipher = [snapshot, shared_key = std::make_shared<const FPEKeyContext>(key), tweak, algorithm,
+                          small_domain](const uint16_t id) {
+            return snapshot->create_cipher(id, shared_key, tweak, algorithm, small_domain);
+        };
+        _glyph_set_name = [snapshot](const uint16_t id) { return snapshot->glyph_set_name(id); };
+        _glyph_source = [snapshot](const uint16_t id) { return snapshot->glyph_source(id); };
     }
 
+    UnicodeGlyphCipherIndex(const UnicodeGlyphCipherIndex&) = delete;
+    UnicodeGlyphCipherIndex& operator=(const UnicodeGlyphCipherIndex&) = delete;
+    UnicodeGlyphCipherIndex(UnicodeGlyphCipherIndex&& other) noexcept = default;
+    UnicodeGlyphCipherIndex& operator=(UnicodeGlyphCipherIndex&& other) noexcept = default;
+
     GlyphFPECipher& operator[](uint32_t codepoint) {
-        uint32_t idx = _codepoint_to_glyph_cipher[codepoint];
-        if (idx == UINT32_MAX)
-            return noop_cipher;
-        return glyph_ciphers[idx];
+        const uint16_t id = _codepoint_to_glyph_cipher[codepoint];
+        return id == CodepointCipherTable::NO_CIPHER ? noop_cipher : cipher(id);
     }
     const GlyphFPECipher& operator[](uint32_t codepoint) const {
-        uint32_t idx = _codepoint_to_glyph_cipher[codepoint];
-        if (idx == UINT32_MAX)
-            return noop_cipher;
-        return glyph_ciphers[idx];
+        const uint16_t id = _codepoint_to_glyph_cipher[codepoint];
+        return id == CodepointCipherTable::NO_CIPHER ? noop_cipher : cipher(id);
+    }
+
+    // Position of the cipher for codepoint, or CodepointCipherTable::NO_CIPHER for the noop cipher
+    uint16_t cipher_id(uint32_t codepoint) const noexcept { return _codepoint_to_glyph_cipher[codepoint]; }
+
+    // Number of real ciphers (no noop), created or not
+    size_t cipher_count() const noexcept { return _cipher_count; }
+
+    // The cipher at a position below cipher_count(), created if this is its first use
+    GlyphFPECipher& cipher(const uint16_t id) const {
+        if (GlyphFPECipher* ready = _slots[id].ready.load(std::memory_order_acquire))
+            return *ready;
+        return create(id);
+    }
+
+    bool is_created(const uint16_t id) const noexcept {
+        return _slots[id].ready.load(std::memory_order_acquire) != nullptr;
+    }
+
+    size_t created_count() const noexcept {
+        size_t count = 0;
+        for (size_t id = 0; id < _cipher_count; ++id)
+            count += is_created(static_cast<uint16_t>(id));
+        return count;
+    }
+
+    // Creates the ciphers of the named glyph sets (Unicode block names for the lazy index) ahead of their first use
+    void prewarm(const std::vector<std::string_view>& glyph_set_names) const {
+        for (const auto name : glyph_set_names)
+        {
+            const auto id = find_glyph_set(name);
+            if (!id)
+                throw std::invalid_argument("UnicodeGlyphCipherIndex: unknown glyph set " + std::string(name));
+            cipher(*id);
+        }
+    }
+
+    // Creates the ciphers for every code point of sample, e.g. representative input
+    void prewarm(const std::u32string_view sample) const {
+        for (const char32_t codepoint : sample)
+            (*this)[codepoint];
+    }
+
+    const CodepointCipherTable& table() const noexcept { return _codepoint_to_glyph_cipher; }
+
+    // table() with the glyph index of every code point in its cipher added, for callers that map glyphs themselves
+    // (see UnicodeFPECipher). Built on each call, without creating any cipher.
+    CodepointGlyphTable glyph_table() const {
+        std::vector<CodepointGlyphTable::GlyphSource> sources(_cipher_count);
+        for (size_t id = 0; id < _cipher_count; ++id)
+            sources[id] = glyph_source(static_cast<uint16_t>(id));
+        return CodepointGlyphTable::build(_codepoint_to_glyph_cipher, sources);
     }
 
-    std::vector<GlyphFPECipher> glyph_ciphers; // real ciphers only (no noop)
     GlyphFPECipher noop_cipher;
 
 private:
-    uint32_t* _codepoint_to_glyph_cipher = nullptr; // [0x110000], heap-allocated
+    // A cipher is written once, under the mutex, and then published through ready
+    struct Slot
+    {
+        std::atomic<GlyphFPECipher*> ready{nullptr};
+        std::optional<GlyphFPECipher> cipher;
+
+        GlyphFPECipher& publish(GlyphFPECipher&& created)
+        {
+            cipher.emplace(std::move(created));
+            ready.store(&*cipher, std::memory_order_release);
+            return *cipher;
+        }
+    };
+
+    CodepointCipherTable _codepoint_to_glyph_cipher;
+    size_t _cipher_count = 0;
+    std::unique_ptr<Slot[]> _slots;
+    std::function<GlyphFPECipher(uint16_t)> _create_cipher; // empty when every cipher was handed over
+    std::function<std::string_view(uint16_t)> _glyph_set_name; // likewise
+    std::function<CodepointGlyphTable::GlyphSource(uint16_t)> _glyph_source; // likewise
+    std::unique_ptr<std::mutex> _create_mutex;
+
+    GlyphFPECipher& create(const uint16_t id) const
+    {
+        std::lock_guard lock(*_create_mutex);
+        Slot& slot = _slots[id];
+        if (GlyphFPECipher* ready = slot.ready.load(std::memory_order_relaxed))
+            return *ready;
+        return slot.publish(_create_cipher(id));
+    }
+
+    CodepointGlyphTable::GlyphSource glyph_source(const uint16_t id) const
+    {
+        if (_glyph_source)
+            return _glyph_source(id);
+        const GlyphFPECipher& cipher = *_slots[id].cipher;
+        if (cipher.is_noop())
+            return {};
+        if (const CodepointRangeGlyphSet* range = cipher.codepoint_range())
+            return {range, nullptr};
+        return {nullptr, &cipher.glyphs()};
+    }
+
+    std::optional<uint16_t> find_glyph_set(const std::string_view name) const
+    {
+        for (size_t id = 0; id < _cipher_count; ++id)
+        {
+            const std::string_view set_name = _glyph_set_name ? _glyph_set_name(static_cast<uint16_t>(id))
+                                                              : _slots[id].cipher->getGlyphSetName();
+            if (set_name == name)
+                return static_cast<uint16_t>(id);
+        }
+        return std::nullopt;
+    }
+
+    static bool over_unicode_blocks(const std::vector<GlyphFPECipher>& ciphers)
+    {
+        if (ciphers.size() != unicode_block_tables::glyph_sets.size())
+            return false;
+        for (size_t id = 0; id < ciphers.size(); ++id)
+            if (ciphers[id].codepoint_range() != &unicode_block_tables::glyph_sets[id])
+                return false;
+        return true;
+    }
+
+    void assign_codepoints(const IndexedGlyphSet& codebook, const uint16_t id)
+    {
+        for (unsigned i = 0; i < codebook.size(); ++i)
+        {
+            const uint32_t cp = decode_utf8(codebook.from_index(i));
+            _codepoint_to_glyph_cipher.assign(cp, cp, id);
+        }
+    }
+
+    // Whole pages of a range are mapped at once, so a block costs the same however large it is
+    void assign_codepoints(const CodepointRangeGlyphSet& codebook, const uint16_t id)
+    {
+        constexpr uint32_t surrogate_first = 0xD800;
+        constexpr uint32_t surrogate_last = 0xDFFF;
+        const uint32_t first = codebook.first_codepoint();
+        const uint32_t last = codebook.last_codepoint();
+        if (first < surrogate_first)
+            _codepoint_to_glyph_cipher.assign(first, std::min(last, surrogate_first - 1), id);
+        if (last > surrogate_last)
+            _codepoint_to_glyph_cipher.assign(std::max(first, surrogate_last + 1), last, id);
+    }
 };
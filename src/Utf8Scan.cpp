@@ -0,0 +1,410 @@
+#include "Utf8Scan.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTF8_SCAN_X86 1
+#endif
+
+namespace utf8_scan
+{
+    constexpr uint32_t NOT_VALID = UINT32_MAX;
+
+    static inline bool is_continuation(const unsigned char byte) noexcept
+    {
+        return (byte & 0xC0) == 0x80;
+    }
+
+    // Code point of the sequence at s, of which available bytes exist, and its width; NOT_VALID unless well-formed
+    static inline uint32_t decode_checked(const unsigned char* s, const size_t available, size_t& width) noexcept
+    {
+        const unsigned char lead = s[0];
+        if (lead < 0x80)
+        {
+            width = 1;
+            return lead;
+        }
+        if (lead < 0xC2) // a continuation byte, or the lead of an overlong 2-byte form
+            return NOT_VALID;
+        if (lead < 0xE0)
+        {
+            width = 2;
+            if (available < 2 || !is_continuation(s[1]))
+                return NOT_VALID;
+            return ((lead & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+        }
+        if (lead < 0xF0)
+        {
+            width = 3;
+            if (available < 3 || !is_continuation(s[1]) || !is_continuation(s[2]))
+                return NOT_VALID;
+            const uint32_t cp = ((lead & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+            return cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF) ? NOT_VALID : cp;
+        }
+        if (lead < 0xF5)
+        {
+            width = 4;
+            if (available < 4 || !is_continuation(s[1]) || !is_continuation(s[2]) || !is_continuation(s[3]))
+                return NOT_VALID;
+            const uint32_t cp =
+                ((lead & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) | ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+            return cp < 0x10000 || cp > CodepointGlyphTable::MAX_CODEPOINT ? NOT_VALID : cp;
+        }
+        return NOT_VALID;
+    }
+
+    size_t first_invalid(const std::string_view input) noexcept
+    {
+        const auto* s = reinterpret_cast<const unsigned char*>(input.data());
+        size_t pos = 0;
+        while (pos < input.size())
+        {
+            size_t width;
+            if (decode_checked(s + pos, input.size() - pos, width) == NOT_VALID)
+                return pos;
+            pos += width;
+        }
+        return pos;
+    }
+
+    size_t scan_scalar(
+        const std::string_view input, const CodepointGlyphTable& table, const uint16_t unmapped_id, uint16_t* ids,
+        uint32_t* indexes, size_t* glyph_counts
+    )
+    {
+        const auto* s = reinterpret_cast<const unsigned char*>(input.data());
+        size_t count = 0;
+        size_t pos = 0;
+        while (pos < input.size())
+        {
+            size_t width;
+            const uint32_t cp = decode_checked(s + pos, input.size() - pos, width);
+            if (cp == NOT_VALID)
+                return INVALID;
+            const CodepointGlyphTable::Glyph glyph = table[cp];
+            ids[count] = glyph.cipher == CodepointGlyphTable::NO_CIPHER ? unmapped_id : glyph.cipher;
+            indexes[count] = glyph.index;
+            ++glyph_counts[ids[count]];
+            ++count;
+            pos += width;
+        }
+        return count;
+    }
+
+    // Eight bytes at a time
+    bool is_ascii_scalar(const std::string_view input) noexcept
+    {
+        const char* s = input.data();
+        const size_t size = input.size();
+        uint64_t high_bits = 0;
+        size_t pos = 0;
+        for (; pos + 8 <= size; pos += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, s + pos, 8);
+            high_bits |= word;
+        }
+        for (; pos < size; ++pos)
+            high_bits |= static_cast<unsigned char>(s[pos]);
+        return (high_bits & 0x8080808080808080ull) == 0;
+    }
+
+#ifdef UTF8_SCAN_X86
+
+    bool has_avx2() noexcept
+    {
+        static const bool supported = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+        }();
+        return supported;
+    }
+
+    // Error classes of simdutf's validator. Each table maps a nibble of a byte pair to the classes it allows; a pair is
+    // invalid when the three lookups share a class.
+    constexpr uint8_t TOO_SHORT = 1 << 0;      // 11______ 0_______ or 11______ 11______
+    constexpr uint8_t TOO_LONG = 1 << 1;       // 0_______ 10______
+    constexpr uint8_t OVERLONG_3 = 1 << 2;     // 11100000 100_____
+    constexpr uint8_t TOO_LARGE = 1 << 3;      // 11110100 1001____ and above
+    constexpr uint8_t SURROGATE = 1 << 4;      // 11101101 101_____
+    constexpr uint8_t OVERLONG_2 = 1 << 5;     // 1100000_ 10______
+    constexpr uint8_t TOO_LARGE_1000 = 1 << 6; // 11110101 1000____ and above
+    constexpr uint8_t OVERLONG_4 = 1 << 6;     // 11110000 1000____
+    constexpr uint8_t TWO_CONTS = 1 << 7;      // 10______ 10______
+    constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    __attribute__((target("avx2"))) static inline __m256i nibble_table(
+        const uint8_t t0, const uint8_t t1, const uint8_t t2, const uint8_t t3, const uint8_t t4, const uint8_t t5,
+        const uint8_t t6, const uint8_t t7, const uint8_t t8, const uint8_t t9, const uint8_t t10, const uint8_t t11,
+        const uint8_t t12, const uint8_t t13, const uint8_t t14, const uint8_t t15
+    )
+    {
+        return _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            static_cast<char>(t0), static_cast<char>(t1), static_cast<char>(t2), static_cast<char>(t3),
+            static_cast<char>(t4), static_cast<char>(t5), static_cast<char>(t6), static_cast<char>(t7),
+            static_cast<char>(t8), static_cast<char>(t9), static_cast<char>(t10), static_cast<char>(t11),
+            static_cast<char>(t12), static_cast<char>(t13), static_cast<char>(t14), static_cast<char>(t15)
+        ));
+    }
+
+    // The bytes of input shifted back by N, the first N taken from the end of previous
+    template <int N>
+    __attribute__((target("avx2"))) static inline __m256i prev(const __m256i input, const __m256i previous)
+    {
+        return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);
+    }
+
+    struct Validator
+    {
+        __m256i byte_1_high;
+        __m256i byte_1_low;
+        __m256i byte_2_high;
+
+        __attribute__((target("avx2"))) Validator()
+            : byte_1_high(nibble_table(
+                  // 0_______ ________: ASCII first
+                  TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                  // 10______ ________: continuation first
+                  TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+                  // 1100____, 1101____: 2-byte lead first
+                  TOO_SHORT | OVERLONG_2, TOO_SHORT,
+                  // 1110____: 3-byte lead first
+                  TOO_SHORT | OVERLONG_3 | SURROGATE,
+                  // 1111____: 4-byte lead first
+                  TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4))
+            , byte_1_low(nibble_table(
+                  CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, // ____0000
+                  CARRY | OVERLONG_2,                           // ____0001
+                  CARRY, CARRY,                                 // ____001_
+                  CARRY | TOO_LARGE,                            // ____0100
+                  CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____0101
+                  CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                  CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                  CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                  CARRY | TOO_LARGE | TOO_LARGE_1000,
+                  CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, // ____1101
+                  CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000))
+            , byte_2_high(nibble_table(
+                  // ________ 0_______: ASCII second
+                  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                  // ________ 1000____
+                  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                  // ________ 1001____
+                  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                  // ________ 101_____
+                  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                  // ________ 11______: lead second
+                  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT))
+        {
+        }
+
+        // Nonzero lanes where input, read after previous, is not well-formed
+        __attribute__((target("avx2"))) __m256i errors(const __m256i input, const __m256i previous) const
+        {
+            const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+            const __m256i prev1 = prev<1>(input, previous);
+            const __m256i special = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+                    _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, low_nibble))
+                ),
+                _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble))
+            );
+
+            // Third and fourth bytes of 3- and 4-byte sequences must be continuations, which the pair check above
+            // sees as TWO_CONTS; elsewhere TWO_CONTS is an error
+            const __m256i third = _mm256_subs_epu8(prev<2>(input, previous), _mm256_set1_epi8(0xE0 - 0x80));
+            const __m256i fourth =
+                _mm256_subs_epu8(prev<3>(input, previous), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+            const __m256i must_continue =
+                _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+            return _mm256_xor_si256(must_continue, special);
+        }
+    };
+
+    // Code point of the sequence at s without any checks: the validator rejects whatever is wrong with it
+    static inline uint32_t decode_unchecked(const unsigned char* s, const size_t width) noexcept
+    {
+        switch (width)
+        {
+        case 1:
+            return s[0];
+        case 2:
+            return ((s[0] & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+        case 3:
+            return ((s[0] & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+        default:
+            return ((s[0] & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) | ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+        }
+    }
+
+    __attribute__((target("avx2"))) size_t scan_avx2(
+        const std::string_view input, const CodepointGlyphTable& table, const uint16_t unmapped_id, uint16_t* ids,
+        uint32_t* indexes, size_t* glyph_counts
+    )
+    {
+        const auto* s = reinterpret_cast<const unsigned char*>(input.data());
+        const size_t size = input.size();
+        const Validator validator;
+
+        // Where one cipher takes all of ASCII with one base, as the Basic Latin block does, an ASCII block's ids are a
+        // fill and its indexes its bytes less the base
+        const uint16_t* latin_ids = table.page_ids(0);
+        const uint32_t* latin_bases = table.page_bases(0);
+        const bool ascii_uniform =
+            std::all_of(latin_ids, latin_ids + 0x80, [&](const uint16_t id) { return id == latin_ids[0]; }) &&
+            std::all_of(latin_bases, latin_bases + 0x80, [&](const uint32_t base) { return base == latin_bases[0]; });
+        const uint16_t ascii_id = !ascii_uniform ? CodepointGlyphTable::NO_CIPHER
+                                  : latin_ids[0] == CodepointGlyphTable::NO_CIPHER ? unmapped_id
+                                                                                   : latin_ids[0];
+
+        // Glyphs are counted per run of one cipher, which keeps glyph_counts out of the loop's dependency chain
+        uint16_t run_id = unmapped_id;
+        size_t run_glyphs = 0;
+        auto start_run = [&](const uint16_t id) {
+            if (id != run_id)
+            {
+                glyph_counts[run_id] += run_glyphs;
+                run_id = id;
+                run_glyphs = 0;
+            }
+        };
+        auto emit = [&](const CodepointGlyphTable::Glyph glyph, size_t& count) {
+            const uint16_t id = glyph.cipher == CodepointGlyphTable::NO_CIPHER ? unmapped_id : glyph.cipher;
+            ids[count] = id;
+            indexes[count] = glyph.index;
+            ++count;
+            start_run(id);
+            ++run_glyphs;
+        };
+
+        __m256i previous = _mm256_setzero_si256();
+        __m256i errors = _mm256_setzero_si256();
+        size_t count = 0;
+        size_t pos = 0;
+        for (size_t block = 0; block < size; block += 32)
+        {
+            __m256i bytes;
+            if (block + 32 <= size)
+            {
+                bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + block));
+            }
+            else
+            {
+                alignas(32) unsigned char tail[32] = {};
+                std::memcpy(tail, s + block, size - block);
+                bytes = _mm256_load_si256(reinterpret_cast<const __m256i*>(tail));
+            }
+            errors = _mm256_or_si256(errors, validator.errors(bytes, previous));
+            previous = bytes;
+            if (!_mm256_testz_si256(errors, errors))
+                return INVALID;
+
+            // Glyphs that start in this block. The last may run into the next block, which is validated next.
+            const size_t end = std::min(block + 32, size);
+            if (pos == block && _mm256_movemask_epi8(bytes) == 0)
+            {
+                if (ascii_id != CodepointGlyphTable::NO_CIPHER && end - pos == 32)
+                {
+                    const __m256i fill = _mm256_set1_epi16(static_cast<short>(ascii_id));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ids + count), fill);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ids + count + 16), fill);
+                    const __m256i base = _mm256_set1_epi32(static_cast<int>(latin_bases[0]));
+                    for (size_t quarter = 0; quarter < 32; quarter += 8)
+                    {
+                        const __m128i eight = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + pos + quarter));
+                        _mm256_storeu_si256(
+                            reinterpret_cast<__m256i*>(indexes + count + quarter),
+                            _mm256_sub_epi32(_mm256_cvtepu8_epi32(eight), base)
+                        );
+                    }
+                    count += 32;
+                    pos += 32;
+                    start_run(ascii_id);
+                    run_glyphs += 32;
+                    continue;
+                }
+                for (; pos < end; ++pos)
+                    emit({latin_ids[s[pos]], s[pos] - latin_bases[s[pos]]}, count);
+                continue;
+            }
+            while (pos < end)
+            {
+                const size_t glyph_width = width(s[pos]);
+                if (glyph_width > size - pos)
+                    return INVALID;
+                emit(table[decode_unchecked(s + pos, glyph_width)], count);
+                pos += glyph_width;
+            }
+        }
+        glyph_counts[run_id] += run_glyphs;
+
+        // A sequence cut off by the end of input fails against a block of zeros
+        errors = _mm256_or_si256(errors, validator.errors(_mm256_setzero_si256(), previous));
+        return _mm256_testz_si256(errors, errors) ? count : INVALID;
+    }
+
+    // 128 bytes per iteration, ORed together so that one test covers them all
+    __attribute__((target("avx2"))) bool is_ascii_avx2(const std::string_view input) noexcept
+    {
+        const char* s = input.data();
+        const size_t size = input.size();
+        size_t pos = 0;
+        for (; pos + 128 <= size; pos += 128)
+        {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos + 32));
+            const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos + 64));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos + 96));
+            if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d))) != 0)
+                return false;
+        }
+        for (; pos + 32 <= size; pos += 32)
+        {
+            if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos))) != 0)
+                return false;
+        }
+        return is_ascii_scalar(input.substr(pos));
+    }
+
+#else
+
+    bool has_avx2() noexcept
+    {
+        return false;
+    }
+
+    bool is_ascii_avx2(const std::string_view input) noexcept
+    {
+        return is_ascii_scalar(input);
+    }
+
+    size_t scan_avx2(
+        const std::string_view input, const CodepointGlyphTable& table, const uint16_t unmapped_id, uint16_t* ids,
+        uint32_t* indexes, size_t* glyph_counts
+    )
+    {
+        return scan_scalar(input, table, unmapped_id, ids, indexes, glyph_counts);
+    }
+
+#endif
+
+    size_t scan(
+        const std::string_view input, const CodepointGlyphTable& table, const uint16_t unmapped_id, uint16_t* ids,
+        uint32_t* indexes, size_t* glyph_counts
+    )
+    {
+        static const bool use_avx2 = has_avx2();
+        return use_avx2 ? scan_avx2(input, table, unmapped_id, ids, indexes, glyph_counts)
+                        : scan_scalar(input, table, unmapped_id, ids, indexes, glyph_counts);
+    }
+
+    bool is_ascii(const std::string_view input) noexcept
+    {
+        static const bool use_avx2 = has_avx2();
+        return use_avx2 ? is_ascii_avx2(input) : is_ascii_scalar(input);
+    }
+}
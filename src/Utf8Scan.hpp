@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "CodepointGlyphTable.hpp"
+
+// Validation, decoding and cipher dispatch of UTF-8 input in a single pass, the first step of every UnicodeFPECipher
+// call: what leaves it is glyph indexes, ready for the ciphers.
+//
+// The AVX2 scan checks 32 bytes per iteration with simdutf's lookup-table validator (Keiser and Lemire, "Validating
+// UTF-8 In Less Than One Instruction Per Byte") and decodes each block while it is still in L1; ASCII blocks skip the
+// decoding. The scalar scan validates each sequence as it decodes it. Both give identical results, picked once from
+// CPUID.
+namespace utf8_scan
+{
+    // What scan() returns for input that is not well-formed UTF-8
+    constexpr size_t INVALID = SIZE_MAX;
+
+    // Writes the cipher id and glyph index of every glyph of input, as table[code point] gives them, to ids and
+    // indexes, which have room for input.size() each; unmapped_id stands in where the table has no cipher, with an
+    // unspecified index. glyph_counts[id] grows by one for each glyph, so it needs unmapped_id + 1 entries. Returns
+    // the number of glyphs, or INVALID if input holds an overlong form, a surrogate, a code point past U+10FFFF or a
+    // broken or truncated sequence; ids, indexes and glyph_counts are then unspecified.
+    size_t scan(
+        std::string_view input, const CodepointGlyphTable& table, uint16_t unmapped_id, uint16_t* ids,
+        uint32_t* indexes, size_t* glyph_counts
+    );
+
+    // Position of the first byte of input that does not start or continue a well-formed sequence, else input.size()
+    size_t first_invalid(std::string_view input) noexcept;
+
+    // True when every byte of input is ASCII, which makes it well-formed with one glyph per byte
+    bool is_ascii(std::string_view input) noexcept;
+
+    // Width of the sequence a lead byte of well-formed UTF-8 starts
+    constexpr size_t width(const unsigned char lead) noexcept
+    {
+        return lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    }
+
+    // True when this CPU runs the AVX2 scan
+    bool has_avx2() noexcept;
+
+    // Explicit variants for tests and benchmarks. Only call the _avx2 ones when has_avx2().
+    size_t scan_scalar(
+        std::string_view input, const CodepointGlyphTable& table, uint16_t unmapped_id, uint16_t* ids,
+        uint32_t* indexes, size_t* glyph_counts
+    );
+    size_t scan_avx2(
+        std::string_view input, const CodepointGlyphTable& table, uint16_t unmapped_id, uint16_t* ids,
+        uint32_t* indexes, size_t* glyph_counts
+    );
+    bool is_ascii_scalar(std::string_view input) noexcept;
+    bool is_ascii_avx2(std::string_view input) noexcept;
+}
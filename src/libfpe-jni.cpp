@@ -9,6 +9,21 @@ extern "C" {
         return (jlong)unicodefpe_create();
     }
 
+    JNIEXPORT jlong JNICALL Java_net_todorovich_fpe_jdbc_UnicodeFPECipherJNI_createFromSnapshot(
+        JNIEnv* env, jobject obj, jstring path)
+    {
+        if (!path) return 0;
+
+        const char* pathChars = env->GetStringUTFChars(path, NULL);
+        if (!pathChars) return 0;
+
+        jlong handle = (jlong)unicodefpe_create_from_snapshot(pathChars);
+
+        env->ReleaseStringUTFChars(path, pathChars);
+
+        return handle;
+    }
+
     JNIEXPORT jint JNICALL Java_net_todorovich_fpe_jdbc_UnicodeFPECipherJNI_encrypt(
         JNIEnv* env, jobject obj, jlong handle,
         jbyteArray input, jint inputLen,
@@ -9,6 +9,9 @@ extern "C" {
 
     JNIEXPORT jlong JNICALL Java_net_todorovich_fpe_jdbc_UnicodeFPECipherJNI_create(JNIEnv* env, jobject obj);
 
+    JNIEXPORT jlong JNICALL Java_net_todorovich_fpe_jdbc_UnicodeFPECipherJNI_createFromSnapshot(
+        JNIEnv* env, jobject obj, jstring path);
+
     JNIEXPORT jint JNICALL Java_net_todorovich_fpe_jdbc_UnicodeFPECipherJNI_encrypt(
         JNIEnv* env, jobject obj, jlong handle,
         jbyteArray input, jint inputLen,
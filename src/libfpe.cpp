@@ -1,25 +1,52 @@
 #include "libfpe.hpp"
+#include "CipherIndexSnapshot.hpp"
 #include "UnicodeFPECipher.hpp"
-#include "PreconfiguredIndexedGlyphSet.hpp"
-#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <new>
+#include <span>
 #include <stdexcept>
+#include <string>
 
 std::vector<uint8_t> test_key(16, 0x00);
 std::vector<uint8_t> test_tweak(4, 0x00);
 
+namespace {
+    // One mapping per snapshot path while any handle uses it
+    std::shared_ptr<const CipherIndexSnapshot> open_shared_snapshot(const std::string& path)
+    {
+        static std::mutex mutex;
+        static std::map<std::string, std::weak_ptr<const CipherIndexSnapshot>> open_snapshots;
+
+        std::lock_guard lock(mutex);
+        auto& open = open_snapshots[path];
+        if (auto snapshot = open.lock())
+            return snapshot;
+        auto snapshot = CipherIndexSnapshot::open(path);
+        open = snapshot;
+        return snapshot;
+    }
+}
+
 extern "C"
 {
     // Create a cipher covering all Unicode
     UnicodeFPECipherHandle unicodefpe_create() {
         try {
-            return new UnicodeFPECipher(
-                UnicodeGlyphCipherIndex(
-                    PreconfiguredIndexedGlyphSet::buildUnicodeGlyphCiphers(test_key, test_tweak),
-                    test_key,
-                    test_tweak
-                )
-            );
+            // Block ciphers are created as input reaches them
+            return new UnicodeFPECipher(UnicodeGlyphCipherIndex(test_key, test_tweak));
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    UnicodeFPECipherHandle unicodefpe_create_from_snapshot(const char* path) {
+        if (!path) return nullptr;
+        try {
+            return new UnicodeFPECipher(UnicodeGlyphCipherIndex(open_shared_snapshot(path), test_key, test_tweak));
         }
         catch (...)
         {
@@ -27,6 +54,18 @@ extern "C"
         }
     }
 
+    int unicodefpe_write_snapshot(const char* path) {
+        if (!path) return 1;
+        try {
+            CipherIndexSnapshot::write(path, UnicodeGlyphCipherIndex(test_key, test_tweak));
+            return 0;
+        }
+        catch (...)
+        {
+            return 3;
+        }
+    }
+
     // Encrypt UTF-8 input, write to output buffer (must be preallocated).
     // Returns 0 on success, nonzero on error.
     int unicodefpe_encrypt(
@@ -39,10 +78,12 @@ extern "C"
         try
         {
             UnicodeFPECipher* cipher = static_cast<UnicodeFPECipher*>(handle);
-            std::string result = cipher->encrypt(std::string_view(input, input_len));
-            if (result.size() >= output_capacity) return 2; // Not enough room
-            std::memcpy(output, result.data(), result.size());
-            output[result.size()] = 0; // null-terminate
+            if (input_len >= output_capacity) return 2; // Not enough room; output is as long as input
+            cipher->encrypt_into(
+                std::string_view(input, input_len), std::span<char>(output, input_len),
+                UnicodeFPECipher::thread_context()
+            );
+            output[input_len] = 0; // null-terminate
             return 0;
         }
         catch (...)
@@ -61,10 +102,12 @@ extern "C"
         if (!handle || !input || !output) return 1;
         try {
             UnicodeFPECipher* cipher = static_cast<UnicodeFPECipher*>(handle);
-            std::string result = cipher->decrypt(std::string_view(input, input_len));
-            if (result.size() >= output_capacity) return 2; // Not enough room
-            std::memcpy(output, result.data(), result.size());
-            output[result.size()] = 0; // null-terminate
+            if (input_len >= output_capacity) return 2; // Not enough room; output is as long as input
+            cipher->decrypt_into(
+                std::string_view(input, input_len), std::span<char>(output, input_len),
+                UnicodeFPECipher::thread_context()
+            );
+            output[input_len] = 0; // null-terminate
             return 0;
         } catch (...) {
             return 3;
@@ -11,6 +11,14 @@ extern "C" {
     // Create a cipher that covers all Unicode
     UnicodeFPECipherHandle unicodefpe_create();
 
+    // Create a cipher over a snapshot file written by unicodefpe_write_snapshot. Handles created from the same path
+    // share one read-only mapping of it. Returns NULL if the file is missing or invalid.
+    UnicodeFPECipherHandle unicodefpe_create_from_snapshot(const char* path);
+
+    // Write the glyph sets and code point table of the cipher unicodefpe_create builds to path, without any key
+    // material. Returns 0 on success.
+    int unicodefpe_write_snapshot(const char* path);
+
     // Encrypt: input/output are UTF-8 strings. Returns 0 on success.
     int unicodefpe_encrypt(
         UnicodeFPECipherHandle handle,
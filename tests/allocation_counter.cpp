@@ -0,0 +1,46 @@
+#include "allocation_counter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local size_t allocations = 0;
+}
+
+size_t thread_allocation_count() noexcept
+{
+    return allocations;
+}
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
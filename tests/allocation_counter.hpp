@@ -0,0 +1,6 @@
+#pragma once
+#include <cstddef>
+
+// Number of global operator new calls made by the current thread so far. Counting is done by the replacement
+// operator new/delete in allocation_counter.cpp, which is linked into encryption_test.
+size_t thread_allocation_count() noexcept;
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+inline std::vector<uint8_t> fixed_key_128() {
+    return std::vector<uint8_t>{
+        0x00, 0x11, 0x22, 0x33,
+        0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xAA, 0xBB,
+        0xCC, 0xDD, 0xEE, 0xFF
+    };
+}
+
+inline std::vector<uint8_t> from_hex(const std::string& hex) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        bytes.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+    return bytes;
+}
+
+// Words of two or more characters from the data/ word list, resolved relative to the test working directory
+inline std::vector<std::string> load_word_list() {
+    std::filesystem::path path = std::filesystem::current_path() / ".." / "data" / "google-10000-english.txt";
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Missing word list: " + path.string());
+
+    std::vector<std::string> words;
+    std::string word;
+    while (std::getline(in, word)) {
+        if (word.size() > 1) words.push_back(word);
+    }
+    return words;
+}
+
+// The word list as radix-26 digits ('a' -> 0 ... 'z' -> 25)
+inline std::vector<std::vector<uint32_t>> load_words_as_digits() {
+    std::vector<std::vector<uint32_t>> inputs;
+    for (const auto& word : load_word_list()) {
+        std::vector<uint32_t> digits;
+        digits.reserve(word.size());
+        for (char c : word) {
+            if (c < 'a' || c > 'z') throw std::runtime_error("Invalid character in word");
+            digits.push_back(static_cast<uint32_t>(c - 'a'));
+        }
+        inputs.push_back(std::move(digits));
+    }
+    return inputs;
+}
@@ -0,0 +1,128 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "AesPrf.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> sequential_bytes(const size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (size_t i = 0; i < size; ++i)
+        bytes[i] = static_cast<uint8_t>(i);
+    return bytes;
+}
+
+static std::vector<uint8_t> from_hex(const std::string& hex) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < hex.size(); i += 2)
+        bytes.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+    return bytes;
+}
+
+static const AesPrf::Backend BACKENDS[] = {AesPrf::Backend::Portable, AesPrf::Backend::AesNi, AesPrf::Backend::Vaes};
+
+TEST_CASE("AesPrf matches the FIPS 197 example vectors on every backend", "[AesPrf]") {
+    // FIPS 197, Appendix C
+    const auto plaintext = from_hex("00112233445566778899aabbccddeeff");
+    const std::pair<size_t, std::string> vectors[] = {
+        {16, "69c4e0d86a7b0430d8cdb78070b4c55a"},
+        {24, "dda97ca4864cdfe06eaf70a0ec0d7191"},
+        {32, "8ea2b7ca516745bfeafc49904b496089"},
+    };
+
+    for (const auto& [key_size, expected] : vectors) {
+        const AesPrf prf(sequential_bytes(key_size));
+
+        std::vector<uint8_t> block = plaintext;
+        prf.encrypt(block.data(), block.data());
+        INFO("key bytes=" << key_size);
+        REQUIRE(block == from_hex(expected));
+
+        for (const auto backend : BACKENDS) {
+            if (!AesPrf::supported(backend))
+                continue;
+            std::vector<uint8_t> out(16);
+            prf.encrypt_blocks(backend, plaintext.data(), out.data(), 1);
+            INFO("backend=" << static_cast<int>(backend));
+            REQUIRE(out == from_hex(expected));
+        }
+    }
+}
+
+TEST_CASE("AesPrf backends agree for every block count", "[AesPrf]") {
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    for (const size_t key_size : {16, 24, 32}) {
+        std::vector<uint8_t> key(key_size);
+        for (auto& b : key) b = static_cast<uint8_t>(byte(rng));
+        const AesPrf prf(key);
+
+        for (size_t blocks = 0; blocks <= 40; ++blocks) {
+            std::vector<uint8_t> in(blocks * 16);
+            for (auto& b : in) b = static_cast<uint8_t>(byte(rng));
+
+            std::vector<uint8_t> expected(in.size());
+            prf.encrypt_blocks(AesPrf::Backend::Portable, in.data(), expected.data(), blocks);
+
+            for (const auto backend : BACKENDS) {
+                if (!AesPrf::supported(backend))
+                    continue;
+                INFO("key bytes=" << key_size << " blocks=" << blocks << " backend=" << static_cast<int>(backend));
+
+                // One spare block past the end must come back untouched
+                std::vector<uint8_t> out(in.size() + 16, 0xA5);
+                prf.encrypt_blocks(backend, in.data(), out.data(), blocks);
+                REQUIRE(std::equal(expected.begin(), expected.end(), out.begin()));
+                REQUIRE(std::all_of(out.end() - 16, out.end(), [](const uint8_t b) { return b == 0xA5; }));
+
+                std::vector<uint8_t> in_place = in;
+                prf.encrypt_blocks(backend, in_place.data(), in_place.data(), blocks);
+                REQUIRE(in_place == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("AesPrf rejects invalid keys and unsupported backends", "[AesPrf]") {
+    REQUIRE_THROWS_AS(AesPrf(std::vector<uint8_t>(15)), std::invalid_argument);
+    REQUIRE_THROWS_AS(AesPrf(std::vector<uint8_t>(20)), std::invalid_argument);
+    REQUIRE_THROWS_AS(AesPrf(std::vector<uint8_t>{}), std::invalid_argument);
+
+    REQUIRE(AesPrf::supported(AesPrf::Backend::Portable));
+    REQUIRE(AesPrf::supported(AesPrf::active_backend()));
+
+    const AesPrf prf(sequential_bytes(32));
+    uint8_t block[16] = {};
+    for (const auto backend : BACKENDS) {
+        if (!AesPrf::supported(backend))
+            REQUIRE_THROWS_AS(prf.encrypt_blocks(backend, block, block, 1), std::invalid_argument);
+    }
+}
+
+TEST_CASE("AesPrf backend performance benchmark", "[AesPrf][performance]") {
+    const AesPrf prf(sequential_bytes(32));
+    constexpr size_t blocks = 8; // one FF1 batch
+    constexpr int iterations = 200'000;
+    std::vector<uint8_t> buffer(blocks * 16, 0x3C);
+
+    for (const auto backend : BACKENDS) {
+        if (!AesPrf::supported(backend))
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            prf.encrypt_blocks(backend, buffer.data(), buffer.data(), blocks);
+        auto end = std::chrono::steady_clock::now();
+
+        const double ns_per_block =
+            std::chrono::duration<double, std::nano>(end - start).count() / (double(iterations) * blocks);
+        std::cout << "[benchmark] AES-256 backend " << static_cast<int>(backend) << ": " << ns_per_block
+                  << " ns/block over " << blocks << "-block batches" << std::endl;
+        CHECK(ns_per_block < 10'000);
+    }
+}
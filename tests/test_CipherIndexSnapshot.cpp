@@ -0,0 +1,181 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "CipherIndexSnapshot.hpp"
+#include "CodepointRangeGlyphSet.hpp"
+#include "PreconfiguredIndexedGlyphSet.hpp"
+#include "UnicodeFPECipher.hpp"
+#include "UnicodeGlyphCipherIndex.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "codebook_helpers.hpp"
+
+static std::string snapshot_path(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("fpe_snapshot_" + name + ".bin")).string();
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+static void write_file(const std::string& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+TEST_CASE("CipherIndexSnapshot round-trips a mix of indexed and code point range glyph sets", "[CipherIndexSnapshot]") {
+    const std::vector<uint8_t> key = {0x5A, 0xC3, 0x17, 0x8E, 0x21, 0x9B, 0x44, 0xF0,
+                                      0x0D, 0x66, 0xB2, 0x7C, 0xE9, 0x38, 0x95, 0x4F};
+    const std::vector<uint8_t> tweak(8, 0x24);
+
+    const CodepointRangeGlyphSet cyrillic("cyrillic", 0x0400, 0x04FF);
+    const CodepointRangeGlyphSet greek("greek", 0x0370, 0x03FF);
+    auto kana = codebook_from_cps({0x3042, 0x3044, 0x3046, 0x3048, 0x304A, 0x304B, 0x304D});
+    auto marks = codebook_from_cps({0x00BF, 0x00A1});
+
+    const auto shared_key = std::make_shared<const FPEKeyContext>(key);
+    auto ciphers = PreconfiguredIndexedGlyphSet::buildAsciiGlyphCiphers(key, tweak);
+    ciphers.emplace_back(&cyrillic, shared_key, tweak);
+    ciphers.emplace_back(&greek, shared_key, tweak);
+    ciphers.emplace_back(&kana, shared_key, tweak);
+    ciphers.emplace_back(GlyphFPECipher(&marks)); // noop
+    UnicodeGlyphCipherIndex built_index(std::move(ciphers), key, tweak);
+
+    const std::string path = snapshot_path("mixed");
+    CipherIndexSnapshot::write(path, built_index);
+
+    // Nothing of the key reaches the file
+    const std::string bytes = read_file(path);
+    const std::string key_bytes(key.begin(), key.end());
+    REQUIRE(bytes.find(key_bytes) == std::string::npos);
+    REQUIRE(bytes.find(key_bytes.substr(0, 8)) == std::string::npos);
+
+    const auto snapshot = CipherIndexSnapshot::open(path);
+    REQUIRE(snapshot->file_size() == bytes.size());
+    REQUIRE(snapshot->glyph_set_count() == built_index.cipher_count());
+    REQUIRE(snapshot->glyph_set_name(5) == "cyrillic");
+    REQUIRE_THROWS_AS(snapshot->glyph_set_name(100), std::out_of_range);
+
+    UnicodeGlyphCipherIndex loaded_index(snapshot, key, tweak);
+    REQUIRE(loaded_index.created_count() == 0);
+    REQUIRE_FALSE(loaded_index.table().owns_pages());
+    REQUIRE(std::ranges::equal(loaded_index.table().pages(), built_index.table().pages()));
+    REQUIRE(loaded_index[0x00BF].is_noop());
+    REQUIRE(loaded_index[0x3042].glyphs().index_strategy() == built_index[0x3042].glyphs().index_strategy());
+
+    UnicodeFPECipher built{std::move(built_index)};
+    UnicodeFPECipher loaded{std::move(loaded_index)};
+    const std::vector<std::string> inputs = {"Hello, World 42!", "Привет, κόσμε", "あいうえお かき", "¿Que? ¡Si!"};
+    for (const auto& input : inputs) {
+        const auto encrypted = loaded.encrypt(input);
+        REQUIRE(encrypted == built.encrypt(input));
+        REQUIRE(loaded.decrypt(encrypted) == input);
+    }
+
+    // Another key over the same file gives another cipher
+    UnicodeFPECipher other_key{UnicodeGlyphCipherIndex(snapshot, std::vector<uint8_t>(16, 0x01), tweak)};
+    REQUIRE(other_key.encrypt(inputs[0]) != loaded.encrypt(inputs[0]));
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("CipherIndexSnapshot of the Unicode blocks matches the compile-time tables", "[CipherIndexSnapshot]") {
+    const std::vector<uint8_t> key(16, 0x31);
+    const std::vector<uint8_t> tweak(8, 0x32);
+
+    const std::string path = snapshot_path("blocks");
+    UnicodeGlyphCipherIndex blocks(key, tweak);
+    CipherIndexSnapshot::write(path, blocks);
+
+    const auto start = std::chrono::steady_clock::now();
+    UnicodeGlyphCipherIndex loaded(CipherIndexSnapshot::open(path), key, tweak);
+    const auto end = std::chrono::steady_clock::now();
+
+    REQUIRE(loaded.cipher_count() == blocks.cipher_count());
+    REQUIRE(std::ranges::equal(loaded.table().directory(), blocks.table().directory()));
+    REQUIRE(std::ranges::equal(loaded.table().pages(), blocks.table().pages()));
+
+    loaded.prewarm({"Cyrillic", "CJK Unified Ideographs"});
+    REQUIRE(loaded.created_count() == 2);
+    REQUIRE(loaded[0x0416].encrypt("Привет") == blocks[0x0416].encrypt("Привет"));
+    REQUIRE(loaded[0x4E2D].encrypt("中文字符") == blocks[0x4E2D].encrypt("中文字符"));
+
+    std::filesystem::remove(path);
+    std::cout << "[benchmark] CipherIndexSnapshot opened and indexed in "
+              << std::chrono::duration<double, std::micro>(end - start).count() << " us" << std::endl;
+    CHECK(std::chrono::duration<double, std::milli>(end - start).count() < 5.0);
+}
+
+TEST_CASE("CipherIndexSnapshot writers racing on one path leave one whole file", "[CipherIndexSnapshot]") {
+    const std::vector<uint8_t> key(16, 0x41);
+    const std::vector<uint8_t> tweak(8, 0x42);
+    const UnicodeGlyphCipherIndex index(PreconfiguredIndexedGlyphSet::buildAsciiGlyphCiphers(key, tweak), key, tweak);
+
+    const auto directory = std::filesystem::temp_directory_path() / "fpe_snapshot_race";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    const std::string path = (directory / "index.bin").string();
+
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 8; ++i)
+        writers.emplace_back([&] {
+            for (int round = 0; round < 4; ++round)
+                CipherIndexSnapshot::write(path, index);
+        });
+    for (auto& writer : writers)
+        writer.join();
+
+    // Every temporary was renamed away, and what is left is readable by other processes
+    REQUIRE(std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator()) == 1);
+    const auto permissions = std::filesystem::status(path).permissions();
+    REQUIRE((permissions & std::filesystem::perms::others_read) != std::filesystem::perms::none);
+    REQUIRE(CipherIndexSnapshot::open(path)->glyph_set_count() == index.cipher_count());
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("CipherIndexSnapshot rejects missing, foreign and corrupt files", "[CipherIndexSnapshot]") {
+    const std::vector<uint8_t> key(16, 0x41);
+    const std::vector<uint8_t> tweak(8, 0x42);
+
+    const std::string path = snapshot_path("corrupt");
+    CipherIndexSnapshot::write(path, UnicodeGlyphCipherIndex(key, tweak));
+    const std::string good = read_file(path);
+    REQUIRE_NOTHROW(CipherIndexSnapshot::open(path));
+
+    REQUIRE_THROWS_AS(CipherIndexSnapshot::open(snapshot_path("does_not_exist")), std::runtime_error);
+
+    write_file(path, "not a snapshot");
+    REQUIRE_THROWS_AS(CipherIndexSnapshot::open(path), std::runtime_error);
+
+    write_file(path, good.substr(0, good.size() - 1));
+    REQUIRE_THROWS_AS(CipherIndexSnapshot::open(path), std::runtime_error);
+
+    std::string bad_magic = good;
+    bad_magic[0] = 'X';
+    write_file(path, bad_magic);
+    REQUIRE_THROWS_AS(CipherIndexSnapshot::open(path), std::runtime_error);
+
+    std::string bad_version = good;
+    bad_version[8] = static_cast<char>(CipherIndexSnapshot::VERSION + 1);
+    write_file(path, bad_version);
+    REQUIRE_THROWS_AS(CipherIndexSnapshot::open(path), std::runtime_error);
+
+    // One flipped bit anywhere past the header fails the checksum
+    for (const size_t at : {good.size() / 3, good.size() / 2, good.size() - 1}) {
+        std::string flipped = good;
+        flipped[at] ^= 0x10;
+        write_file(path, flipped);
+        REQUIRE_THROWS_AS(CipherIndexSnapshot::open(path), std::runtime_error);
+    }
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,89 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "CodepointRangeGlyphSet.hpp"
+#include "GlyphFPECipher.hpp"
+#include "IndexedGlyphSet.hpp"
+#include "PreconfiguredIndexedGlyphSet.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+static std::string materialize(const uint32_t first, const uint32_t last) {
+    std::string glyphs;
+    for (uint32_t cp = first; cp <= last; ++cp) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+        PreconfiguredIndexedGlyphSet::encode_utf8(cp, glyphs);
+    }
+    return glyphs;
+}
+
+TEST_CASE("CodepointRangeGlyphSet numbers glyphs like an IndexedGlyphSet", "[CodepointRangeGlyphSet]") {
+    const std::pair<uint32_t, uint32_t> ranges[] = {
+        {0x20, 0x7E},       // 1 byte
+        {0x0370, 0x03FF},   // 2 bytes
+        {0xD000, 0xE0FF},   // 3 bytes, across the surrogate hole
+        {0xDC00, 0xE00F},   // 3 bytes, starting inside the hole
+        {0x1F600, 0x1F64F}, // 4 bytes
+    };
+
+    for (const auto& [first, last] : ranges) {
+        INFO("range " << first << ".." << last);
+        CodepointRangeGlyphSet range("range", first, last);
+        IndexedGlyphSet indexed("indexed", materialize(first, last));
+
+        REQUIRE(range.size() == indexed.size());
+        REQUIRE(range.glyph_size() == indexed.glyph_size());
+        for (unsigned i = 0; i < range.size(); ++i) {
+            REQUIRE(range.from_index(i) == indexed.from_index(i));
+            REQUIRE(range.find_index(indexed.from_index(i)) == i);
+        }
+    }
+}
+
+TEST_CASE("CodepointRangeGlyphSet rejects glyphs outside the range", "[CodepointRangeGlyphSet]") {
+    CodepointRangeGlyphSet greek("greek", 0x0370, 0x03FF);
+
+    REQUIRE(greek.find_index("\xCE\xB1") == 0x3B1 - 0x370);                    // α
+    REQUIRE(greek.find_index("\xD0\x80") == CodepointRangeGlyphSet::NOT_FOUND); // U+0400
+    REQUIRE(greek.find_index("\xCD\xAF") == CodepointRangeGlyphSet::NOT_FOUND); // U+036F
+    REQUIRE(greek.find_index("\xCE\x31") == CodepointRangeGlyphSet::NOT_FOUND); // bad continuation byte
+    REQUIRE(greek.find_index("\x8E\xB1") == CodepointRangeGlyphSet::NOT_FOUND); // bad lead byte
+    REQUIRE(greek.find_index("a") == CodepointRangeGlyphSet::NOT_FOUND);
+    REQUIRE_THROWS_AS(greek.to_index("a"), std::out_of_range);
+    REQUIRE_THROWS_AS(greek.from_index(static_cast<unsigned>(greek.size())), std::out_of_range);
+
+    // Surrogates are never glyphs, even encoded
+    CodepointRangeGlyphSet across("across", 0xD000, 0xE0FF);
+    REQUIRE(across.find_index("\xED\xA0\x80") == CodepointRangeGlyphSet::NOT_FOUND);
+    REQUIRE(across.codepoint(0x800) == 0xE000);
+
+    REQUIRE_THROWS_AS(CodepointRangeGlyphSet("mixed", 0x70, 0x90), std::invalid_argument);
+    REQUIRE_THROWS_AS(CodepointRangeGlyphSet("surrogates", 0xD800, 0xDBFF), std::invalid_argument);
+    REQUIRE_THROWS_AS(CodepointRangeGlyphSet("reversed", 0x3FF, 0x370), std::invalid_argument);
+}
+
+TEST_CASE("GlyphFPECipher over a code point range matches one over the materialized set", "[CodepointRangeGlyphSet]") {
+    const auto key = std::make_shared<const FPEKeyContext>(std::vector<uint8_t>(16, 0x42));
+    const std::vector<uint8_t> tweak(8, 0x99);
+
+    CodepointRangeGlyphSet range("cyrillic", 0x0400, 0x04FF);
+    IndexedGlyphSet indexed("cyrillic", materialize(0x0400, 0x04FF));
+
+    GlyphFPECipher over_range(&range, key, tweak);
+    GlyphFPECipher over_indexed(&indexed, key, tweak);
+
+    REQUIRE(over_range.codepoint_range() == &range);
+    REQUIRE(over_indexed.codepoint_range() == nullptr);
+    REQUIRE(over_range.glyph_size() == 2);
+    REQUIRE(over_range.glyph_count() == 256);
+    REQUIRE(over_range.getGlyphSetName() == "cyrillic");
+    REQUIRE_THROWS_AS(over_range.glyphs(), std::logic_error);
+
+    for (const std::string input : {"Ж", "Привет", "ЁжикВТумане"}) {
+        const auto encrypted = over_range.encrypt(input);
+        REQUIRE(encrypted == over_indexed.encrypt(input));
+        REQUIRE(over_range.decrypt(encrypted) == input);
+    }
+    REQUIRE(over_range.encrypt_batch({"Мир", "Да"}) == over_indexed.encrypt_batch({"Мир", "Да"}));
+}
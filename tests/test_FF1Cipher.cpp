@@ -2,6 +2,8 @@
 #include <catch2/catch_template_test_macros.hpp>
 
 #include "FF1Cipher.hpp"
+#include "allocation_counter.hpp"
+#include "cipher_helpers.hpp"
 
 #include <array>
 #include <vector>
@@ -9,17 +11,6 @@
 #include <unordered_set>
 #include <iostream>
 #include <chrono>
-#include <filesystem>
-#include <fstream>
-
-static std::vector<uint8_t> fixed_key_128() {
-    return std::vector<uint8_t>{
-        0x00, 0x11, 0x22, 0x33,
-        0x44, 0x55, 0x66, 0x77,
-        0x88, 0x99, 0xAA, 0xBB,
-        0xCC, 0xDD, 0xEE, 0xFF
-    };
-}
 
 static std::vector<uint8_t> fixed_tweak() {
     return std::vector<uint8_t>{ 0xDE, 0xAD, 0xBE, 0xEF };
@@ -154,20 +145,6 @@ TEST_CASE("FF1Cipher collision test with fixed-length arrays", "[FF1Cipher][coll
     }
 }
 
-static std::vector<std::string> load_words_2()
-{
-    std::filesystem::path path = std::filesystem::current_path() / ".." /"data" / "google-10000-english.txt";
-    std::ifstream in(path);
-    if (!in) throw std::runtime_error("Missing word list: " + path.string());
-
-    std::vector<std::string> words;
-    std::string word;
-    while (std::getline(in, word)) {
-        if (!word.empty() && word.size() > 1) words.push_back(word);
-    }
-    return words;
-}
-
 TEST_CASE("FF1Cipher encode/decode performance benchmark with words", "[ff1cipher][performance]") {
 
     constexpr unsigned radix = 62; // assuming radix 62 (0-9, A-Z, a-z)
@@ -176,7 +153,7 @@ TEST_CASE("FF1Cipher encode/decode performance benchmark with words", "[ff1ciphe
 
     FF1Cipher cipher(key, tweak, radix);
 
-    auto words = load_words_2();
+    auto words = load_word_list();
 
     // Convert each word to vector<DigitType> based on your radix scheme.
     // Here we assume a function that maps chars to digit values in [0, radix)
@@ -240,6 +217,390 @@ TEST_CASE("FF1Cipher encode/decode performance benchmark with words", "[ff1ciphe
     CHECK(dec_ops_per_sec > 75000);
 }
 
+static std::vector<uint32_t> from_base36(const std::string& text) {
+    std::vector<uint32_t> digits;
+    for (char c : text)
+        digits.push_back(c <= '9' ? static_cast<uint32_t>(c - '0') : static_cast<uint32_t>(c - 'a' + 10));
+    return digits;
+}
+
+TEST_CASE("FF1Cipher matches NIST SP 800-38G sample vectors", "[FF1Cipher]") {
+    struct Sample {
+        const char* key;
+        const char* tweak;
+        unsigned radix;
+        const char* plaintext;
+        const char* ciphertext;
+    };
+
+    const std::string key_128 = "2B7E151628AED2A6ABF7158809CF4F3C";
+    const std::string key_192 = key_128 + "EF4359D8D580AA4F";
+    const std::string key_256 = key_192 + "7F036D6F04FC6A94";
+
+    const Sample samples[] = {
+        {key_128.c_str(), "", 10, "0123456789", "2433477484"},
+        {key_128.c_str(), "39383736353433323130", 10, "0123456789", "6124200773"},
+        {key_128.c_str(), "3737373770717273373737", 36, "0123456789abcdefghi", "a9tv40mll9kdu509eum"},
+        {key_192.c_str(), "", 10, "0123456789", "2830668132"},
+        {key_192.c_str(), "39383736353433323130", 10, "0123456789", "2496655549"},
+        {key_192.c_str(), "3737373770717273373737", 36, "0123456789abcdefghi", "xbj3kv35jrawxv32ysr"},
+        {key_256.c_str(), "", 10, "0123456789", "6657667009"},
+        {key_256.c_str(), "39383736353433323130", 10, "0123456789", "1001623463"},
+        {key_256.c_str(), "3737373770717273373737", 36, "0123456789abcdefghi", "xs8a0azh2avyalyzuwd"},
+    };
+
+    for (const auto& sample : samples) {
+        INFO("key=" << sample.key << " tweak=" << sample.tweak << " radix=" << sample.radix);
+        FF1Cipher cipher(from_hex(sample.key), from_hex(sample.tweak), sample.radix);
+
+        auto encrypted = cipher.encrypt(from_base36(sample.plaintext));
+        REQUIRE(encrypted == from_base36(sample.ciphertext));
+
+        auto decrypted = cipher.decrypt(std::move(encrypted));
+        REQUIRE(decrypted == from_base36(sample.plaintext));
+    }
+}
+
+TEST_CASE("FF1Cipher roundtrips domains wider than 128 bits", "[FF1Cipher]") {
+    auto key = fixed_key_128();
+    auto tweak = fixed_tweak();
+
+    for (unsigned radix : {2, 10, 62, 20992}) {
+        FF1Cipher cipher(key, tweak, radix);
+        for (size_t length : {1, 2, 3, 31, 64, 257, 300}) {
+            auto digits = generate_valid_digits<uint32_t>(radix, length);
+
+            auto encrypted = cipher.encrypt(std::vector<uint32_t>(digits));
+            REQUIRE(encrypted.size() == length);
+
+            auto decrypted = cipher.decrypt(std::move(encrypted));
+            REQUIRE(decrypted == digits);
+        }
+    }
+}
+
+TEST_CASE("FF1Cipher batch encode/decode performance benchmark with words", "[ff1cipher][performance][batch]") {
+
+    constexpr unsigned radix = 26;
+    FF1Cipher cipher(fixed_key_128(), fixed_tweak(), radix);
+
+    const auto inputs = load_words_as_digits();
+
+    auto start_enc = std::chrono::steady_clock::now();
+    auto encrypted = cipher.encrypt_batch(inputs);
+    auto end_enc = std::chrono::steady_clock::now();
+
+    auto start_dec = std::chrono::steady_clock::now();
+    auto decrypted = cipher.decrypt_batch(encrypted);
+    auto end_dec = std::chrono::steady_clock::now();
+
+    REQUIRE(decrypted == inputs);
+
+    std::chrono::duration<double> encode_duration = end_enc - start_enc;
+    std::chrono::duration<double> decode_duration = end_dec - start_dec;
+
+    double enc_ops_per_sec = inputs.size() / encode_duration.count();
+    double dec_ops_per_sec = inputs.size() / decode_duration.count();
+
+    std::cout << "[benchmark] FF1Cipher batch encoded " << inputs.size() << " words in "
+        << encode_duration.count() << " seconds (" << enc_ops_per_sec << " ops/s)" << std::endl;
+
+    std::cout << "[benchmark] FF1Cipher batch decoded " << inputs.size() << " words in "
+        << decode_duration.count() << " seconds (" << dec_ops_per_sec << " ops/s)" << std::endl;
+
+    CHECK(enc_ops_per_sec > 75000);
+    CHECK(dec_ops_per_sec > 75000);
+}
+
+TEST_CASE("FF1Cipher cached per-length state matches a fresh cipher", "[FF1Cipher]") {
+    auto key = fixed_key_128();
+    std::vector<uint8_t> long_tweak(37, 0x5A); // spans several Q blocks
+
+    FF1Cipher warm(key, long_tweak, 36);
+    for (size_t length = 1; length <= 40; ++length) {
+        auto digits = generate_valid_digits<uint32_t>(36, length);
+        auto first = warm.encrypt(std::vector<uint32_t>(digits));
+        auto second = warm.encrypt(std::vector<uint32_t>(digits));
+
+        FF1Cipher fresh(key, long_tweak, 36);
+        INFO("length=" << length);
+        REQUIRE(first == second);
+        REQUIRE(first == fresh.encrypt(std::vector<uint32_t>(digits)));
+        REQUIRE(warm.decrypt(std::move(first)) == digits);
+    }
+}
+
+TEST_CASE("FF1Cipher batch matches per-string encryption", "[FF1Cipher][batch]") {
+    auto key = fixed_key_128();
+    auto tweak = fixed_tweak();
+    constexpr unsigned radix = 62;
+
+    FF1Cipher cipher(key, tweak, radix);
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<unsigned> digit(0, radix - 1);
+    std::uniform_int_distribution<size_t> length(0, 40);
+
+    std::vector<std::vector<uint32_t>> inputs;
+    for (int i = 0; i < 500; ++i) {
+        std::vector<uint32_t> digits(length(rng));
+        for (auto& d : digits) d = digit(rng);
+        inputs.push_back(std::move(digits));
+    }
+
+    auto encrypted = cipher.encrypt_batch(inputs);
+    REQUIRE(encrypted.size() == inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        REQUIRE(encrypted[i] == cipher.encrypt(std::vector<uint32_t>(inputs[i])));
+    }
+
+    auto decrypted = cipher.decrypt_batch(encrypted);
+    REQUIRE(decrypted == inputs);
+}
+
+TEST_CASE("FF1Cipher batch rejects invalid digits", "[FF1Cipher][batch][error]") {
+    FF1Cipher cipher(fixed_key_128(), fixed_tweak(), 10);
+
+    std::vector<std::vector<uint32_t>> inputs = {{1, 2, 3}, generate_invalid_digits<uint32_t>(10)};
+
+    REQUIRE_THROWS_AS(cipher.encrypt_batch(inputs), std::invalid_argument);
+}
+
+TEST_CASE("FF1Cipher span API matches vector API and works in place", "[FF1Cipher][span]") {
+    FF1Cipher cipher(fixed_key_128(), fixed_tweak(), 62);
+    const auto digits = generate_valid_digits<uint32_t>(62, 17);
+
+    std::array<uint32_t, 17> out{};
+    cipher.encrypt(digits, out);
+    REQUIRE(std::vector<uint32_t>(out.begin(), out.end()) == cipher.encrypt(std::vector<uint32_t>(digits)));
+
+    std::array<uint32_t, 17> in_place{};
+    std::copy(digits.begin(), digits.end(), in_place.begin());
+    cipher.encrypt(in_place, in_place);
+    REQUIRE(in_place == out);
+
+    cipher.decrypt(in_place, in_place);
+    REQUIRE(std::vector<uint32_t>(in_place.begin(), in_place.end()) == digits);
+
+    std::array<uint32_t, 16> too_small{};
+    REQUIRE_THROWS_AS(cipher.encrypt(digits, too_small), std::invalid_argument);
+}
+
+TEST_CASE("FF1Cipher span API makes no heap allocations", "[FF1Cipher][span]") {
+    FF1Cipher cipher(fixed_key_128(), fixed_tweak(), 62);
+
+    std::array<uint32_t, 32> buffer{};
+    for (size_t i = 0; i < buffer.size(); ++i) buffer[i] = static_cast<uint32_t>(i * 7 % 62);
+
+    for (size_t length : {1, 2, 5, 10, 16, 21, 32}) {
+        const std::span<uint32_t> digits(buffer.data(), length);
+
+        const size_t before = thread_allocation_count();
+        cipher.encrypt(digits, digits);
+        cipher.decrypt(digits, digits);
+        const size_t after = thread_allocation_count();
+
+        INFO("length=" << length);
+        REQUIRE(after == before);
+    }
+}
+
+TEST_CASE("FF1Cipher per-call tweak matches a cipher built with that tweak", "[FF1Cipher][tweak]") {
+    auto key = fixed_key_128();
+    FF1Cipher cipher(key, fixed_tweak(), 36);
+    const auto digits = generate_valid_digits<uint32_t>(36, 12);
+
+    std::vector<uint8_t> other_tweak = {0x01, 0x02, 0x03, 0x04, 0x05};
+    FF1Cipher rekeyed(key, other_tweak, 36);
+
+    auto with_tweak = cipher.encrypt(std::vector<uint32_t>(digits), other_tweak);
+    REQUIRE(with_tweak == rekeyed.encrypt(std::vector<uint32_t>(digits)));
+    REQUIRE(with_tweak != cipher.encrypt(std::vector<uint32_t>(digits)));
+    REQUIRE(cipher.decrypt(std::move(with_tweak), other_tweak) == digits);
+
+    // The constructor tweak passed explicitly takes the same path as the plain overload
+    REQUIRE(cipher.encrypt(std::vector<uint32_t>(digits), fixed_tweak()) == cipher.encrypt(std::vector<uint32_t>(digits)));
+
+    std::vector<std::vector<uint32_t>> inputs = {digits, generate_valid_digits<uint32_t>(36, 3)};
+    auto batch = cipher.encrypt_batch(inputs, other_tweak);
+    REQUIRE(batch == rekeyed.encrypt_batch(inputs));
+    REQUIRE(cipher.decrypt_batch(batch, other_tweak) == inputs);
+}
+
+TEST_CASE("FF1Cipher per-call tweaks survive LRU eviction", "[FF1Cipher][tweak]") {
+    auto key = fixed_key_128();
+    FF1Cipher cipher(key, fixed_tweak(), 10);
+    const auto digits = generate_valid_digits<uint32_t>(10, 9);
+
+    // More distinct tweaks than the cache holds, visited twice so the second pass sees evicted entries
+    std::vector<std::vector<uint32_t>> first_pass;
+    for (int round = 0; round < 2; ++round) {
+        for (uint32_t i = 0; i < 200; ++i) {
+            std::vector<uint8_t> tweak = {static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8), 0x7E};
+            auto encrypted = cipher.encrypt(std::vector<uint32_t>(digits), tweak);
+            if (round == 0) {
+                first_pass.push_back(encrypted);
+            } else {
+                INFO("tweak=" << i);
+                REQUIRE(encrypted == first_pass[i]);
+                REQUIRE(cipher.decrypt(std::move(encrypted), tweak) == digits);
+            }
+        }
+    }
+    REQUIRE(first_pass[0] != first_pass[1]);
+}
+
+TEST_CASE("FF1Cipher radix-specialized kernels match reference ciphertexts", "[FF1Cipher][radix]") {
+    // Reference outputs come from the BIGNUM path, which has no per-radix code. Inputs are (i * 7 + 3) mod radix.
+    struct Case {
+        int32_t radix;
+        std::vector<uint32_t> expected;
+    };
+    const std::vector<Case> cases = {
+        {6, {0, 0, 5, 1, 1, 5, 3, 0, 1, 5, 2, 5, 0, 0, 0, 1, 3, 1, 2, 4, 3, 5, 5, 5, 2, 2, 2, 2, 4, 2, 4, 2, 5, 4, 4, 3,
+             1, 5, 1, 4}},
+        {10, {5, 6, 7, 5, 6, 0, 9, 3, 0, 6, 4, 1, 1, 6, 2, 6, 2, 8, 8, 7}},
+        {33, {15, 10, 19, 31, 28, 1, 22, 0, 10, 11, 4, 27, 5, 20, 30, 18, 16, 29, 17, 29, 25, 32, 23, 14}},
+        {52, {34, 28, 36, 44, 16, 15, 8, 0, 45, 14, 47, 49}},
+        {52, {40, 49, 42, 45, 36, 24, 29, 49, 42, 32, 50, 26, 25, 47, 38, 32, 38, 4, 48, 8, 9, 29, 12, 27, 12, 46, 31, 19,
+              39, 10}},
+        {32, {31, 16, 15, 15, 20, 13, 12, 21, 30, 20, 0, 12, 14, 24, 15, 29}},
+        {2, {1, 1, 0, 0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 1, 1, 0, 0, 1, 0, 0, 1, 0, 0,
+             0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 0, 1}},
+        {4096, {3562, 946, 3470, 1908, 2887, 2992, 991, 260, 1104}},
+    };
+
+    const std::vector<uint8_t> key(16, 0x2B);
+    const std::vector<uint8_t> tweak = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+
+    for (const auto& c : cases) {
+        FF1Cipher cipher(key, tweak, c.radix);
+        std::vector<uint32_t> digits(c.expected.size());
+        for (size_t i = 0; i < digits.size(); ++i)
+            digits[i] = static_cast<uint32_t>((i * 7 + 3) % c.radix);
+
+        INFO("radix=" << c.radix << " length=" << digits.size());
+        auto encrypted = cipher.encrypt(std::vector<uint32_t>(digits));
+        REQUIRE(encrypted == c.expected);
+        REQUIRE(cipher.decrypt(std::move(encrypted)) == digits);
+        REQUIRE(cipher.encrypt_batch({digits}).front() == c.expected);
+    }
+}
+
+TEST_CASE("FF1Cipher small-domain tables match the Feistel rounds", "[FF1Cipher][small_domain]") {
+    std::mt19937 rng(9);
+
+    for (int32_t radix : {2, 6, 10, 52, 300}) {
+        FF1Cipher rounds(fixed_key_128(), fixed_tweak(), radix);
+        FF1Cipher tables(fixed_key_128(), fixed_tweak(), radix, SmallDomainTables{10000, 1 << 20});
+        std::uniform_int_distribution<uint32_t> digit(0, static_cast<uint32_t>(radix - 1));
+
+        std::vector<std::vector<uint32_t>> inputs;
+        for (size_t length = 1; length <= 8; ++length) {
+            for (int k = 0; k < 4; ++k) {
+                std::vector<uint32_t> digits(length);
+                for (auto& d : digits) d = digit(rng);
+                inputs.push_back(std::move(digits));
+            }
+        }
+
+        for (const auto& digits : inputs) {
+            INFO("radix=" << radix << " length=" << digits.size());
+            auto encrypted = tables.encrypt(std::vector<uint32_t>(digits));
+            REQUIRE(encrypted == rounds.encrypt(std::vector<uint32_t>(digits)));
+            REQUIRE(tables.decrypt(std::move(encrypted)) == digits);
+        }
+
+        const auto batch = tables.encrypt_batch(inputs);
+        REQUIRE(batch == rounds.encrypt_batch(inputs));
+        REQUIRE(tables.decrypt_batch(batch) == inputs);
+
+        // A per-call tweak bypasses the tables built under the constructor tweak
+        const std::vector<uint8_t> other_tweak = {0x01, 0x02};
+        REQUIRE(tables.encrypt(std::vector<uint32_t>(inputs[0]), other_tweak)
+                == rounds.encrypt(std::vector<uint32_t>(inputs[0]), other_tweak));
+
+        // Every length used with radix^n <= 10000 holds a forward and an inverse uint16_t table
+        size_t expected_bytes = 0;
+        size_t domain = radix;
+        for (size_t length = 1; length <= 8 && domain <= 10000; ++length, domain *= radix)
+            expected_bytes += 2 * domain * sizeof(uint16_t);
+        REQUIRE(tables.small_domain_table_bytes() == expected_bytes);
+    }
+}
+
+TEST_CASE("FF1Cipher small-domain tables respect their byte budget", "[FF1Cipher][small_domain]") {
+    // Room for the tables of lengths 1 and 2 (40 + 400 bytes) but not length 3 (4000 bytes)
+    FF1Cipher cipher(fixed_key_128(), fixed_tweak(), 10, SmallDomainTables{1000, 1000});
+    FF1Cipher rounds(fixed_key_128(), fixed_tweak(), 10);
+    REQUIRE(cipher.small_domain_table_bytes() == 0);
+
+    for (const std::vector<uint32_t>& digits : {std::vector<uint32_t>{7}, {4, 2}, {9, 9, 9}, {1, 2, 3, 4}}) {
+        INFO("length=" << digits.size());
+        REQUIRE(cipher.encrypt(std::vector<uint32_t>(digits)) == rounds.encrypt(std::vector<uint32_t>(digits)));
+    }
+    REQUIRE(cipher.small_domain_table_bytes() == 440);
+
+    REQUIRE_THROWS_AS(
+        FF1Cipher(fixed_key_128(), fixed_tweak(), 10, SmallDomainTables{65537, 1 << 20}), std::invalid_argument
+    );
+}
+
+TEST_CASE("FF1Cipher small-domain tables performance benchmark", "[ff1cipher][performance][small_domain]") {
+    FF1Cipher rounds(fixed_key_128(), fixed_tweak(), 10);
+    FF1Cipher tables(fixed_key_128(), fixed_tweak(), 10, SmallDomainTables{10000, 1 << 20});
+
+    constexpr int iterations = 100000;
+    std::array<uint32_t, 4> buffer{};
+    auto run = [&](const FF1Cipher& cipher) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            buffer = {static_cast<uint32_t>(i % 10), static_cast<uint32_t>(i / 10 % 10), 3, 7};
+            cipher.encrypt(buffer, buffer);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return iterations / std::chrono::duration<double>(end - start).count();
+    };
+
+    const double rounds_ops = run(rounds);
+    const double tables_ops = run(tables);
+
+    std::cout << "[benchmark] FF1Cipher 4-digit strings: " << rounds_ops << " ops/s with rounds, " << tables_ops
+              << " ops/s with tables (" << tables.small_domain_table_bytes() << " bytes)" << std::endl;
+
+    CHECK(tables_ops > rounds_ops);
+}
+
+TEST_CASE("FF1Cipher over a shared key context matches separately keyed ciphers", "[FF1Cipher][key_context]") {
+    const auto key = std::make_shared<const FPEKeyContext>(fixed_key_128());
+
+    const std::vector<int32_t> radices = {10, 26, 52, 300, 20992};
+    std::vector<FF1Cipher> shared;
+    for (int32_t radix : radices)
+        shared.emplace_back(key, fixed_tweak(), radix);
+    REQUIRE(key.use_count() == 6);
+
+    const std::vector<uint32_t> digits = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+    for (size_t i = 0; i < radices.size(); ++i) {
+        FF1Cipher own(fixed_key_128(), fixed_tweak(), radices[i]);
+        INFO("radix=" << radices[i]);
+        auto encrypted = shared[i].encrypt(std::vector<uint32_t>(digits));
+        REQUIRE(encrypted == own.encrypt(std::vector<uint32_t>(digits)));
+        REQUIRE(shared[i].decrypt(std::move(encrypted)) == digits);
+        REQUIRE(shared[i].encrypt_batch({digits}) == own.encrypt_batch({digits}));
+    }
+
+    // The context outlives the handle it was created through
+    const std::weak_ptr<const FPEKeyContext> weak = key;
+    FF1Cipher survivor = std::move(shared.front());
+    shared.clear();
+    REQUIRE(weak.use_count() == 2);
+    REQUIRE_FALSE(survivor.encrypt(std::vector<uint32_t>(digits)).empty());
+
+    REQUIRE_THROWS_AS(FF1Cipher(std::shared_ptr<const FPEKeyContext>(), fixed_tweak(), 10), std::invalid_argument);
+    REQUIRE_THROWS_AS(FPEKeyContext(std::vector<uint8_t>(15, 0x00)), std::invalid_argument);
+}
+
 TEST_CASE("FF1Cipher decrypt throws or fails on invalid ciphertext", "[FF1Cipher][error]") {
     auto key = fixed_key_128();
     auto tweak = fixed_tweak();
@@ -0,0 +1,172 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "FF3_1Cipher.hpp"
+#include "FF1Cipher.hpp"
+#include "allocation_counter.hpp"
+#include "cipher_helpers.hpp"
+
+#include <array>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <chrono>
+
+static std::vector<uint8_t> ff3_tweak() {
+    return std::vector<uint8_t>{ 0xDE, 0xAD, 0xBE, 0xEF, 0x01, 0x02, 0x03 };
+}
+
+static std::vector<uint32_t> ff3_from_decimal(const std::string& text) {
+    std::vector<uint32_t> digits;
+    for (char c : text)
+        digits.push_back(static_cast<uint32_t>(c - '0'));
+    return digits;
+}
+
+TEST_CASE("FF3_1Cipher matches the NIST ACVP sample vector", "[FF3_1Cipher]") {
+    FF3_1Cipher cipher(from_hex("2DE79D232DF5585D68CE47882AE256D6"), from_hex("CBD09280979564"), 10);
+
+    const auto plaintext = ff3_from_decimal("3992520240");
+    const auto ciphertext = ff3_from_decimal("8901801106");
+
+    REQUIRE(cipher.encrypt(std::vector<uint32_t>(plaintext)) == ciphertext);
+    REQUIRE(cipher.decrypt(std::vector<uint32_t>(ciphertext)) == plaintext);
+}
+
+TEST_CASE("FF3_1Cipher roundtrips every length up to the radix limit", "[FF3_1Cipher]") {
+    std::mt19937 rng(11);
+
+    for (int32_t radix : {2, 10, 26, 62, 20992, 65536}) {
+        FF3_1Cipher cipher(fixed_key_128(), ff3_tweak(), radix);
+        std::uniform_int_distribution<uint32_t> digit(0, static_cast<uint32_t>(radix - 1));
+
+        for (size_t length = 1; length <= cipher.max_length(); ++length) {
+            std::vector<uint32_t> digits(length);
+            for (auto& d : digits) d = digit(rng);
+
+            auto encrypted = cipher.encrypt(std::vector<uint32_t>(digits));
+            INFO("radix=" << radix << " length=" << length);
+            REQUIRE(encrypted.size() == length);
+            REQUIRE(cipher.decrypt(std::move(encrypted)) == digits);
+        }
+    }
+}
+
+TEST_CASE("FF3_1Cipher enforces its length limit and tweak size", "[FF3_1Cipher][error]") {
+    FF3_1Cipher cipher(fixed_key_128(), ff3_tweak(), 10);
+    REQUIRE(cipher.max_length() == 56);
+
+    REQUIRE_NOTHROW(cipher.encrypt(std::vector<uint32_t>(56, 9)));
+    REQUIRE_THROWS_AS(cipher.encrypt(std::vector<uint32_t>(57, 9)), std::invalid_argument);
+    // Below the Rev. 1 minimum of radix^n >= 10^6 inputs are accepted, as the header documents
+    REQUIRE_NOTHROW(cipher.encrypt(std::vector<uint32_t>{7}));
+    REQUIRE_NOTHROW(cipher.encrypt(std::vector<uint32_t>(5, 9)));
+    REQUIRE_THROWS_AS(cipher.encrypt(std::vector<uint32_t>{1, 2, 10}), std::invalid_argument);
+
+    REQUIRE_THROWS_AS(FF3_1Cipher(fixed_key_128(), std::vector<uint8_t>(8, 0x00), 10), std::invalid_argument);
+    REQUIRE_THROWS_AS(FF3_1Cipher(std::vector<uint8_t>(15, 0x00), ff3_tweak(), 10), std::invalid_argument);
+
+    const std::vector<uint8_t> short_tweak(4, 0x00);
+    REQUIRE_THROWS_AS(cipher.encrypt(std::vector<uint32_t>{1, 2, 3}, short_tweak), std::invalid_argument);
+}
+
+TEST_CASE("FF3_1Cipher per-call tweak matches a cipher built with that tweak", "[FF3_1Cipher][tweak]") {
+    FF3_1Cipher cipher(fixed_key_128(), ff3_tweak(), 36);
+    const std::vector<uint8_t> other_tweak = {0x10, 0x20, 0x30, 0x4F, 0x50, 0x60, 0x70};
+    FF3_1Cipher rekeyed(fixed_key_128(), other_tweak, 36);
+
+    const std::vector<uint32_t> digits = {1, 35, 0, 7, 22, 13, 4, 4, 18};
+
+    auto with_tweak = cipher.encrypt(std::vector<uint32_t>(digits), other_tweak);
+    REQUIRE(with_tweak == rekeyed.encrypt(std::vector<uint32_t>(digits)));
+    REQUIRE(with_tweak != cipher.encrypt(std::vector<uint32_t>(digits)));
+    REQUIRE(cipher.decrypt(std::move(with_tweak), other_tweak) == digits);
+
+    std::vector<std::vector<uint32_t>> inputs = {digits, {}, {3, 1, 4}};
+    auto batch = cipher.encrypt_batch(inputs, other_tweak);
+    REQUIRE(batch == rekeyed.encrypt_batch(inputs));
+    REQUIRE(cipher.decrypt_batch(batch, other_tweak) == inputs);
+}
+
+TEST_CASE("FF3_1Cipher span API works in place without heap allocations", "[FF3_1Cipher][span]") {
+    FF3_1Cipher cipher(fixed_key_128(), ff3_tweak(), 62);
+
+    std::array<uint32_t, 32> buffer{};
+    for (size_t i = 0; i < buffer.size(); ++i) buffer[i] = static_cast<uint32_t>(i * 7 % 62);
+    const auto original = buffer;
+
+    for (size_t length : {1, 2, 5, 10, 16, 21, 32}) {
+        const std::span<uint32_t> digits(buffer.data(), length);
+
+        const size_t before = thread_allocation_count();
+        cipher.encrypt(digits, digits);
+        cipher.decrypt(digits, digits);
+        const size_t after = thread_allocation_count();
+
+        INFO("length=" << length);
+        REQUIRE(after == before);
+        REQUIRE(buffer == original);
+    }
+}
+
+TEST_CASE("FF3_1Cipher shares a key context with FF1Cipher", "[FF3_1Cipher][key_context]") {
+    const auto key = std::make_shared<const FPEKeyContext>(fixed_key_128());
+    FF1Cipher ff1(key, ff3_tweak(), 26);
+    FF3_1Cipher ff3_1(key, ff3_tweak(), 26);
+    FF3_1Cipher own(fixed_key_128(), ff3_tweak(), 26);
+    REQUIRE(key.use_count() == 3);
+
+    const std::vector<uint32_t> digits = {7, 4, 11, 11, 14, 22, 14, 17, 11, 3};
+    auto encrypted = ff3_1.encrypt(std::vector<uint32_t>(digits));
+    REQUIRE(encrypted == own.encrypt(std::vector<uint32_t>(digits)));
+    REQUIRE(ff3_1.decrypt(std::move(encrypted)) == digits);
+
+    FF3_1Cipher moved = std::move(ff3_1);
+    REQUIRE(moved.encrypt(std::vector<uint32_t>(digits)) == own.encrypt(std::vector<uint32_t>(digits)));
+    REQUIRE_THROWS_AS(ff3_1.encrypt(std::vector<uint32_t>(digits)), std::logic_error);
+}
+
+// Runs encrypt then decrypt over every word and returns {encrypt ops/s, decrypt ops/s}
+template <typename Cipher>
+static std::pair<double, double> benchmark_words(const Cipher& cipher, const std::vector<std::vector<uint32_t>>& inputs)
+{
+    std::vector<uint32_t> buffer;
+
+    auto start_enc = std::chrono::steady_clock::now();
+    for (const auto& digits : inputs) {
+        buffer.assign(digits.begin(), digits.end());
+        cipher.encrypt(buffer, buffer);
+    }
+    auto end_enc = std::chrono::steady_clock::now();
+
+    auto start_dec = std::chrono::steady_clock::now();
+    for (const auto& digits : inputs) {
+        buffer.assign(digits.begin(), digits.end());
+        cipher.decrypt(buffer, buffer);
+    }
+    auto end_dec = std::chrono::steady_clock::now();
+
+    return {
+        inputs.size() / std::chrono::duration<double>(end_enc - start_enc).count(),
+        inputs.size() / std::chrono::duration<double>(end_dec - start_dec).count()
+    };
+}
+
+TEST_CASE("FF3_1Cipher vs FF1Cipher performance benchmark with words", "[ff3_1cipher][performance]") {
+    constexpr int32_t radix = 26;
+    const auto inputs = load_words_as_digits();
+    REQUIRE(inputs.size() >= 9578);
+
+    FF1Cipher ff1(fixed_key_128(), ff3_tweak(), radix);
+    FF3_1Cipher ff3_1(fixed_key_128(), ff3_tweak(), radix);
+
+    const auto [ff1_enc, ff1_dec] = benchmark_words(ff1, inputs);
+    const auto [ff3_enc, ff3_dec] = benchmark_words(ff3_1, inputs);
+
+    std::cout << "[benchmark] FF1Cipher   " << inputs.size() << " words: " << ff1_enc << " enc ops/s, "
+              << ff1_dec << " dec ops/s" << std::endl;
+    std::cout << "[benchmark] FF3_1Cipher " << inputs.size() << " words: " << ff3_enc << " enc ops/s, "
+              << ff3_dec << " dec ops/s" << std::endl;
+
+    CHECK(ff3_enc > 75000);
+    CHECK(ff3_dec > 75000);
+}
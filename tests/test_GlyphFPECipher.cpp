@@ -68,6 +68,107 @@ TEST_CASE("different outputs for different keys", "[GlyphFPECipher]") {
     REQUIRE(encrypted1 != encrypted2);
 }
 
+TEST_CASE("GlyphFPECipher FF3-1 backend roundtrips and differs from FF1", "[GlyphFPECipher][FF3_1Cipher]") {
+    auto codebook = buildAsciiCodebook();
+    std::vector<uint8_t> key(16, 0x42);
+    std::vector<uint8_t> tweak(7, 0x99);
+
+    GlyphFPECipher ff1(codebook, key, tweak);
+    GlyphFPECipher ff3_1(codebook, key, tweak, false, FPEAlgorithm::FF3_1);
+    REQUIRE(ff1.algorithm() == FPEAlgorithm::FF1);
+    REQUIRE(ff3_1.algorithm() == FPEAlgorithm::FF3_1);
+
+    std::string input = "HelloWorld";
+    auto encrypted = ff3_1.encrypt(input);
+    REQUIRE(encrypted.size() == input.size());
+    REQUIRE(encrypted != ff1.encrypt(input));
+    REQUIRE(ff3_1.decrypt(encrypted) == input);
+
+    std::vector<std::string> inputs = {"Hello", "", "World"};
+    auto batch = ff3_1.encrypt_batch(inputs);
+    REQUIRE(batch[0] == ff3_1.encrypt("Hello"));
+    REQUIRE(ff3_1.decrypt_batch(batch) == inputs);
+
+    // FF3-1 needs a 56-bit tweak
+    REQUIRE_THROWS_AS(GlyphFPECipher(codebook, key, std::vector<uint8_t>(4, 0x99), false, FPEAlgorithm::FF3_1),
+                      std::invalid_argument);
+}
+
+TEST_CASE("GlyphFPECipher small-domain tables match the Feistel rounds", "[GlyphFPECipher][small_domain]") {
+    auto codebook = buildAsciiCodebook();
+    std::vector<uint8_t> key(16, 0x42);
+    std::vector<uint8_t> tweak(8, 0x99);
+
+    GlyphFPECipher rounds(codebook, key, tweak);
+    GlyphFPECipher tables(codebook, key, tweak, false, FPEAlgorithm::FF1, SmallDomainTables{1 << 16, 1 << 20});
+
+    for (const std::string input : {"a", "Hi", "Hello", "HelloWorld"}) {
+        auto encrypted = tables.encrypt(input);
+        REQUIRE(encrypted == rounds.encrypt(input));
+        REQUIRE(tables.decrypt(encrypted) == input);
+    }
+
+    // Only strings of one and two glyphs have domains within 65536
+    const size_t radix = codebook.size();
+    REQUIRE(tables.small_domain_table_bytes() == 2 * (radix + radix * radix) * sizeof(uint16_t));
+    REQUIRE(rounds.small_domain_table_bytes() == 0);
+}
+
+TEST_CASE("BasicGlyphFPECipher backends match the type-erased cipher", "[GlyphFPECipher][backend]") {
+    auto codebook = buildAsciiCodebook();
+    std::vector<uint8_t> key(16, 0x42);
+    std::vector<uint8_t> tweak(8, 0x99);
+    std::vector<uint8_t> ff3_tweak(FF3_1Cipher::TWEAK_SIZE, 0x99);
+    const auto shared_key = std::make_shared<const FPEKeyContext>(key);
+
+    BasicGlyphFPECipher<glyph_fpe::FF1> ff1(&codebook, shared_key, tweak);
+    BasicGlyphFPECipher<glyph_fpe::FF3_1> ff3_1(&codebook, shared_key, ff3_tweak);
+    BasicGlyphFPECipher<glyph_fpe::FF1> table(&codebook, shared_key, tweak, SmallDomainTables{1 << 16, 16 << 20});
+    BasicGlyphFPECipher<glyph_fpe::Noop> noop(&codebook);
+
+    GlyphFPECipher erased_ff1(codebook, key, tweak);
+    GlyphFPECipher erased_ff3_1(codebook, key, ff3_tweak, false, FPEAlgorithm::FF3_1);
+
+    const std::vector<std::string> inputs = {"a", "Hi", "Hello", "HelloWorld"};
+    for (const auto& input : inputs) {
+        REQUIRE(ff1.encrypt(input) == erased_ff1.encrypt(input));
+        REQUIRE(ff3_1.encrypt(input) == erased_ff3_1.encrypt(input));
+        REQUIRE(table.encrypt(input) == ff1.encrypt(input));
+        REQUIRE(table.decrypt(table.encrypt(input)) == input);
+        REQUIRE(noop.encrypt(input) == input);
+    }
+    REQUIRE(ff1.encrypt_batch(inputs) == erased_ff1.encrypt_batch(inputs));
+    REQUIRE(table.backend().small_domain_table_bytes() > 0);
+
+    // One container over every backend
+    std::vector<GlyphFPECipher> mixed;
+    mixed.emplace_back(std::move(ff1));
+    mixed.emplace_back(std::move(ff3_1));
+    mixed.emplace_back(std::move(table));
+    mixed.emplace_back(std::move(noop));
+
+    REQUIRE(mixed[0].algorithm() == FPEAlgorithm::FF1);
+    REQUIRE(mixed[1].algorithm() == FPEAlgorithm::FF3_1);
+    REQUIRE(mixed[2].small_domain_table_bytes() > 0);
+    REQUIRE(mixed[3].is_noop());
+    REQUIRE_FALSE(mixed[0].is_noop());
+    for (const auto& cipher : mixed) {
+        REQUIRE(&cipher.glyphs() == &codebook);
+        REQUIRE(cipher.decrypt(cipher.encrypt("HelloWorld")) == "HelloWorld");
+    }
+    REQUIRE(mixed[0].encrypt("HelloWorld") == erased_ff1.encrypt("HelloWorld"));
+    REQUIRE(mixed[1].encrypt("HelloWorld") == erased_ff3_1.encrypt("HelloWorld"));
+}
+
+TEST_CASE("GlyphFPECipher noop flag needs no valid key", "[GlyphFPECipher][backend]") {
+    auto codebook = buildAsciiCodebook();
+    // No key schedule is built for noop, so an unusable key is accepted
+    GlyphFPECipher noop(codebook, std::vector<uint8_t>{}, std::vector<uint8_t>{}, true);
+    REQUIRE(noop.is_noop());
+    REQUIRE(noop.encrypt("NoOp") == "NoOp");
+    REQUIRE_THROWS(GlyphFPECipher(codebook, std::vector<uint8_t>{}, std::vector<uint8_t>(8, 0x00)));
+}
+
 static std::vector<std::string> load_words()
 {
     std::filesystem::path path = std::filesystem::current_path() / ".." /"data" / "google-10000-english.txt";
@@ -0,0 +1,215 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "CodepointRangeGlyphSet.hpp"
+#include "GlyphFPECipher.hpp"
+#include "GlyphKernels.hpp"
+#include "IndexedGlyphSet.hpp"
+#include "PreconfiguredIndexedGlyphSet.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using glyph_kernels::CodepointRange;
+
+static std::string encode_run(const CodepointRange& range, const std::vector<uint32_t>& indexes) {
+    std::string out;
+    for (const auto index : indexes)
+        PreconfiguredIndexedGlyphSet::encode_utf8(range.first + index, out);
+    return out;
+}
+
+// Runs every variant this CPU has and requires they all match the expected result
+static void require_map_range(const CodepointRange& range, const std::string& in, const size_t expected_mapped,
+                              const std::vector<uint32_t>& expected) {
+    const size_t count = in.size() / range.width;
+    std::vector<std::vector<uint32_t>> outs(3, std::vector<uint32_t>(count));
+    REQUIRE(glyph_kernels::map_range_scalar(range, in.data(), count, outs[0].data()) == expected_mapped);
+    REQUIRE(glyph_kernels::map_range(range, in.data(), count, outs[1].data()) == expected_mapped);
+    if (glyph_kernels::has_avx2())
+        REQUIRE(glyph_kernels::map_range_avx2(range, in.data(), count, outs[2].data()) == expected_mapped);
+    else
+        outs[2] = outs[0];
+    for (const auto& out : outs)
+        REQUIRE(std::equal(expected.begin(), expected.begin() + expected_mapped, out.begin()));
+}
+
+TEST_CASE("GlyphKernels map and unmap code point ranges of every width", "[GlyphKernels]") {
+    const CodepointRange ranges[] = {
+        {0x20, 0x5F, 1},     // printable ASCII
+        {0x0400, 0x100, 2},  // Cyrillic
+        {0x4E00, 0x5200, 3}, // CJK ideographs
+        {0x1F600, 0x50, 4},  // emoticons
+    };
+    std::mt19937 rng(17);
+
+    for (const auto& range : ranges) {
+        for (size_t count = 0; count <= 80; ++count) {
+            INFO("width=" << range.width << " count=" << count);
+            std::vector<uint32_t> indexes(count);
+            for (auto& index : indexes) index = rng() % range.count;
+            indexes.push_back(0);
+            indexes.push_back(range.count - 1);
+            const std::string utf8 = encode_run(range, indexes);
+
+            require_map_range(range, utf8, indexes.size(), indexes);
+
+            for (const bool avx2 : {false, true}) {
+                if (avx2 && !glyph_kernels::has_avx2()) continue;
+                std::string out(utf8.size(), '\0');
+                if (avx2)
+                    glyph_kernels::unmap_range_avx2(range, indexes.data(), indexes.size(), out.data());
+                else
+                    glyph_kernels::unmap_range_scalar(range, indexes.data(), indexes.size(), out.data());
+                REQUIRE(out == utf8);
+            }
+        }
+    }
+}
+
+TEST_CASE("GlyphKernels report the first glyph outside the range", "[GlyphKernels]") {
+    const CodepointRange ranges[] = {{0x20, 0x5F, 1}, {0x0400, 0x100, 2}, {0x4E00, 0x5200, 3}, {0x1F600, 0x50, 4}};
+    std::mt19937 rng(18);
+
+    for (const auto& range : ranges) {
+        const size_t count = 70;
+        std::vector<uint32_t> indexes(count);
+        for (auto& index : indexes) index = rng() % range.count;
+        const std::string utf8 = encode_run(range, indexes);
+
+        for (size_t bad = 0; bad < count; ++bad) {
+            INFO("width=" << range.width << " bad=" << bad);
+            // One code point past the range, then a broken lead byte and a broken continuation byte
+            std::string past = utf8;
+            std::string glyph;
+            PreconfiguredIndexedGlyphSet::encode_utf8(range.first + range.count, glyph);
+            past.replace(bad * range.width, range.width, glyph);
+            require_map_range(range, past, bad, indexes);
+
+            std::string broken = utf8;
+            broken[bad * range.width] = static_cast<char>(0xFF);
+            require_map_range(range, broken, bad, indexes);
+
+            if (range.width > 1) {
+                broken = utf8;
+                broken[bad * range.width + range.width - 1] = 'A';
+                require_map_range(range, broken, bad, indexes);
+            }
+        }
+    }
+}
+
+TEST_CASE("GlyphKernels map and unmap sparse 1-byte sets through the byte table", "[GlyphKernels]") {
+    IndexedGlyphSet letters("letters", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+    std::vector<uint32_t> table(256, UINT32_MAX);
+    for (unsigned i = 0; i < letters.size(); ++i)
+        table[static_cast<unsigned char>(letters.from_index(i)[0])] = i;
+
+    std::mt19937 rng(19);
+    for (size_t count = 0; count <= 100; ++count) {
+        INFO("count=" << count);
+        std::vector<uint32_t> indexes(count);
+        std::string text;
+        for (auto& index : indexes) {
+            index = rng() % letters.size();
+            text += letters.from_index(index);
+        }
+
+        std::vector<uint32_t> scalar(count), avx2(count);
+        REQUIRE(glyph_kernels::map_bytes_scalar(table.data(), text.data(), count, scalar.data()) == count);
+        REQUIRE(scalar == indexes);
+        std::string out(count, '\0');
+        glyph_kernels::unmap_bytes_scalar(letters.data(), indexes.data(), count, out.data());
+        REQUIRE(out == text);
+
+        if (glyph_kernels::has_avx2()) {
+            REQUIRE(glyph_kernels::map_bytes_avx2(table.data(), text.data(), count, avx2.data()) == count);
+            REQUIRE(avx2 == indexes);
+            std::string avx2_out(count, '\0');
+            glyph_kernels::unmap_bytes_avx2(letters.data(), indexes.data(), count, avx2_out.data());
+            REQUIRE(avx2_out == text);
+
+            for (size_t bad = 0; bad < count; bad += 7) {
+                std::string broken = text;
+                broken[bad] = '_';
+                REQUIRE(glyph_kernels::map_bytes_avx2(table.data(), broken.data(), count, avx2.data()) == bad);
+            }
+        }
+    }
+}
+
+TEST_CASE("GlyphFPECipher names the byte of the first glyph outside its set", "[GlyphKernels][GlyphFPECipher]") {
+    const auto key = std::make_shared<const FPEKeyContext>(std::vector<uint8_t>(16, 0x42));
+    const std::vector<uint8_t> tweak(8, 0x99);
+
+    IndexedGlyphSet digits("digits", "0123456789");
+    IndexedGlyphSet letters("letters", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+    CodepointRangeGlyphSet cyrillic("cyrillic", 0x0400, 0x04FF);
+
+    GlyphFPECipher over_digits(&digits, key, tweak);
+    GlyphFPECipher over_letters(&letters, key, tweak);
+    GlyphFPECipher over_cyrillic(&cyrillic, key, tweak);
+
+    const std::string long_digits(40, '7');
+    REQUIRE(over_digits.decrypt(over_digits.encrypt(long_digits)) == long_digits);
+    const std::string long_letters = "TheQuickBrownFoxJumpsOverTheLazyDogTheQuickBrownFox";
+    REQUIRE(over_letters.decrypt(over_letters.encrypt(long_letters)) == long_letters);
+
+    auto require_bad_byte = [](const GlyphFPECipher& cipher, const std::string& input, const std::string& byte) {
+        try {
+            cipher.encrypt(input);
+            FAIL("no exception for " << input);
+        } catch (const std::out_of_range& e) {
+            REQUIRE(std::string(e.what()).ends_with("at byte " + byte));
+        }
+    };
+    require_bad_byte(over_digits, long_digits + "x" + long_digits, "40");
+    require_bad_byte(over_letters, long_letters + "1", "51");
+    require_bad_byte(over_cyrillic, "ПриветПриветПриветПривет" "Z" "ривет", "48");
+    require_bad_byte(over_cyrillic, "При\xD0", "6"); // trailing partial glyph
+}
+
+TEST_CASE("GlyphKernels scalar vs AVX2 performance benchmark", "[GlyphKernels][performance]") {
+    if (!glyph_kernels::has_avx2())
+        return;
+
+    constexpr int iterations = 20'000;
+    const CodepointRange ranges[] = {{0x20, 0x5F, 1}, {0x4E00, 0x5200, 3}};
+    std::mt19937 rng(20);
+
+    for (const auto& range : ranges) {
+        std::vector<uint32_t> indexes(256);
+        for (auto& index : indexes) index = rng() % range.count;
+        const std::string utf8 = encode_run(range, indexes);
+        std::vector<uint32_t> out(indexes.size());
+        std::string text(utf8.size(), '\0');
+        uint64_t sink = 0;
+
+        auto start_scalar = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            sink += glyph_kernels::map_range_scalar(range, utf8.data(), out.size(), out.data());
+            glyph_kernels::unmap_range_scalar(range, out.data(), out.size(), text.data());
+        }
+        auto end_scalar = std::chrono::steady_clock::now();
+
+        auto start_avx2 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            sink -= glyph_kernels::map_range_avx2(range, utf8.data(), out.size(), out.data());
+            glyph_kernels::unmap_range_avx2(range, out.data(), out.size(), text.data());
+        }
+        auto end_avx2 = std::chrono::steady_clock::now();
+
+        const double glyphs = double(iterations) * indexes.size();
+        const double scalar_rate = glyphs / std::chrono::duration<double>(end_scalar - start_scalar).count();
+        const double avx2_rate = glyphs / std::chrono::duration<double>(end_avx2 - start_avx2).count();
+
+        std::cout << "[benchmark] GlyphKernels " << range.width << "-byte map+unmap: " << scalar_rate
+                  << " scalar glyphs/s, " << avx2_rate << " avx2 glyphs/s" << std::endl;
+
+        REQUIRE(sink == 0);
+        REQUIRE(text == utf8);
+        CHECK(avx2_rate > 10000000);
+    }
+}
@@ -1,6 +1,12 @@
 #include <catch2/catch_test_macros.hpp>
 #include "IndexedGlyphSet.hpp"
 
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
 TEST_CASE("IndexedGlyphSet constructs with unique glyphs and infers glyph size", "[IndexedGlyphSet]") {
     std::string glyphs;
     glyphs.append("\xC3\xB1"); // ñ (2 bytes)
@@ -45,6 +51,21 @@ TEST_CASE("IndexedGlyphSet throws on invalid glyph size input", "[IndexedGlyphSe
     REQUIRE_THROWS_AS(IndexedGlyphSet("test", std::string("\xC3")), std::invalid_argument);
 }
 
+TEST_CASE("IndexedGlyphSet rejects ill-formed UTF-8 glyphs", "[IndexedGlyphSet]") {
+    // A bad continuation byte sorts out of code point order; this once wrote past the code point table
+    REQUIRE_THROWS_AS(IndexedGlyphSet("x", "\xC3\x7F\xC3\x80\xC4\x80"), std::runtime_error);
+
+    for (const std::string glyphs : {
+             "\xC3\xB1\xC3\xC3",                 // lead byte where a continuation belongs
+             "\xC1\xBF\xC3\xB1",                 // overlong 2-byte
+             "\xE0\x80\xAF\xE2\x82\xAC",         // overlong 3-byte
+             "\xED\xA0\x80\xE2\x82\xAC",         // surrogate
+             "\xF4\x90\x80\x80\xF0\x9F\x98\x80", // past U+10FFFF
+         }) {
+        REQUIRE_THROWS_AS(IndexedGlyphSet("x", glyphs), std::runtime_error);
+    }
+}
+
 TEST_CASE("IndexedGlyphSet iterator works", "[IndexedGlyphSet]") {
     std::string glyphs;
     glyphs.append("\xC3\xB1");
@@ -105,4 +126,149 @@ TEST_CASE("IndexedGlyphSet encode/decode performance benchmark", "[IndexedGlyphS
               << decode_duration.count() << " seconds (" << dec_ops_per_sec << " ops/s)\n";
 
     REQUIRE(true); // dummy to satisfy Catch2
-}
\ No newline at end of file
+}
+TEST_CASE("IndexedGlyphSet picks a dense lookup for byte and contiguous sets", "[IndexedGlyphSet]") {
+    IndexedGlyphSet ascii("ascii", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+    REQUIRE(ascii.index_strategy() == GlyphIndexStrategy::ByteTable);
+
+    // Greek capitals U+0391..U+03A9 without the unassigned U+03A2
+    std::string greek;
+    for (uint32_t cp = 0x391; cp <= 0x3A9; ++cp) {
+        if (cp == 0x3A2) continue;
+        greek += static_cast<char>(0xC0 | (cp >> 6));
+        greek += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    IndexedGlyphSet dense("greek", greek);
+    REQUIRE(dense.index_strategy() == GlyphIndexStrategy::CodepointOffset);
+
+    // Two 3-byte glyphs far apart
+    IndexedGlyphSet sparse("sparse", "\xE2\x82\xAC\xEF\xBF\xBD"); // € and U+FFFD
+    REQUIRE(sparse.index_strategy() == GlyphIndexStrategy::Hash);
+
+    for (const IndexedGlyphSet* set : {&ascii, &dense, &sparse}) {
+        for (unsigned i = 0; i < set->size(); ++i) {
+            REQUIRE(set->find_index(set->from_index(i)) == i);
+            REQUIRE(set->to_index(set->from_index(i)) == i);
+        }
+    }
+}
+
+TEST_CASE("IndexedGlyphSet find_index returns NOT_FOUND for glyphs outside the set", "[IndexedGlyphSet]") {
+    IndexedGlyphSet ascii("ascii", "abc");
+    REQUIRE(ascii.find_index("d") == IndexedGlyphSet::NOT_FOUND);
+    REQUIRE(ascii.find_index("\xFF") == IndexedGlyphSet::NOT_FOUND);
+    REQUIRE(ascii.find_index("ab") == IndexedGlyphSet::NOT_FOUND);
+    REQUIRE(ascii.find_index("") == IndexedGlyphSet::NOT_FOUND);
+    REQUIRE_THROWS_AS(ascii.to_index("d"), std::out_of_range);
+
+    IndexedGlyphSet dense("latin", "\xC3\xB1\xC3\xB2\xC3\xB6"); // ñ ò ö
+    REQUIRE(dense.index_strategy() == GlyphIndexStrategy::CodepointOffset);
+    REQUIRE(dense.find_index("\xC3\xB3") == IndexedGlyphSet::NOT_FOUND); // ó, a hole in the range
+    REQUIRE(dense.find_index("\xC3\xBF") == IndexedGlyphSet::NOT_FOUND); // past the range
+    REQUIRE(dense.find_index("\xC3\xB0") == IndexedGlyphSet::NOT_FOUND); // before it
+    REQUIRE(dense.find_index("\xC3\x31") == IndexedGlyphSet::NOT_FOUND); // malformed, decodes to U+00F1
+    REQUIRE(dense.find_index("\xC3") == IndexedGlyphSet::NOT_FOUND);
+}
+
+TEST_CASE("IndexedGlyphSet stores glyphs in one fixed-stride buffer", "[IndexedGlyphSet]") {
+    IndexedGlyphSet igs("test", "\xC3\xB6\xC3\xB1\xC3\xB2"); // ö ñ ò, stored sorted
+
+    const GlyphView view = igs.glyphs();
+    REQUIRE(view.size() == 3);
+    REQUIRE(view[0] == "\xC3\xB1");
+    REQUIRE(view[1] == "\xC3\xB2");
+    REQUIRE(view[2] == "\xC3\xB6");
+    REQUIRE(view.end() - view.begin() == 3);
+    REQUIRE(std::string(igs.data(), 6) == "\xC3\xB1\xC3\xB2\xC3\xB6");
+
+    for (unsigned i = 0; i < igs.size(); ++i)
+        REQUIRE(igs.from_index(i).data() == igs.data() + i * igs.glyph_size());
+
+    // Lookups keep working once the set has moved, whatever the strategy
+    IndexedGlyphSet sparse("sparse", "\xE2\x82\xAC\xEF\xBF\xBD");
+    IndexedGlyphSet moved(std::move(sparse));
+    REQUIRE(moved.index_strategy() == GlyphIndexStrategy::Hash);
+    REQUIRE(moved.to_index("\xEF\xBF\xBD") == 1);
+    REQUIRE(std::vector<std::string_view>(moved.begin(), moved.end()).size() == 2);
+}
+
+// Count distinct glyphs of the given UTF-8 width, code points spread over a wide range
+static std::string sparse_glyphs(const size_t count, const size_t width, const uint32_t seed) {
+    const uint32_t lo = width == 3 ? 0x4E00 : 0x20000;   // CJK, CJK Extension B onwards
+    const uint32_t hi = width == 3 ? 0xD7FF : 0x10FFFF;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint32_t> pick(lo, hi);
+    std::set<uint32_t> codepoints;
+    while (codepoints.size() < count)
+        codepoints.insert(pick(rng));
+
+    std::string out;
+    for (const uint32_t cp : codepoints) {
+        if (width == 3) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        }
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+TEST_CASE("IndexedGlyphSet uses a perfect hash for large sparse sets", "[IndexedGlyphSet]") {
+    for (const size_t width : {3, 4}) {
+        const std::string flat = sparse_glyphs(2000, width, 5);
+        IndexedGlyphSet chosen("sparse", flat);
+        IndexedGlyphSet hashed("sparse", flat, GlyphIndexStrategy::Hash);
+        REQUIRE(chosen.index_strategy() == GlyphIndexStrategy::PerfectHash);
+        REQUIRE(hashed.index_strategy() == GlyphIndexStrategy::Hash);
+
+        for (unsigned i = 0; i < chosen.size(); ++i) {
+            REQUIRE(chosen.find_index(chosen.from_index(i)) == i);
+            REQUIRE(hashed.find_index(hashed.from_index(i)) == i);
+        }
+
+        // Glyphs of another set map nowhere, however the hash places them
+        IndexedGlyphSet other("other", sparse_glyphs(2000, width, 6));
+        for (const auto glyph : other.glyphs())
+            REQUIRE(chosen.find_index(glyph) == hashed.find_index(glyph));
+    }
+
+    // Small sparse sets stay on the hash map
+    REQUIRE(IndexedGlyphSet("small", sparse_glyphs(100, 4, 7)).index_strategy() == GlyphIndexStrategy::Hash);
+    REQUIRE_THROWS_AS(IndexedGlyphSet("wide", sparse_glyphs(10, 3, 8), GlyphIndexStrategy::ByteTable),
+                      std::invalid_argument);
+}
+
+TEST_CASE("IndexedGlyphSet perfect hash vs hash map performance benchmark", "[IndexedGlyphSet][performance]") {
+    constexpr size_t glyph_count = 20000;
+    constexpr size_t lookups = 1'000'000;
+
+    for (const size_t width : {3, 4}) {
+        const std::string flat = sparse_glyphs(glyph_count, width, 9);
+        IndexedGlyphSet perfect("perfect", flat, GlyphIndexStrategy::PerfectHash);
+        IndexedGlyphSet hashed("hashed", flat, GlyphIndexStrategy::Hash);
+
+        std::mt19937 rng(10);
+        std::vector<std::string_view> probes(lookups);
+        for (auto& probe : probes)
+            probe = perfect.from_index(rng() % glyph_count);
+
+        double ops[2];
+        unsigned sink = 0;
+        const IndexedGlyphSet* sets[2] = {&perfect, &hashed};
+        for (int s = 0; s < 2; ++s) {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto probe : probes)
+                sink += sets[s]->find_index(probe);
+            auto end = std::chrono::steady_clock::now();
+            ops[s] = lookups / std::chrono::duration<double>(end - start).count();
+        }
+
+        std::cout << "[benchmark] IndexedGlyphSet " << width << "-byte, " << glyph_count
+                  << " glyphs: " << ops[0] << " perfect hash ops/s, " << ops[1] << " hash map ops/s\n";
+        REQUIRE(sink != 0);
+        CHECK(ops[0] > 1000000);
+    }
+}
@@ -0,0 +1,102 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "NumeralConversion.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Numeral count of the largest power of the radix that fits in 64 bits
+static size_t max_count(const uint32_t radix) {
+    size_t count = 0;
+    for (unsigned __int128 power = radix; power <= (unsigned __int128)1 << 64; power *= radix)
+        ++count;
+    return count;
+}
+
+static uint64_t num_radix(const std::vector<uint32_t>& digits, const uint32_t radix) {
+    uint64_t value = 0;
+    for (const auto digit : digits)
+        value = value * radix + digit;
+    return value;
+}
+
+TEST_CASE("NumeralConversion kernels agree for every radix and length", "[NumeralConversion]") {
+    std::mt19937_64 rng(8);
+
+    for (uint32_t radix = 2; radix <= 65536; radix += radix < 300 ? 1 : 97) {
+        for (size_t count = 0; count <= max_count(radix); ++count) {
+            std::vector<uint32_t> digits(count);
+            for (auto& d : digits) d = static_cast<uint32_t>(rng() % radix);
+            const uint64_t value = num_radix(digits, radix);
+
+            std::vector<uint32_t> scalar(count), dispatched(count);
+            numeral_conversion::str_radix_scalar(value, scalar.data(), count, radix);
+            numeral_conversion::str_radix(value, dispatched.data(), count, radix);
+
+            INFO("radix=" << radix << " count=" << count);
+            REQUIRE(scalar == digits);
+            REQUIRE(dispatched == digits);
+
+            if (numeral_conversion::has_avx2()) {
+                std::vector<uint32_t> avx2(count);
+                numeral_conversion::str_radix_avx2(value, avx2.data(), count, radix);
+                REQUIRE(avx2 == digits);
+            }
+        }
+    }
+}
+
+TEST_CASE("NumeralConversion AVX2 handles the extremes of each radix", "[NumeralConversion]") {
+    if (!numeral_conversion::has_avx2())
+        return;
+
+    for (uint32_t radix : {2u, 10u, 26u, 255u, 256u, 4096u, 8191u, 20992u, 65536u}) {
+        const size_t count = max_count(radix);
+        for (const bool top : {false, true}) {
+            const std::vector<uint32_t> digits(count, top ? radix - 1 : 0);
+            std::vector<uint32_t> out(count);
+            numeral_conversion::str_radix_avx2(num_radix(digits, radix), out.data(), count, radix);
+
+            INFO("radix=" << radix << " top=" << top);
+            REQUIRE(out == digits);
+        }
+    }
+}
+
+TEST_CASE("NumeralConversion scalar vs AVX2 performance benchmark", "[NumeralConversion][performance]") {
+    if (!numeral_conversion::has_avx2())
+        return;
+
+    constexpr uint32_t radix = 1000;
+    constexpr size_t count = 6;
+    constexpr int iterations = 2'000'000;
+    const uint64_t base = 123'456'789'012'345;
+
+    std::vector<uint32_t> digits(count);
+    uint64_t sink = 0;
+
+    auto start_scalar = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        numeral_conversion::str_radix_scalar(base + i, digits.data(), count, radix);
+        sink += digits[count - 1];
+    }
+    auto end_scalar = std::chrono::steady_clock::now();
+
+    auto start_avx2 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        numeral_conversion::str_radix_avx2(base + i, digits.data(), count, radix);
+        sink -= digits[count - 1];
+    }
+    auto end_avx2 = std::chrono::steady_clock::now();
+
+    const double scalar_ops = iterations / std::chrono::duration<double>(end_scalar - start_scalar).count();
+    const double avx2_ops = iterations / std::chrono::duration<double>(end_avx2 - start_avx2).count();
+
+    std::cout << "[benchmark] STR_radix " << count << " numerals: " << scalar_ops << " scalar ops/s, "
+              << avx2_ops << " avx2 ops/s" << std::endl;
+
+    REQUIRE(sink == 0);
+    CHECK(avx2_ops > 1000000);
+}
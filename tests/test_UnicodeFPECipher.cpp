@@ -9,7 +9,9 @@
 #include <string>
 #include <fstream>
 #include <filesystem>
+#include <stdexcept>
 
+#include "allocation_counter.hpp"
 #include "codebook_helpers.hpp"
 
 std::vector<uint8_t> test_key(16, 0x00);
@@ -53,6 +55,42 @@ TEST_CASE("UnicodeFPECipher: noop glyphs pass through unchanged", "[UnicodeFPECi
     REQUIRE(decrypted == input);
 }
 
+TEST_CASE("UnicodeFPECipher: unmapped glyphs of any width pass through unchanged", "[UnicodeFPECipher]")
+{
+    auto book1 = codebook_from_cps({0x61, 0x62, 0x63}); // a, b, c
+
+    std::vector<GlyphFPECipher> glyph_ciphers;
+    glyph_ciphers.emplace_back(&book1, test_key, test_tweak, false);
+
+    UnicodeFPECipher cipher(UnicodeGlyphCipherIndex(std::move(glyph_ciphers), test_key, test_tweak));
+
+    std::string input = "aéb中c😀"; // 2-, 3- and 4-byte glyphs without a cipher
+    std::string encrypted = cipher.encrypt(input);
+    REQUIRE(encrypted.size() == input.size());
+    REQUIRE(encrypted.substr(1, 2) == "é");
+    REQUIRE(encrypted.substr(4, 3) == "中");
+    REQUIRE(encrypted.substr(8, 4) == "😀");
+    REQUIRE(cipher.decrypt(encrypted) == input);
+}
+
+TEST_CASE("UnicodeFPECipher: rejects ill-formed UTF-8", "[UnicodeFPECipher]")
+{
+    UnicodeFPECipher cipher(UnicodeGlyphCipherIndex(test_key, test_tweak));
+
+    const std::string bad_inputs[] = {
+        "abc\x80",                              // lone continuation
+        "Привет\xC0\xAF",                       // overlong
+        "x\xED\xA0\x80y",                       // surrogate
+        "long enough to fill a block \xE2\x82", // truncated
+    };
+    for (const auto& input : bad_inputs)
+    {
+        REQUIRE_THROWS_AS(cipher.encrypt(input), std::runtime_error);
+        REQUIRE_THROWS_AS(cipher.decrypt(input), std::runtime_error);
+    }
+    REQUIRE_THROWS_WITH(cipher.encrypt("Привет\xC0\xAF"), "UnicodeFPECipher: invalid UTF-8 at byte 12");
+}
+
 TEST_CASE("UnicodeFPECipher: mixed mapped and unmapped glyphs", "[UnicodeFPECipher]")
 {
     auto book1 = codebook_from_cps({0x61, 0x62, 0x63}); // a,b,c
@@ -74,6 +112,68 @@ TEST_CASE("UnicodeFPECipher: mixed mapped and unmapped glyphs", "[UnicodeFPECiph
 }
 
 
+TEST_CASE("UnicodeFPECipher: batch matches per-input encryption", "[UnicodeFPECipher][batch]")
+{
+    auto book1 = codebook_from_cps({0x61, 0x62, 0x63}); // a,b,c
+    auto book2 = codebook_from_cps({0x31, 0x32, 0x33}); // 1,2,3
+
+    std::vector<GlyphFPECipher> glyph_ciphers;
+    glyph_ciphers.emplace_back(&book1, test_key, test_tweak, false);
+    glyph_ciphers.emplace_back(&book2, test_key, test_tweak, false);
+
+    UnicodeGlyphCipherIndex ugci(std::move(glyph_ciphers), test_key, test_tweak);
+    UnicodeFPECipher cipher(std::move(ugci));
+
+    std::vector<std::string> inputs = {"a1x2b3y", "", "abcabc", "321", "xyz", "c3"};
+
+    auto encrypted = cipher.encrypt_batch(inputs);
+    REQUIRE(encrypted.size() == inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+        REQUIRE(encrypted[i] == cipher.encrypt(inputs[i]));
+
+    REQUIRE(cipher.decrypt_batch(encrypted) == inputs);
+}
+
+TEST_CASE("UnicodeFPECipher: per-call tweak roundtrip", "[UnicodeFPECipher][tweak]")
+{
+    auto book1 = codebook_from_cps({0x61, 0x62, 0x63}); // a,b,c
+    auto book2 = codebook_from_cps({0x31, 0x32, 0x33}); // 1,2,3
+
+    std::vector<GlyphFPECipher> glyph_ciphers;
+    glyph_ciphers.emplace_back(&book1, test_key, test_tweak, false);
+    glyph_ciphers.emplace_back(&book2, test_key, test_tweak, false);
+
+    UnicodeGlyphCipherIndex ugci(std::move(glyph_ciphers), test_key, test_tweak);
+    UnicodeFPECipher cipher(std::move(ugci));
+
+    std::string input = "abcabcabc1x2b3y";
+    std::vector<uint8_t> tweak_a = {0x01, 0x02, 0x03};
+    std::vector<uint8_t> tweak_b = {0x04, 0x05, 0x06};
+
+    std::string encrypted_a = cipher.encrypt(input, tweak_a);
+    std::string encrypted_b = cipher.encrypt(input, tweak_b);
+    REQUIRE(encrypted_a.size() == input.size());
+    REQUIRE(encrypted_a != encrypted_b);
+    REQUIRE(cipher.encrypt(input, test_tweak) == cipher.encrypt(input));
+
+    REQUIRE(cipher.decrypt(encrypted_a, tweak_a) == input);
+    REQUIRE(cipher.decrypt(encrypted_b, tweak_b) == input);
+}
+
+TEST_CASE("UnicodeFPECipher: FF3-1 glyph ciphers roundtrip", "[UnicodeFPECipher][FF3_1Cipher]")
+{
+    std::vector<uint8_t> tweak(7, 0x02);
+    auto glyph_ciphers = PreconfiguredIndexedGlyphSet::buildAsciiGlyphCiphers(test_key, tweak, FPEAlgorithm::FF3_1);
+    UnicodeGlyphCipherIndex ugci(std::move(glyph_ciphers), test_key, tweak);
+    UnicodeFPECipher cipher(std::move(ugci));
+
+    std::string input = "Format-preserving encryption, 8 rounds!";
+    std::string encrypted = cipher.encrypt(input);
+    REQUIRE(encrypted.size() == input.size());
+    REQUIRE(encrypted != input);
+    REQUIRE(cipher.decrypt(encrypted) == input);
+}
+
 // Load Google's 10,000 words from file
 static std::vector<std::string> load_words()
 {
@@ -89,6 +189,177 @@ static std::vector<std::string> load_words()
     return words;
 }
 
+TEST_CASE("UnicodeFPECipher over a lazy index matches one over eager ciphers", "[UnicodeFPECipher][lazy]") {
+    const std::vector<uint8_t> key(16, 0x05);
+    const std::vector<uint8_t> tweak(8, 0x06);
+
+    UnicodeFPECipher lazy{UnicodeGlyphCipherIndex(key, tweak)};
+    UnicodeFPECipher eager{
+        UnicodeGlyphCipherIndex(PreconfiguredIndexedGlyphSet::buildUnicodeGlyphCiphers(key, tweak), key, tweak)};
+
+    const std::vector<std::string> inputs = {"Hello, world", "Привет мир", "日本語のテキスト", "mixed Ж 中 😀 text"};
+    for (const auto& input : inputs) {
+        const auto encrypted = lazy.encrypt(input);
+        REQUIRE(encrypted == eager.encrypt(input));
+        REQUIRE(lazy.decrypt(encrypted) == input);
+    }
+    REQUIRE(lazy.encrypt_batch(inputs) == eager.encrypt_batch(inputs));
+}
+
+TEST_CASE("UnicodeFPECipher: all-ASCII input matches encrypting each glyph class on its own", "[UnicodeFPECipher][ascii]") {
+    const std::vector<uint8_t> key(16, 0x07);
+    const std::vector<uint8_t> tweak(8, 0x08);
+    const std::vector<uint8_t> other_tweak(8, 0x09);
+
+    UnicodeFPECipher cipher{
+        UnicodeGlyphCipherIndex(PreconfiguredIndexedGlyphSet::buildAsciiGlyphCiphers(key, tweak), key, tweak)};
+    const UnicodeGlyphCipherIndex reference(PreconfiguredIndexedGlyphSet::buildAsciiGlyphCiphers(key, tweak), key, tweak);
+
+    // What the general path does: each class's glyphs in order through its own cipher, then back into place
+    auto expected = [&](const std::string& input, const bool encrypt, const std::vector<uint8_t>* per_call_tweak) {
+        std::vector<std::string> classes(reference.cipher_count());
+        for (const char c : input)
+            classes[reference.cipher_id(static_cast<unsigned char>(c))] += c;
+        for (size_t id = 0; id < classes.size(); ++id) {
+            if (classes[id].empty())
+                continue;
+            const GlyphFPECipher& glyph_cipher = reference.cipher(static_cast<uint16_t>(id));
+            if (per_call_tweak)
+                classes[id] = encrypt ? glyph_cipher.encrypt(classes[id], *per_call_tweak)
+                                      : glyph_cipher.decrypt(classes[id], *per_call_tweak);
+            else
+                classes[id] = encrypt ? glyph_cipher.encrypt(classes[id]) : glyph_cipher.decrypt(classes[id]);
+        }
+        std::vector<size_t> taken(classes.size(), 0);
+        std::string output;
+        for (const char c : input) {
+            const uint16_t id = reference.cipher_id(static_cast<unsigned char>(c));
+            output += classes[id][taken[id]++];
+        }
+        return output;
+    };
+
+    std::string every_byte;
+    for (int c = 0; c < 0x80; ++c)
+        every_byte += static_cast<char>(c);
+    const std::vector<std::string> inputs = {
+        "", "a", "jane.doe+billing@example.com", "ACCT-0042-7731-9", "O'Brien, Mary-Kate\t(ext. 12)", every_byte,
+        std::string(300, 'z')
+    };
+    for (const auto& input : inputs) {
+        INFO(input);
+        const auto encrypted = cipher.encrypt(input);
+        REQUIRE(encrypted == expected(input, true, nullptr));
+        REQUIRE(cipher.decrypt(encrypted) == input);
+        REQUIRE(cipher.decrypt(input) == expected(input, false, nullptr));
+
+        const auto tweaked = cipher.encrypt(input, other_tweak);
+        REQUIRE(tweaked == expected(input, true, &other_tweak));
+        REQUIRE(cipher.decrypt(tweaked, other_tweak) == input);
+    }
+
+    // One non-ASCII glyph sends the input down the general path, which still passes it through
+    const std::string mixed = "jane.doe@exämple.com";
+    const auto encrypted = cipher.encrypt(mixed);
+    REQUIRE(encrypted.find("ä") != std::string::npos);
+    REQUIRE(cipher.decrypt(encrypted) == mixed);
+}
+
+TEST_CASE("UnicodeFPECipher: encrypt_into matches encrypt, in place and across ciphers", "[UnicodeFPECipher][into]") {
+    const std::vector<uint8_t> key(16, 0x0A);
+    const std::vector<uint8_t> tweak(8, 0x0B);
+    const std::vector<uint8_t> other_tweak(8, 0x0C);
+
+    // Ciphers with different cipher counts take turns with one context
+    const UnicodeFPECipher blocks{UnicodeGlyphCipherIndex(key, tweak)};
+    const UnicodeFPECipher ascii{
+        UnicodeGlyphCipherIndex(PreconfiguredIndexedGlyphSet::buildAsciiGlyphCiphers(key, tweak), key, tweak)};
+    TokenizeContext ctx;
+
+    const std::vector<std::string> inputs = {
+        "", "plain ascii 42", "Привет мир", "mixed Ж 中 😀 text", "日本語のテキスト and more", "jane.doe@exämple.com"
+    };
+    for (const UnicodeFPECipher* cipher : {&blocks, &ascii, &blocks}) {
+        for (const auto& input : inputs) {
+            INFO(input);
+            std::string out(input.size() + 3, '#');
+            REQUIRE(cipher->encrypt_into(input, out, ctx) == input.size());
+            const std::string encrypted = out.substr(0, input.size());
+            REQUIRE(encrypted == cipher->encrypt(input));
+            REQUIRE(out.substr(input.size()) == "###");
+
+            std::string in_place = encrypted;
+            REQUIRE(cipher->decrypt_into(in_place, in_place, ctx) == input.size());
+            REQUIRE(in_place == input);
+
+            REQUIRE(cipher->encrypt_into(in_place, in_place, ctx, other_tweak) == input.size());
+            REQUIRE(in_place == cipher->encrypt(input, other_tweak));
+            cipher->decrypt_into(in_place, in_place, ctx, other_tweak);
+            REQUIRE(in_place == input);
+        }
+    }
+
+    // Batches scan every input through the thread's context, ASCII ones included
+    std::vector<std::string> expected;
+    for (const auto& input : inputs)
+        expected.push_back(blocks.encrypt(input));
+    REQUIRE(blocks.encrypt_batch(inputs) == expected);
+    REQUIRE(blocks.decrypt_batch(expected) == inputs);
+    REQUIRE(ascii.encrypt(inputs[4]) == ascii.encrypt_batch({inputs[4]})[0]);
+}
+
+TEST_CASE("UnicodeFPECipher: encrypt_into rejects a short output and recovers from bad input", "[UnicodeFPECipher][into]") {
+    const std::vector<uint8_t> key(16, 0x0D);
+    const std::vector<uint8_t> tweak(8, 0x0E);
+    const UnicodeFPECipher cipher{UnicodeGlyphCipherIndex(key, tweak)};
+    TokenizeContext ctx;
+
+    const std::string input = "mixed Ж 中 😀 text";
+    std::string out(input.size() - 1, '\0');
+    REQUIRE_THROWS_AS(cipher.encrypt_into(input, out, ctx), std::invalid_argument);
+
+    // Ill-formed input leaves nothing behind in the context
+    out.resize(input.size());
+    const std::string bad = "Ж 中 \xE2\x82 😀";
+    REQUIRE_THROWS_AS(cipher.encrypt_into(bad, out, ctx), std::runtime_error);
+    REQUIRE(cipher.encrypt_into(input, out, ctx) == input.size());
+    REQUIRE(out == cipher.encrypt(input));
+}
+
+TEST_CASE("UnicodeFPECipher: encrypt_into makes no heap allocations once warmed up", "[UnicodeFPECipher][into]") {
+    const std::vector<uint8_t> key(16, 0x0F);
+    const std::vector<uint8_t> tweak(8, 0x10);
+    const std::vector<uint8_t> other_tweak(8, 0x11);
+    const UnicodeFPECipher cipher{UnicodeGlyphCipherIndex(key, tweak)};
+    TokenizeContext ctx;
+
+    const std::vector<std::string> inputs = {
+        "jane.doe+billing@example.com", "Привет мир", "mixed Ж 中 😀 text", "日本語のテキスト", "ACCT-0042-7731-9", "x"
+    };
+    std::string out(64, '\0');
+
+    // The first round creates the ciphers in use and grows the context to fit
+    for (const auto& input : inputs) {
+        cipher.encrypt_into(input, out, ctx);
+        cipher.decrypt_into(input, out, ctx);
+        cipher.encrypt_into(input, out, ctx, other_tweak);
+        cipher.encrypt_into(input, out, UnicodeFPECipher::thread_context());
+    }
+
+    for (const auto& input : inputs) {
+        const size_t before = thread_allocation_count();
+        cipher.encrypt_into(input, out, ctx);
+        cipher.decrypt_into(std::string_view(out.data(), input.size()), out, ctx);
+        cipher.encrypt_into(input, out, ctx, other_tweak);
+        cipher.encrypt_into(input, out, UnicodeFPECipher::thread_context());
+        const size_t after = thread_allocation_count();
+
+        INFO(input);
+        REQUIRE(after == before);
+        REQUIRE(out.substr(0, input.size()) == cipher.encrypt(input));
+    }
+}
+
 TEST_CASE("UnicodeFPECipher benchmark 10,000 words", "[UnicodeFPECipher][performance]") {
     std::vector<uint8_t> key(16, 0x01);   // example key
     std::vector<uint8_t> tweak(4, 0x02);  // example tweak
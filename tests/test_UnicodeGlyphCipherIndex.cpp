@@ -1,6 +1,11 @@
 #include <catch2/catch_test_macros.hpp>
 #include "UnicodeGlyphCipherIndex.hpp"
 #include "IndexedGlyphSet.hpp"
+#include "PreconfiguredIndexedGlyphSet.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
 #include <vector>
 
 #include "codebook_helpers.hpp"
@@ -92,3 +97,226 @@ TEST_CASE("UnicodeGlyphCipherIndex: move semantics") {
     REQUIRE(cipher2.glyphs().contains(std::string(1, static_cast<char>(cp))));
 }
 
+
+TEST_CASE("CodepointCipherTable shares uniform pages and copies on write", "[UnicodeGlyphCipherIndex]") {
+    CodepointCipherTable table;
+    const size_t empty_bytes = table.byte_size();
+
+    table.assign(0x4E00, 0x9FFF, 1); // 82 whole pages
+    REQUIRE(table.page_count() == 2);
+    table.assign(0x0370, 0x03FF, 2); // half a page
+    table.assign(0x0400, 0x04FF, 3); // a whole page
+    table.assign(0x0300, 0x036F, 4); // the other half of the first
+    REQUIRE(table.page_count() == 4);
+
+    REQUIRE(table[0x4E00] == 1);
+    REQUIRE(table[0x9FFF] == 1);
+    REQUIRE(table[0x4DFF] == CodepointCipherTable::NO_CIPHER);
+    REQUIRE(table[0xA000] == CodepointCipherTable::NO_CIPHER);
+    REQUIRE(table[0x036F] == 4);
+    REQUIRE(table[0x0370] == 2);
+    REQUIRE(table[0x0400] == 3);
+    REQUIRE(table[0x110000] == CodepointCipherTable::NO_CIPHER);
+    REQUIRE(table.byte_size() < empty_bytes + 4 * 512 + 16);
+
+    // Overlaps are rejected on private and shared pages alike
+    REQUIRE_THROWS_AS(table.assign(0x03FF, 0x03FF, 5), std::invalid_argument);
+    REQUIRE_THROWS_AS(table.assign(0x9F00, 0x9FFF, 5), std::invalid_argument);
+    REQUIRE_THROWS_AS(table.assign(0x5000, 0x5000, 5), std::invalid_argument);
+    REQUIRE(table[0x5000] == 1);
+
+    // Copies are independent values
+    CodepointCipherTable copy = table;
+    copy.assign(0x0041, 0x0041, 6);
+    REQUIRE(copy[0x41] == 6);
+    REQUIRE(table[0x41] == CodepointCipherTable::NO_CIPHER);
+}
+
+TEST_CASE("UnicodeGlyphCipherIndex maps every Unicode block code point to its cipher", "[UnicodeGlyphCipherIndex]") {
+    const std::vector<uint8_t> key(16, 0x11);
+    const std::vector<uint8_t> tweak(8, 0x22);
+
+    auto ciphers = PreconfiguredIndexedGlyphSet::buildUnicodeGlyphCiphers(key, tweak);
+    const auto start = std::chrono::steady_clock::now();
+    UnicodeGlyphCipherIndex index(std::move(ciphers), key, tweak);
+    const auto end = std::chrono::steady_clock::now();
+
+    for (uint16_t id = 0; id < index.cipher_count(); ++id) {
+        const auto* range = index.cipher(id).codepoint_range();
+        REQUIRE(range != nullptr);
+        for (unsigned i = 0; i < range->size(); ++i) {
+            const uint32_t cp = range->codepoint(i);
+            REQUIRE(index.cipher_id(cp) == id);
+            REQUIRE(&index[cp] == &index.cipher(id));
+        }
+    }
+    REQUIRE(&index[0xD800] == &index.noop_cipher);
+    REQUIRE(index.cipher_id(0x10FFFF + 1) == CodepointCipherTable::NO_CIPHER);
+    REQUIRE_FALSE(index.table().owns_pages());
+
+    std::cout << "[benchmark] UnicodeGlyphCipherIndex over " << index.cipher_count() << " blocks: "
+              << std::chrono::duration<double, std::micro>(end - start).count() << " us, "
+              << index.table().page_count() << " pages, " << index.table().byte_size() << " bytes" << std::endl;
+    CHECK(index.table().byte_size() < 256 * 1024);
+}
+
+TEST_CASE("CodepointGlyphTable gives the cipher and glyph index of a code point in one lookup", "[UnicodeGlyphCipherIndex]") {
+    const std::vector<uint8_t> key(16, 0x13);
+    const std::vector<uint8_t> tweak(8, 0x24);
+
+    // Two whole pages of an IndexedGlyphSet, whose indexes differ page to page, a range across the surrogates and
+    // scattered glyphs, noop ones among them
+    std::string kana_glyphs;
+    for (uint32_t cp = 0x3000; cp <= 0x31FF; ++cp)
+        PreconfiguredIndexedGlyphSet::encode_utf8(cp, kana_glyphs);
+    const IndexedGlyphSet kana("kana", kana_glyphs);
+    const CodepointRangeGlyphSet around_surrogates("around surrogates", 0xD000, 0xE0FF);
+    auto letters = codebook_from_cps({0x41, 0x5A, 0x7A});
+    auto accents = codebook_from_cps({0xC0, 0x100, 0x1FF});
+    auto marks = codebook_from_cps({0x21, 0x3F});
+
+    const auto shared_key = std::make_shared<const FPEKeyContext>(key);
+    std::vector<GlyphFPECipher> ciphers;
+    ciphers.emplace_back(&kana, shared_key, tweak);
+    ciphers.emplace_back(&around_surrogates, shared_key, tweak);
+    ciphers.emplace_back(&letters, shared_key, tweak);
+    ciphers.emplace_back(&accents, shared_key, tweak);
+    ciphers.emplace_back(GlyphFPECipher(&marks)); // noop
+    const UnicodeGlyphCipherIndex index(std::move(ciphers), key, tweak);
+    const CodepointGlyphTable table = index.glyph_table();
+
+    for (uint32_t cp = 0; cp <= CodepointGlyphTable::MAX_CODEPOINT; ++cp) {
+        const uint16_t id = index.cipher_id(cp);
+        const CodepointGlyphTable::Glyph glyph = table[cp];
+        if (id == CodepointCipherTable::NO_CIPHER || index.cipher(id).is_noop()) {
+            if (glyph.cipher != CodepointGlyphTable::NO_CIPHER)
+                FAIL("code point " << cp << " should be unmapped");
+            continue;
+        }
+        std::string utf8;
+        PreconfiguredIndexedGlyphSet::encode_utf8(cp, utf8);
+        const GlyphFPECipher& cipher = index.cipher(id);
+        const unsigned expected = cipher.codepoint_range() ? cipher.codepoint_range()->find_index(utf8)
+                                                           : cipher.glyphs().find_index(utf8);
+        if (glyph.cipher != id || glyph.index != expected)
+            FAIL("code point " << cp << ": " << glyph.cipher << "/" << glyph.index << " != " << id << "/" << expected);
+    }
+    REQUIRE(table[0x10FFFF + 1].cipher == CodepointGlyphTable::NO_CIPHER);
+
+    // The Unicode blocks share pages as their id table does, and creating the table creates no cipher
+    const UnicodeGlyphCipherIndex blocks(key, tweak);
+    const CodepointGlyphTable block_table = blocks.glyph_table();
+    REQUIRE(blocks.created_count() == 0);
+    REQUIRE(block_table.page_count() <= blocks.table().page_count() + 1);
+    for (uint32_t cp : {0x41u, 0x416u, 0x4E2Du, 0xAC00u, 0x1F600u, 0x10FE0u}) {
+        const auto& range = unicode_block_tables::glyph_sets[blocks.cipher_id(cp)];
+        REQUIRE(block_table[cp].cipher == blocks.cipher_id(cp));
+        REQUIRE(block_table[cp].index == range.index_of(cp));
+    }
+    std::cout << "[benchmark] CodepointGlyphTable over Unicode blocks: " << block_table.page_count() << " pages, "
+              << block_table.byte_size() << " bytes" << std::endl;
+}
+
+TEST_CASE("Compile-time Unicode block table matches one built at run time", "[UnicodeGlyphCipherIndex]") {
+    static_assert(unicode_block_tables::GLYPH_BLOCK_COUNT + 3 == std::size(unicode_blocks)); // less the surrogates
+
+    const auto shared = CodepointCipherTable::over(unicode_block_tables::directory, unicode_block_tables::pages);
+    CodepointCipherTable built;
+    for (uint16_t id = 0; id < unicode_block_tables::glyph_sets.size(); ++id) {
+        const auto& set = unicode_block_tables::glyph_sets[id];
+        for (unsigned i = 0; i < set.size(); ++i)
+            built.assign(set.codepoint(i), set.codepoint(i), id);
+    }
+    for (uint32_t cp = 0; cp <= CodepointCipherTable::MAX_CODEPOINT; ++cp)
+        if (shared[cp] != built[cp])
+            FAIL("code point " << cp << ": " << shared[cp] << " != " << built[cp]);
+    REQUIRE(shared.page_count() <= built.page_count());
+    REQUIRE(unicode_block_tables::glyph_sets[0].name() == "Basic Latin");
+
+    // Assigning to a copy moves it onto pages of its own and leaves the static pages alone
+    CodepointCipherTable copy = shared;
+    REQUIRE_THROWS_AS(copy.assign(0x4E00, 0x4E00, 7), std::invalid_argument);
+    copy.assign(0xE0000, 0xE007F, 7);
+    REQUIRE(copy.owns_pages());
+    REQUIRE(copy[0xE0041] == 7);
+    REQUIRE(copy[0x4E00] == shared[0x4E00]);
+    REQUIRE(shared[0xE0041] == CodepointCipherTable::NO_CIPHER);
+
+    // Ciphers in any other order get a table of their own
+    const std::vector<uint8_t> key(16, 0x11);
+    const std::vector<uint8_t> tweak(8, 0x22);
+    auto ciphers = PreconfiguredIndexedGlyphSet::buildUnicodeGlyphCiphers(key, tweak);
+    std::swap(ciphers.front(), ciphers.back());
+    UnicodeGlyphCipherIndex reordered(std::move(ciphers), key, tweak);
+    REQUIRE(reordered.table().owns_pages());
+    REQUIRE(reordered.cipher_id('A') == reordered.cipher_count() - 1);
+    REQUIRE(reordered[0x4E00].codepoint_range()->name() == "CJK Unified Ideographs");
+}
+
+TEST_CASE("Lazy UnicodeGlyphCipherIndex creates block ciphers on first use", "[UnicodeGlyphCipherIndex][lazy]") {
+    const std::vector<uint8_t> key(16, 0x11);
+    const std::vector<uint8_t> tweak(8, 0x22);
+
+    const auto start = std::chrono::steady_clock::now();
+    UnicodeGlyphCipherIndex lazy(key, tweak);
+    const auto end = std::chrono::steady_clock::now();
+    UnicodeGlyphCipherIndex eager(PreconfiguredIndexedGlyphSet::buildUnicodeGlyphCiphers(key, tweak), key, tweak);
+
+    REQUIRE(lazy.cipher_count() == eager.cipher_count());
+    REQUIRE(lazy.created_count() == 0);
+    REQUIRE(eager.created_count() == eager.cipher_count());
+    REQUIRE(&lazy[0xD800] == &lazy.noop_cipher);
+    REQUIRE(lazy.created_count() == 0);
+
+    // Same ids, same ciphers
+    const uint32_t zhe = 0x0416; // Ж
+    REQUIRE(lazy.cipher_id(zhe) == eager.cipher_id(zhe));
+    REQUIRE(lazy[zhe].encrypt("Привет") == eager[zhe].encrypt("Привет"));
+    REQUIRE(lazy.created_count() == 1);
+    REQUIRE(lazy.is_created(lazy.cipher_id(zhe)));
+    REQUIRE(&lazy[zhe] == &lazy[0x0430]); // the same Cyrillic cipher
+
+    lazy.prewarm({"Greek and Coptic", "CJK Unified Ideographs"});
+    REQUIRE(lazy.created_count() == 3);
+    REQUIRE(lazy.is_created(lazy.cipher_id(0x4E2D)));
+    REQUIRE_THROWS_AS(lazy.prewarm({"Klingon"}), std::invalid_argument);
+
+    lazy.prewarm(U"Hi 😀");
+    REQUIRE(lazy.created_count() == 5); // Basic Latin and Emoticons
+    REQUIRE(lazy[0x1F600].encrypt("😀😃") == eager[0x1F600].encrypt("😀😃"));
+
+    // A bad key fails at construction, not at first use
+    REQUIRE_THROWS(UnicodeGlyphCipherIndex(std::vector<uint8_t>(5, 0x00), tweak));
+
+    std::cout << "[benchmark] lazy UnicodeGlyphCipherIndex built in "
+              << std::chrono::duration<double, std::micro>(end - start).count() << " us" << std::endl;
+}
+
+TEST_CASE("Lazy UnicodeGlyphCipherIndex creates each cipher once across threads", "[UnicodeGlyphCipherIndex][lazy]") {
+    const std::vector<uint8_t> key(16, 0x33);
+    const std::vector<uint8_t> tweak(8, 0x44);
+    UnicodeGlyphCipherIndex lazy(key, tweak);
+
+    const std::vector<uint32_t> codepoints = {'a', 0x0416, 0x03B1, 0x4E2D, 0xAC00, 0x1F600, 0x05D0, 0x0E01};
+    constexpr int threads = 8;
+    std::vector<std::vector<const GlyphFPECipher*>> seen(threads);
+    std::atomic<int> waiting{threads};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            waiting.fetch_sub(1);
+            while (waiting.load() > 0) {}
+            for (int round = 0; round < 100; ++round)
+                for (size_t i = 0; i < codepoints.size(); ++i) {
+                    const GlyphFPECipher* cipher = &lazy[codepoints[(i + t) % codepoints.size()]];
+                    if (round == 0) seen[t].push_back(cipher);
+                }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    REQUIRE(lazy.created_count() == codepoints.size());
+    for (int t = 0; t < threads; ++t)
+        for (size_t i = 0; i < codepoints.size(); ++i)
+            REQUIRE(seen[t][i] == &lazy[codepoints[(i + t) % codepoints.size()]]);
+}
@@ -0,0 +1,225 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "PreconfiguredIndexedGlyphSet.hpp"
+#include "UnicodeGlyphCipherIndex.hpp"
+#include "Utf8Scan.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Scan
+    {
+        size_t glyphs;
+        std::vector<uint16_t> ids;
+        std::vector<uint32_t> indexes;
+        std::vector<size_t> glyph_counts;
+    };
+
+    template <typename ScanFn>
+    Scan run(ScanFn scan, const std::string& input, const CodepointGlyphTable& table, const uint16_t unmapped_id) {
+        Scan result{
+            0, std::vector<uint16_t>(input.size()), std::vector<uint32_t>(input.size()),
+            std::vector<size_t>(unmapped_id + 1, 0)
+        };
+        result.glyphs = scan(
+            input, table, unmapped_id, result.ids.data(), result.indexes.data(), result.glyph_counts.data()
+        );
+        if (result.glyphs != utf8_scan::INVALID) {
+            result.ids.resize(result.glyphs);
+            result.indexes.resize(result.glyphs);
+            // Indexes of unmapped glyphs are unspecified
+            for (size_t i = 0; i < result.glyphs; ++i)
+                if (result.ids[i] == unmapped_id)
+                    result.indexes[i] = 0;
+        }
+        return result;
+    }
+
+    // Every variant this CPU has, each required to agree with the scalar scan
+    Scan require_scans_agree(const std::string& input, const CodepointGlyphTable& table, const uint16_t unmapped_id) {
+        const Scan scalar = run(utf8_scan::scan_scalar, input, table, unmapped_id);
+        const Scan dispatched = run(utf8_scan::scan, input, table, unmapped_id);
+        REQUIRE(dispatched.glyphs == scalar.glyphs);
+        if (utf8_scan::has_avx2()) {
+            const Scan avx2 = run(utf8_scan::scan_avx2, input, table, unmapped_id);
+            REQUIRE(avx2.glyphs == scalar.glyphs);
+            if (scalar.glyphs != utf8_scan::INVALID) {
+                REQUIRE(avx2.ids == scalar.ids);
+                REQUIRE(avx2.indexes == scalar.indexes);
+                REQUIRE(avx2.glyph_counts == scalar.glyph_counts);
+            }
+        }
+        return scalar;
+    }
+
+    std::string random_text(std::mt19937& rng, const size_t glyphs) {
+        // ASCII runs with Cyrillic, CJK, emoji and unassigned code points mixed in
+        const std::pair<uint32_t, uint32_t> ranges[] = {
+            {0x20, 0x7E}, {0x20, 0x7E}, {0x20, 0x7E}, {0x0400, 0x04FF}, {0x4E00, 0x9FFF}, {0x1F600, 0x1F64F},
+            {0xE000, 0xF8FF}, {0x0860, 0x086F}, {0x10FFF0, 0x10FFFF}
+        };
+        std::string text;
+        for (size_t i = 0; i < glyphs; ++i) {
+            const auto& [first, last] = ranges[rng() % std::size(ranges)];
+            PreconfiguredIndexedGlyphSet::encode_utf8(first + rng() % (last - first + 1), text);
+        }
+        return text;
+    }
+}
+
+TEST_CASE("Utf8Scan finds the cipher and glyph index of every glyph and counts glyphs per cipher", "[Utf8Scan]") {
+    const UnicodeGlyphCipherIndex index(std::vector<uint8_t>(16, 0x01), std::vector<uint8_t>(8, 0x02));
+    const CodepointGlyphTable table = index.glyph_table();
+    const auto unmapped = static_cast<uint16_t>(index.cipher_count());
+    std::mt19937 rng(22);
+
+    for (size_t glyphs = 0; glyphs <= 200; glyphs += 1 + glyphs / 10) {
+        INFO("glyphs=" << glyphs);
+        const std::string text = random_text(rng, glyphs);
+        const Scan scan = require_scans_agree(text, table, unmapped);
+        REQUIRE(scan.glyphs == glyphs);
+
+        std::vector<size_t> glyph_counts(unmapped + 1, 0);
+        size_t pos = 0;
+        for (size_t i = 0; i < glyphs; ++i) {
+            const size_t width = utf8_scan::width(static_cast<unsigned char>(text[pos]));
+            const std::string_view glyph = std::string_view(text).substr(pos, width);
+            const uint16_t id = index.cipher_id(decode_utf8(glyph));
+            if (id == CodepointCipherTable::NO_CIPHER) {
+                REQUIRE(scan.ids[i] == unmapped);
+            } else {
+                REQUIRE(scan.ids[i] == id);
+                REQUIRE(scan.indexes[i] == index.cipher(id).codepoint_range()->find_index(glyph));
+            }
+            ++glyph_counts[scan.ids[i]];
+            pos += width;
+        }
+        REQUIRE(scan.glyph_counts == glyph_counts);
+    }
+
+    // Long pure ASCII input, in and out of block alignment
+    for (const size_t size : {31, 32, 33, 64, 100}) {
+        const std::string ascii(size, 'q');
+        const Scan scan = require_scans_agree(ascii, table, unmapped);
+        REQUIRE(scan.glyphs == size);
+        REQUIRE(scan.glyph_counts[index.cipher_id('q')] == size);
+        REQUIRE(scan.indexes == std::vector<uint32_t>(size, 'q')); // Basic Latin starts at U+0000
+    }
+}
+
+TEST_CASE("Utf8Scan rejects ill-formed UTF-8 wherever it sits", "[Utf8Scan]") {
+    const UnicodeGlyphCipherIndex index(std::vector<uint8_t>(16, 0x01), std::vector<uint8_t>(8, 0x02));
+    const CodepointGlyphTable table = index.glyph_table();
+    const auto unmapped = static_cast<uint16_t>(index.cipher_count());
+
+    const std::string bad_sequences[] = {
+        "\x80",             // lone continuation
+        "\xC0\xAF",         // overlong 2-byte
+        "\xC1\xBF",         // overlong 2-byte
+        "\xE0\x80\xAF",     // overlong 3-byte
+        "\xF0\x80\x80\xAF", // overlong 4-byte
+        "\xED\xA0\x80",     // surrogate
+        "\xED\xBF\xBF",     // surrogate
+        "\xF4\x90\x80\x80", // past U+10FFFF
+        "\xF5\x80\x80\x80", // lead never used
+        "\xFF",             // lead never used
+        "\xC3(",            // ASCII where a continuation belongs
+        "\xE2\x82(",        // likewise, third byte
+        "\xF0\x9F\x98(",    // likewise, fourth byte
+        "\xE2\x82\xAC\xAC", // continuation too many
+    };
+
+    const std::string fill[] = {"a", "Ж", "中", "😀"};
+    for (const auto& bad : bad_sequences) {
+        std::string prefix;
+        for (size_t i = 0; prefix.size() < 70; ++i) {
+            const std::string input = prefix + bad + "ok";
+            INFO("bad sequence at byte " << prefix.size());
+            REQUIRE(require_scans_agree(input, table, unmapped).glyphs == utf8_scan::INVALID);
+            REQUIRE(utf8_scan::first_invalid(input) >= prefix.size());
+            REQUIRE(utf8_scan::first_invalid(input) < prefix.size() + bad.size());
+            prefix += fill[i % std::size(fill)];
+        }
+    }
+
+    // Truncated at the very end, including at a block boundary
+    for (const std::string cut : {"\xC3", "\xE2\x82", "\xF0\x9F\x98"}) {
+        for (const size_t size : {0, 29, 31, 32, 63}) {
+            const std::string input = std::string(size, 'a') + cut;
+            REQUIRE(require_scans_agree(input, table, unmapped).glyphs == utf8_scan::INVALID);
+            REQUIRE(utf8_scan::first_invalid(input) == size);
+        }
+    }
+
+    // Edges of the valid ranges pass
+    const std::string edges = "\xC2\x80\xDF\xBF\xE0\xA0\x80\xED\x9F\xBF\xEE\x80\x80\xF0\x90\x80\x80\xF4\x8F\xBF\xBF";
+    REQUIRE(require_scans_agree(edges, table, unmapped).glyphs == 7);
+    REQUIRE(utf8_scan::first_invalid(edges) == edges.size());
+}
+
+TEST_CASE("Utf8Scan tells all-ASCII input apart wherever a non-ASCII byte sits", "[Utf8Scan]") {
+    auto require_is_ascii = [](const std::string& input, const bool ascii) {
+        REQUIRE(utf8_scan::is_ascii_scalar(input) == ascii);
+        REQUIRE(utf8_scan::is_ascii(input) == ascii);
+        if (utf8_scan::has_avx2())
+            REQUIRE(utf8_scan::is_ascii_avx2(input) == ascii);
+    };
+
+    require_is_ascii("", true);
+    for (const size_t size : {1, 7, 8, 31, 32, 33, 127, 128, 129, 300}) {
+        INFO("size=" << size);
+        const std::string ascii(size, '\x7F');
+        require_is_ascii(ascii, true);
+        for (size_t at = 0; at < size; at += 1 + size / 16) {
+            std::string input = ascii;
+            input[at] = '\x80';
+            require_is_ascii(input, false);
+        }
+        std::string last = ascii;
+        last.back() = '\xFF';
+        require_is_ascii(last, false);
+    }
+}
+
+TEST_CASE("Utf8Scan scalar vs AVX2 performance benchmark", "[Utf8Scan][performance]") {
+    if (!utf8_scan::has_avx2())
+        return;
+
+    const UnicodeGlyphCipherIndex index(std::vector<uint8_t>(16, 0x01), std::vector<uint8_t>(8, 0x02));
+    const CodepointGlyphTable table = index.glyph_table();
+    const auto unmapped = static_cast<uint16_t>(index.cipher_count());
+    std::mt19937 rng(23);
+
+    const std::string texts[] = {std::string(4096, 'x'), random_text(rng, 1500)};
+    for (const auto& text : texts) {
+        constexpr int iterations = 2'000;
+        std::vector<uint16_t> ids(text.size());
+        std::vector<uint32_t> indexes(text.size());
+        std::vector<size_t> glyph_counts(unmapped + 1, 0);
+        size_t sink = 0;
+
+        auto start_scalar = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            sink += utf8_scan::scan_scalar(text, table, unmapped, ids.data(), indexes.data(), glyph_counts.data());
+        auto end_scalar = std::chrono::steady_clock::now();
+
+        auto start_avx2 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            sink -= utf8_scan::scan_avx2(text, table, unmapped, ids.data(), indexes.data(), glyph_counts.data());
+        auto end_avx2 = std::chrono::steady_clock::now();
+
+        const double bytes = double(iterations) * text.size();
+        const double scalar_rate = bytes / std::chrono::duration<double>(end_scalar - start_scalar).count();
+        const double avx2_rate = bytes / std::chrono::duration<double>(end_avx2 - start_avx2).count();
+
+        std::cout << "[benchmark] Utf8Scan " << text.size() << " bytes: " << scalar_rate / 1e6 << " MB/s scalar, "
+                  << avx2_rate / 1e6 << " MB/s avx2" << std::endl;
+
+        REQUIRE(sink == 0);
+        CHECK(avx2_rate > 100'000'000);
+    }
+}
@@ -1,5 +1,6 @@
 #include "libfpe.hpp"
 
+#include <cstdio>
 #include <cstring>
 #include <catch2/catch_test_macros.hpp>
 
@@ -60,3 +61,32 @@ TEST_CASE("Can use fpe encrypt", "[fpe]")
 
     REQUIRE(std::strcmp(input, decrypted) == 0);
 }
+
+TEST_CASE("Can create fpe from a snapshot file", "[fpe]")
+{
+    const char* path = "libfpe_test_snapshot.bin";
+    REQUIRE(unicodefpe_write_snapshot(path) == 0);
+    REQUIRE(unicodefpe_create_from_snapshot("no_such_snapshot.bin") == nullptr);
+
+    UnicodeFPECipherHandle built = unicodefpe_create();
+    UnicodeFPECipherHandle first = unicodefpe_create_from_snapshot(path);
+    UnicodeFPECipherHandle second = unicodefpe_create_from_snapshot(path);
+    REQUIRE(first != nullptr);
+    REQUIRE(second != nullptr);
+
+    constexpr char input[] = "hello, Мир";
+    char expected[64] = {0};
+    char encrypted[64] = {0};
+    char decrypted[64] = {0};
+    REQUIRE(unicodefpe_encrypt(built, input, strlen(input), expected, sizeof(expected)) == 0);
+    REQUIRE(unicodefpe_encrypt(first, input, strlen(input), encrypted, sizeof(encrypted)) == 0);
+    // Ciphertext may hold NUL bytes, but is as long as the input
+    REQUIRE(std::memcmp(encrypted, expected, sizeof(expected)) == 0);
+    REQUIRE(unicodefpe_decrypt(second, encrypted, strlen(input), decrypted, sizeof(decrypted)) == 0);
+    REQUIRE(std::strcmp(decrypted, input) == 0);
+
+    unicodefpe_destroy(built);
+    unicodefpe_destroy(first);
+    unicodefpe_destroy(second);
+    std::remove(path);
+}